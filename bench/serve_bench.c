@@ -0,0 +1,151 @@
+#define _POSIX_C_SOURCE 200809L
+#include "../src/serve.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+// Compares running a command through a sleepyshell --serve server with starting a fresh
+// `sleepyshell -c` for it. Expects the sleepyshell binary next to this one.
+// Usage: serve_bench [iterations] [command]
+
+#define DEFAULT_ITERATIONS 500
+#define DEFAULT_COMMAND "true"
+
+extern char **environ;
+
+static char shell_path[PATH_MAX];
+static char socket_dir[] = "/tmp/serve_bench.XXXXXX";
+static char socket_path[sizeof(socket_dir) + 8];
+static int null_fd;
+
+static double now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static bool find_shell(void) {
+    const ssize_t n = readlink("/proc/self/exe", shell_path, sizeof(shell_path) - 1);
+    if (n == -1)
+        return false;
+    shell_path[n] = '\0';
+    char *slash = strrchr(shell_path, '/');
+    return slash && snprintf(slash + 1, sizeof(shell_path) - (slash + 1 - shell_path),
+                             "sleepyshell") < (int)sizeof(shell_path);
+}
+
+static pid_t spawn_shell(char *argv[]) {
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, null_fd, STDIN_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, null_fd, STDOUT_FILENO);
+
+    pid_t pid;
+    const int err = posix_spawn(&pid, shell_path, &actions, NULL, argv, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    if (err != 0) {
+        fprintf(stderr, "%s: %s\n", shell_path, strerror(err));
+        exit(1);
+    }
+    return pid;
+}
+
+static void run_request(const int sock, const char *script, const size_t len) {
+    const int fds[3] = {null_fd, null_fd, STDERR_FILENO};
+    int status;
+    if (!serve_send_request(sock, script, len, fds) || !serve_read_status(sock, &status)) {
+        fprintf(stderr, "request failed: %s\n", strerror(errno));
+        exit(1);
+    }
+}
+
+static double measure_fresh_shell_us(const char *command, const int iterations) {
+    char *argv[] = {"sleepyshell", "-c", (char *)command, NULL};
+    const double start = now_us();
+    for (int i = 0; i < iterations; i++) {
+        int status;
+        waitpid(spawn_shell(argv), &status, 0);
+    }
+    return (now_us() - start) / iterations;
+}
+
+static double measure_served_us(const char *command, const int iterations, const bool reuse) {
+    const size_t len = strlen(command);
+    int sock = reuse ? serve_connect(socket_path) : -1;
+    const double start = now_us();
+    for (int i = 0; i < iterations; i++) {
+        if (!reuse)
+            sock = serve_connect(socket_path);
+        if (sock == -1) {
+            fprintf(stderr, "%s: %s\n", socket_path, strerror(errno));
+            exit(1);
+        }
+        run_request(sock, command, len);
+        if (!reuse)
+            close(sock);
+    }
+    const double elapsed = now_us() - start;
+    if (reuse)
+        close(sock);
+    return elapsed / iterations;
+}
+
+static pid_t start_server(void) {
+    char *argv[] = {"sleepyshell", "--serve", socket_path, NULL};
+    const pid_t pid = spawn_shell(argv);
+
+    // Wait for the socket to accept connections
+    for (int attempt = 0; attempt < 200; attempt++) {
+        const int sock = serve_connect(socket_path);
+        if (sock != -1) {
+            close(sock);
+            return pid;
+        }
+        nanosleep(&(struct timespec){.tv_nsec = 10 * 1000 * 1000}, NULL);
+    }
+    fprintf(stderr, "%s: server did not start\n", socket_path);
+    kill(pid, SIGTERM);
+    exit(1);
+}
+
+int main(int argc, char *argv[]) {
+    const int iterations = argc > 1 ? atoi(argv[1]) : DEFAULT_ITERATIONS;
+    const char *command = argc > 2 ? argv[2] : DEFAULT_COMMAND;
+    if (iterations <= 0) {
+        fprintf(stderr, "usage: %s [iterations] [command]\n", argv[0]);
+        return 1;
+    }
+
+    null_fd = open("/dev/null", O_RDWR);
+    if (null_fd == -1 || !find_shell() || !mkdtemp(socket_dir)) {
+        perror("serve_bench");
+        return 1;
+    }
+    snprintf(socket_path, sizeof(socket_path), "%s/sock", socket_dir);
+    const pid_t server = start_server();
+
+    const double fresh_us = measure_fresh_shell_us(command, iterations);
+    const double connect_us = measure_served_us(command, iterations, false);
+    const double reuse_us = measure_served_us(command, iterations, true);
+
+    printf("command: %s, %d iterations\n", command, iterations);
+    printf("%-22s  %10s  %12s\n", "mode", "us/command", "commands/s");
+    printf("%-22s  %10.1f  %12.0f\n", "sleepyshell -c", fresh_us, 1e6 / fresh_us);
+    printf("%-22s  %10.1f  %12.0f\n", "serve, new connection", connect_us, 1e6 / connect_us);
+    printf("%-22s  %10.1f  %12.0f\n", "serve, one connection", reuse_us, 1e6 / reuse_us);
+
+    kill(server, SIGTERM);
+    waitpid(server, NULL, 0);
+    unlink(socket_path);
+    rmdir(socket_dir);
+    return 0;
+}
@@ -0,0 +1,412 @@
+#define _POSIX_C_SOURCE 200809L
+#include "../src/arena.h"
+#include "../src/builtins.h"
+#include "../src/exec.h"
+#include "../src/outbuf.h"
+#include "../src/path_utils.h"
+#include "../src/redirection.h"
+#include "../src/tokenizer.h"
+#include "../src/vars.h"
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// Microbenchmarks for the hot paths of a command line, reported as JSON on stdout.
+// Usage: sleepyshell_bench [--quick] [name-filter]
+//
+// Every benchmark runs BENCH_RUNS timed runs of a fixed iteration count after one warm-up
+// run and reports the median and the fastest run per operation. Inputs are generated from
+// a fixed seed, so two builds see exactly the same work.
+
+#define BENCH_RUNS 5
+#define PATH_DIR_COUNT 100
+#define LOOKUP_TARGET "sleepyshell-bench-target"
+
+typedef void (*BenchFn)(void *ctx, long iterations);
+
+static bool quick;
+static const char *filter;
+static bool first_result = true;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static int compare_u64(const void *a, const void *b) {
+    const uint64_t x = *(const uint64_t *)a;
+    const uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * Times @fn and prints one JSON result object.
+ *
+ * @bytes_per_op  Input bytes one iteration processes, for a throughput figure; 0 for none.
+ */
+static void run_bench(const char *name, BenchFn fn, void *ctx, long iterations,
+                      const size_t bytes_per_op) {
+    if (filter && !strstr(name, filter))
+        return;
+    if (quick)
+        iterations = iterations / 10 ? iterations / 10 : 1;
+
+    fn(ctx, iterations);
+
+    uint64_t runs[BENCH_RUNS];
+    for (int i = 0; i < BENCH_RUNS; i++) {
+        const uint64_t start = now_ns();
+        fn(ctx, iterations);
+        runs[i] = now_ns() - start;
+    }
+    qsort(runs, BENCH_RUNS, sizeof(*runs), compare_u64);
+
+    const double median_ns = (double)runs[BENCH_RUNS / 2] / iterations;
+    const double min_ns = (double)runs[0] / iterations;
+
+    printf("%s\n    {\"name\": \"%s\", \"iterations\": %ld, \"runs\": %d, "
+           "\"ns_per_op\": %.1f, \"min_ns_per_op\": %.1f",
+           first_result ? "" : ",", name, iterations, BENCH_RUNS, median_ns, min_ns);
+    if (bytes_per_op)
+        printf(", \"bytes_per_op\": %zu, \"mb_per_s\": %.1f", bytes_per_op,
+               bytes_per_op * 1e3 / median_ns);
+    printf("}");
+    fflush(stdout);
+    first_result = false;
+}
+
+static uint32_t rng_state = 0x5eed1234u;
+
+static uint32_t rng_next(void) {
+    // xorshift32
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+/**
+ * Builds a command line of about @size bytes of words of 1-12 letters. @quoted_percent of
+ * the words are single- or double-quoted and contain a space.
+ */
+static char *make_line(const size_t size, const unsigned quoted_percent) {
+    char *line = malloc(size + 32);
+    if (!line)
+        return NULL;
+
+    size_t len = 0;
+    while (len < size) {
+        const bool quote = rng_next() % 100 < quoted_percent;
+        const char q = rng_next() % 2 ? '\'' : '"';
+        const size_t word_len = 1 + rng_next() % 12;
+
+        if (quote)
+            line[len++] = q;
+        for (size_t i = 0; i < word_len; i++)
+            line[len++] = (char)('a' + rng_next() % 26);
+        if (quote) {
+            line[len++] = ' ';
+            line[len++] = 'x';
+            line[len++] = q;
+        }
+        line[len++] = ' ';
+    }
+    line[len] = '\0';
+    return line;
+}
+
+typedef struct {
+    Arena arena;
+    const char *line;
+    size_t len;
+} TokenizeCtx;
+
+static void bench_tokenize(void *ctx, const long iterations) {
+    TokenizeCtx *t = ctx;
+    for (long i = 0; i < iterations; i++) {
+        char **tokens;
+        arena_reset(&t->arena);
+        if (tokenize_input_n(&t->arena, t->line, t->len, &tokens) < 0)
+            abort();
+    }
+}
+
+static void run_tokenize_benches(void) {
+    static const size_t sizes[] = {64, 1024, 16384};
+    static const unsigned quoting[] = {0, 10, 50};
+
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(*sizes); s++) {
+        for (size_t q = 0; q < sizeof(quoting) / sizeof(*quoting); q++) {
+            TokenizeCtx ctx = {0};
+            char *line = make_line(sizes[s], quoting[q]);
+            if (!line)
+                abort();
+            ctx.line = line;
+            ctx.len = strlen(line);
+
+            char name[64];
+            snprintf(name, sizeof(name), "tokenize/%zu_bytes/%u%%_quoted", sizes[s], quoting[q]);
+            run_bench(name, bench_tokenize, &ctx, (long)(4000000 / sizes[s]), ctx.len);
+
+            arena_destroy(&ctx.arena);
+            free(line);
+        }
+    }
+}
+
+typedef struct {
+    Arena arena;
+    const char *name;
+    bool cold;
+} LookupCtx;
+
+static void bench_lookup(void *ctx, const long iterations) {
+    LookupCtx *l = ctx;
+    for (long i = 0; i < iterations; i++) {
+        arena_reset(&l->arena);
+        if (l->cold)
+            util_path_cache_clear();
+        util_find_bin_in_path(&l->arena, l->name);
+    }
+}
+
+/**
+ * Creates PATH_DIR_COUNT empty directories under @root and an executable LOOKUP_TARGET in
+ * every one of them, so a lookup through the first N directories always ends in the N-th.
+ */
+static bool make_path_dirs(const char *root, char dirs[][64]) {
+    for (int i = 0; i < PATH_DIR_COUNT; i++) {
+        snprintf(dirs[i], sizeof(dirs[i]), "%s/d%03d", root, i);
+        if (mkdir(dirs[i], 0700) != 0)
+            return false;
+    }
+    return true;
+}
+
+static void place_target(const char *dir, const bool present) {
+    char path[128];
+    snprintf(path, sizeof(path), "%s/" LOOKUP_TARGET, dir);
+    if (!present) {
+        unlink(path);
+        return;
+    }
+
+    const int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0700);
+    if (fd != -1)
+        close(fd);
+}
+
+static void run_lookup_benches(const char *root) {
+    static const int path_lengths[] = {5, 20, 50, 100};
+    static char dirs[PATH_DIR_COUNT][64];
+    if (!make_path_dirs(root, dirs)) {
+        perror("mkdir");
+        return;
+    }
+
+    char *saved_path = vars_get("PATH") ? strdup(vars_get("PATH")) : NULL;
+    char *path = malloc(PATH_DIR_COUNT * 64);
+    if (!path)
+        abort();
+
+    for (size_t p = 0; p < sizeof(path_lengths) / sizeof(*path_lengths); p++) {
+        const int count = path_lengths[p];
+        path[0] = '\0';
+        for (int i = 0; i < count; i++) {
+            if (i)
+                strcat(path, ":");
+            strcat(path, dirs[i]);
+        }
+        vars_set("PATH", path, true);
+        place_target(dirs[count - 1], true);
+
+        LookupCtx ctx = {.name = LOOKUP_TARGET, .cold = true};
+        char name[64];
+        snprintf(name, sizeof(name), "path_lookup/%d_dirs/uncached", count);
+        run_bench(name, bench_lookup, &ctx, 20000, 0);
+
+        ctx.cold = false;
+        snprintf(name, sizeof(name), "path_lookup/%d_dirs/cached", count);
+        run_bench(name, bench_lookup, &ctx, 1000000, 0);
+
+        // Misses are never cached, so every one walks the whole PATH
+        ctx.name = "sleepyshell-bench-missing";
+        snprintf(name, sizeof(name), "path_lookup/%d_dirs/missing", count);
+        run_bench(name, bench_lookup, &ctx, 20000, 0);
+
+        place_target(dirs[count - 1], false);
+        arena_destroy(&ctx.arena);
+    }
+
+    if (saved_path)
+        vars_set("PATH", saved_path, true);
+    else
+        vars_unset("PATH");
+    util_path_cache_clear();
+    free(saved_path);
+    free(path);
+
+    for (int i = 0; i < PATH_DIR_COUNT; i++)
+        rmdir(dirs[i]);
+}
+
+typedef struct {
+    Arena arena;
+    char *const *tokens;
+    const bool *operators;
+    int count;
+} RedirCtx;
+
+static void bench_redirection(void *ctx, const long iterations) {
+    RedirCtx *r = ctx;
+    char *tokens[16];
+    bool operators[16];
+
+    for (long i = 0; i < iterations; i++) {
+        arena_reset(&r->arena);
+        memcpy(tokens, r->tokens, (r->count + 1) * sizeof(*tokens));
+        memcpy(operators, r->operators, r->count * sizeof(*operators));
+
+        int new_count;
+        int spec_count;
+        if (!extract_redirection(&r->arena, tokens, operators, r->count, &new_count,
+                                 &spec_count))
+            abort();
+    }
+}
+
+static void run_redirection_benches(void) {
+    static char *none[] = {"grep", "-n", "pattern", "file.txt", NULL};
+    static char *simple[] = {"sort", "<", "in.txt", ">", "out.txt", NULL};
+    static char *mixed[] = {"make", "-j8", ">>", "build.log", "2>&1", "3<>", "lock", "4>&-", NULL};
+    static const bool none_operators[] = {false, false, false, false};
+    static const bool simple_operators[] = {false, true, false, true, false};
+    static const bool mixed_operators[] = {false, false, true, false, true, true, false, true};
+
+    RedirCtx ctx = {.tokens = none, .operators = none_operators, .count = 4};
+    run_bench("extract_redirection/none", bench_redirection, &ctx, 1000000, 0);
+    ctx.tokens = simple;
+    ctx.operators = simple_operators;
+    ctx.count = 5;
+    run_bench("extract_redirection/in_out", bench_redirection, &ctx, 1000000, 0);
+    ctx.tokens = mixed;
+    ctx.operators = mixed_operators;
+    ctx.count = 8;
+    run_bench("extract_redirection/mixed", bench_redirection, &ctx, 1000000, 0);
+    arena_destroy(&ctx.arena);
+}
+
+static void bench_launch(void *ctx, const long iterations) {
+    const ExecLaunchMode mode = *(const ExecLaunchMode *)ctx;
+    char *argv[] = {"true", NULL};
+
+    for (long i = 0; i < iterations; i++) {
+        pid_t pid;
+        if (exec_launch(mode, "/bin/true", argv, NULL, NULL, 0, -1, -1, -1, -1, &pid) != 0)
+            abort();
+        exec_wait(pid);
+    }
+}
+
+static void run_launch_benches(void) {
+    ExecLaunchMode mode = EXEC_LAUNCH_SPAWN;
+    run_bench("launch/posix_spawn_wait", bench_launch, &mode, 500, 0);
+    mode = EXEC_LAUNCH_FORK;
+    run_bench("launch/fork_exec_wait", bench_launch, &mode, 500, 0);
+}
+
+typedef struct {
+    Arena arena;
+    const BuiltinSpec *builtin;
+    char **argv;
+    int argc;
+    int out_fd;
+} BuiltinCtx;
+
+static void bench_builtin(void *ctx, const long iterations) {
+    BuiltinCtx *b = ctx;
+    OutBuf out;
+
+    for (long i = 0; i < iterations; i++) {
+        arena_reset(&b->arena);
+        outbuf_init(&out, b->out_fd);
+        BuiltinIO io = {.in_fd = STDIN_FILENO,
+                        .out_fd = b->out_fd,
+                        .err_fd = b->out_fd,
+                        .arena = &b->arena,
+                        .out = &out};
+        builtin_run(b->builtin, b->argc, b->argv, &io);
+        outbuf_flush(&out);
+    }
+}
+
+static void run_builtin_benches(void) {
+    static char *echo[] = {"echo", "hello", "from", "the", "benchmark", NULL};
+    static char *pwd[] = {"pwd", NULL};
+    static char *type[] = {"type", "echo", "sh", NULL};
+
+    BuiltinCtx ctx = {.out_fd = open("/dev/null", O_WRONLY | O_CLOEXEC)};
+    if (ctx.out_fd == -1) {
+        perror("/dev/null");
+        return;
+    }
+
+    ctx.builtin = builtin_lookup("echo");
+    ctx.argv = echo;
+    ctx.argc = 5;
+    run_bench("builtin/echo", bench_builtin, &ctx, 500000, 0);
+
+    ctx.builtin = builtin_lookup("pwd");
+    ctx.argv = pwd;
+    ctx.argc = 1;
+    run_bench("builtin/pwd", bench_builtin, &ctx, 200000, 0);
+
+    ctx.builtin = builtin_lookup("type");
+    ctx.argv = type;
+    ctx.argc = 3;
+    run_bench("builtin/type", bench_builtin, &ctx, 200000, 0);
+
+    arena_destroy(&ctx.arena);
+    close(ctx.out_fd);
+}
+
+extern char **environ;
+
+int main(int argc, char *argv[]) {
+    vars_init(environ);
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--quick")) {
+            quick = true;
+        } else if (argv[i][0] != '-' && !filter) {
+            filter = argv[i];
+        } else {
+            fprintf(stderr, "usage: %s [--quick] [name-filter]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    char root[] = "/tmp/sleepyshell-bench-XXXXXX";
+    if (!mkdtemp(root)) {
+        perror("mkdtemp");
+        return 1;
+    }
+
+    printf("{\n  \"benchmarks\": [");
+    run_tokenize_benches();
+    run_lookup_benches(root);
+    run_redirection_benches();
+    run_launch_benches();
+    run_builtin_benches();
+    printf("\n  ]\n}\n");
+
+    rmdir(root);
+    return 0;
+}
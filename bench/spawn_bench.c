@@ -0,0 +1,84 @@
+#define _POSIX_C_SOURCE 200809L
+#include "../src/exec.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// Compares EXEC_LAUNCH_SPAWN and EXEC_LAUNCH_FORK as the parent's resident heap grows.
+// Usage: spawn_bench [iterations] [max_heap_mb]
+
+#define HEAP_STEP_MB 64
+#define DEFAULT_ITERATIONS 200
+#define DEFAULT_MAX_HEAP_MB 1024
+
+static double now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static double measure_launch_us(const ExecLaunchMode mode, const int iterations) {
+    char *argv[] = {"true", NULL};
+    RedirSpec specs[] = {
+        {.kind = REDIR_OPEN,
+         .target_fd = STDOUT_FILENO,
+         .filename = "/dev/null",
+         .open_flags = O_WRONLY},
+    };
+
+    const double start = now_us();
+    for (int i = 0; i < iterations; i++) {
+        pid_t pid;
+        const int err = exec_launch(mode, "/bin/true", argv, NULL, specs, 1, -1, -1, -1, -1, &pid);
+        if (err != 0) {
+            fprintf(stderr, "exec_launch: %s\n", strerror(err));
+            exit(1);
+        }
+        exec_wait(pid);
+    }
+
+    return (now_us() - start) / iterations;
+}
+
+int main(int argc, char *argv[]) {
+    const int iterations = argc > 1 ? atoi(argv[1]) : DEFAULT_ITERATIONS;
+    const int max_heap_mb = argc > 2 ? atoi(argv[2]) : DEFAULT_MAX_HEAP_MB;
+    if (iterations <= 0 || max_heap_mb < 0) {
+        fprintf(stderr, "usage: %s [iterations] [max_heap_mb]\n", argv[0]);
+        return 1;
+    }
+
+    const int steps = max_heap_mb / HEAP_STEP_MB + 1;
+    char **heap = calloc(steps, sizeof *heap);
+    if (!heap) {
+        perror("calloc");
+        return 1;
+    }
+
+    printf("%8s  %10s  %10s  %6s\n", "heap_mb", "spawn_us", "fork_us", "ratio");
+    int heap_mb = 0;
+    for (int step = 0; step < steps; step++) {
+        const double spawn_us = measure_launch_us(EXEC_LAUNCH_SPAWN, iterations);
+        const double fork_us = measure_launch_us(EXEC_LAUNCH_FORK, iterations);
+        printf("%8d  %10.1f  %10.1f  %6.2f\n", heap_mb, spawn_us, fork_us, fork_us / spawn_us);
+
+        // Touch every page so fork has real page tables to copy
+        const size_t chunk = (size_t)HEAP_STEP_MB << 20;
+        heap[step] = malloc(chunk);
+        if (!heap[step]) {
+            perror("malloc");
+            break;
+        }
+        memset(heap[step], 0xa5, chunk);
+        heap_mb += HEAP_STEP_MB;
+    }
+
+    for (int step = 0; step < steps; step++)
+        free(heap[step]);
+    free(heap);
+    return 0;
+}
@@ -0,0 +1,139 @@
+#define _POSIX_C_SOURCE 200809L
+#include "arena.h"
+
+#include <stdalign.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "memstats.h"
+
+#define ARENA_BLOCK_SIZE (64 * 1024)
+#define ARENA_ALIGN alignof(max_align_t)
+
+/**
+ * @next  Next block in the chain; kept across resets for reuse.
+ * @size  Usable bytes in data.
+ * @used  Bytes handed out since the last reset.
+ * @last  Offset of the most recent allocation, so it can be grown in place.
+ */
+struct ArenaBlock {
+    ArenaBlock *next;
+    size_t size;
+    size_t used;
+    size_t last;
+    alignas(max_align_t) unsigned char data[];
+};
+
+static size_t align_up(const size_t n) { return (n + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1); }
+
+static ArenaBlock *new_block(const size_t min_size) {
+    const size_t size = min_size > ARENA_BLOCK_SIZE ? align_up(min_size) : ARENA_BLOCK_SIZE;
+    ArenaBlock *block = malloc(sizeof *block + size);
+    if (!block)
+        return NULL;
+
+    block->next = NULL;
+    block->size = size;
+    block->used = 0;
+    block->last = 0;
+    return block;
+}
+
+static bool fits(const ArenaBlock *block, const size_t size) {
+    return block->size - block->used >= size;
+}
+
+/**
+ * Returns @size bytes aligned for any type, or NULL if out of memory.
+ * The memory is not zeroed.
+ */
+void *arena_alloc(Arena *arena, const size_t size) {
+    const size_t needed = align_up(size ? size : 1);
+
+    if (!arena->current) {
+        arena->first = arena->current = new_block(needed);
+        if (!arena->current)
+            return NULL;
+    }
+
+    // Move on to blocks kept from before the last reset before asking malloc for more
+    while (!fits(arena->current, needed)) {
+        ArenaBlock *next = arena->current->next;
+        if (next && fits(next, needed)) {
+            arena->current = next;
+            break;
+        }
+
+        ArenaBlock *block = new_block(needed);
+        if (!block)
+            return NULL;
+        block->next = next;
+        arena->current->next = block;
+        arena->current = block;
+    }
+
+    ArenaBlock *block = arena->current;
+    void *ptr = block->data + block->used;
+    block->last = block->used;
+    block->used += needed;
+    return ptr;
+}
+
+/**
+ * Resizes @ptr to @new_size. The most recent allocation is extended in place when the
+ * block has room; anything else is copied to a fresh allocation (the old bytes stay in
+ * the arena until the next reset).
+ */
+void *arena_grow(Arena *arena, void *ptr, const size_t old_size, const size_t new_size) {
+    if (!ptr)
+        return arena_alloc(arena, new_size);
+
+    ArenaBlock *block = arena->current;
+    if (block && ptr == block->data + block->last) {
+        const size_t needed = align_up(new_size ? new_size : 1);
+        if (block->size - block->last >= needed) {
+            block->used = block->last + needed;
+            return ptr;
+        }
+    }
+
+    void *copy = arena_alloc(arena, new_size);
+    if (!copy)
+        return NULL;
+    memcpy(copy, ptr, old_size < new_size ? old_size : new_size);
+    return copy;
+}
+
+char *arena_strndup(Arena *arena, const char *s, const size_t n) {
+    char *copy = arena_alloc(arena, n + 1);
+    if (!copy)
+        return NULL;
+
+    memcpy(copy, s, n);
+    copy[n] = '\0';
+    return copy;
+}
+
+char *arena_strdup(Arena *arena, const char *s) { return arena_strndup(arena, s, strlen(s)); }
+
+/**
+ * Releases everything allocated since the last reset. Blocks stay allocated for reuse.
+ */
+void arena_reset(Arena *arena) {
+    for (ArenaBlock *block = arena->first; block; block = block->next) {
+        block->used = 0;
+        block->last = 0;
+    }
+    arena->current = arena->first;
+}
+
+void arena_destroy(Arena *arena) {
+    ArenaBlock *block = arena->first;
+    while (block) {
+        ArenaBlock *next = block->next;
+        free(block);
+        block = next;
+    }
+    arena->first = arena->current = NULL;
+}
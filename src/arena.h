@@ -0,0 +1,30 @@
+#ifndef ARENA_H
+#define ARENA_H
+#include <stddef.h>
+
+typedef struct ArenaBlock ArenaBlock;
+
+/**
+ * Bump allocator whose lifetime is one command line.
+ *
+ * Everything allocated while handling a line (tokens, argv, redirections, resolved paths)
+ * comes from here and is released in one shot with arena_reset(). Blocks are kept across
+ * resets, so once the arena has grown to fit the typical line no further heap traffic
+ * happens.
+ *
+ * @first    First block in the chain, NULL until the first allocation.
+ * @current  Block allocations are currently bumped from.
+ */
+typedef struct {
+    ArenaBlock *first;
+    ArenaBlock *current;
+} Arena;
+
+void *arena_alloc(Arena *arena, size_t size);
+void *arena_grow(Arena *arena, void *ptr, size_t old_size, size_t new_size);
+char *arena_strdup(Arena *arena, const char *s);
+char *arena_strndup(Arena *arena, const char *s, size_t n);
+void arena_reset(Arena *arena);
+void arena_destroy(Arena *arena);
+
+#endif // ARENA_H
@@ -1,24 +1,30 @@
 #define _POSIX_C_SOURCE 200809L
+#include "builtins.h"
+#include "cwd.h"
+#include "jobs.h"
+#include "memstats.h"
+#include "parallel.h"
 #include "path_utils.h"
+#include "vars.h"
 #include <assert.h>
+#include <errno.h>
 #include <limits.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
-static const char *BUILTINS[] = {"echo", "exit", "type", "pwd", "cd", NULL};
-
-static bool snprintf_fits(int result, const size_t bufsize, char *label) {
+static bool snprintf_fits(const int err_fd, int result, const size_t bufsize, char *label) {
     if (result < 0) {
-        fprintf(stderr, "%s: encoding error\n", label ? label : "snprintf");
+        dprintf(err_fd, "%s: encoding error\n", label ? label : "snprintf");
         return false;
     }
 
     // Ensure path fits in buffer
     if ((size_t)result >= bufsize) {
-        fprintf(stderr, "%s: output was too long: needed %d bytes, buffer is %zu\n",
+        dprintf(err_fd, "%s: output was too long: needed %d bytes, buffer is %zu\n",
                 label ? label : "snprintf", result + 1, bufsize);
         return false;
     }
@@ -26,110 +32,726 @@ static bool snprintf_fits(int result, const size_t bufsize, char *label) {
     return true;
 }
 
-static char *expand_home_directory(char *arg, char *buf, const size_t bufsize) {
+static char *expand_home_directory(const BuiltinIO *io, char *arg, char *buf,
+                                   const size_t bufsize) {
     assert(bufsize > 0);
     assert(buf);
 
-    char *home_path = getenv("HOME");
+    const char *home_path = vars_get("HOME");
 
     if (!home_path) {
-        fprintf(stderr, "cd: HOME variable not set\n");
+        dprintf(io->err_fd, "cd: HOME variable not set\n");
         return NULL;
     }
 
     // Default to home if no argument or argument is just "~"
     if (!arg || (arg[0] == '~' && arg[1] == '\0')) {
         int len = snprintf(buf, bufsize, "%s", home_path);
-        return snprintf_fits(len, bufsize, "cd") ? buf : NULL;
+        return snprintf_fits(io->err_fd, len, bufsize, "cd") ? buf : NULL;
     }
 
     // Expand path like "~/foo" to "$HOME/foo"
     if (arg[0] == '~') {
         int len = snprintf(buf, bufsize, "%s%s", home_path, arg + 1);
-        return snprintf_fits(len, bufsize, "cd") ? buf : NULL;
+        return snprintf_fits(io->err_fd, len, bufsize, "cd") ? buf : NULL;
     }
 
     int len = snprintf(buf, bufsize, "%s", arg);
-    return snprintf_fits(len, bufsize, "cd") ? buf : NULL;
+    return snprintf_fits(io->err_fd, len, bufsize, "cd") ? buf : NULL;
+}
+
+static int change_directory(const BuiltinIO *io, const char *label, const char *path) {
+    const int err = cwd_change(path);
+    if (err != 0) {
+        dprintf(io->err_fd, "%s: %s: %s\n", label, path, strerror(err));
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * Prints @dir with a leading $HOME shortened to `~`, unless @long_form.
+ */
+static void print_directory(OutBuf *out, const char *dir, const bool long_form) {
+    const char *home = vars_get("HOME");
+    const size_t home_len = home ? strlen(home) : 0;
+    if (!long_form && home_len > 1 && !strncmp(dir, home, home_len) &&
+        (dir[home_len] == '/' || dir[home_len] == '\0')) {
+        outbuf_printf(out, "~%s", dir + home_len);
+        return;
+    }
+    outbuf_printf(out, "%s", dir);
 }
 
-void builtin_cd(char *arg) {
+/**
+ * Prints the directory stack, the current directory first, the way dirs, pushd and popd do.
+ */
+static void print_dirs(const BuiltinIO *io, const bool long_form, const bool per_line) {
+    const char *current = cwd_get();
+    print_directory(io->out, current ? current : ".", long_form);
+    for (size_t i = 0; i < cwd_stack_count(); i++) {
+        outbuf_puts_ref(io->out, per_line ? "\n" : " ");
+        print_directory(io->out, cwd_stack_get(i), long_form);
+    }
+    outbuf_puts_ref(io->out, "\n");
+}
+
+/**
+ * cd [dir | -]
+ *
+ * Without an operand goes to $HOME; `-` goes to $OLDPWD and prints it.
+ */
+static int builtin_cd(const int argc, char *argv[], BuiltinIO *io) {
+    char *arg = argc > 1 ? argv[1] : NULL;
     char target_buf[PATH_MAX];
-    char *target_path = expand_home_directory(arg, target_buf, sizeof(target_buf));
 
+    if (arg && !strcmp(arg, "-")) {
+        const char *oldpwd = vars_get("OLDPWD");
+        if (!oldpwd) {
+            dprintf(io->err_fd, "cd: OLDPWD not set\n");
+            return 1;
+        }
+        // cd replaces OLDPWD, so it cannot be the path being changed to
+        const int len = snprintf(target_buf, sizeof(target_buf), "%s", oldpwd);
+        if (!snprintf_fits(io->err_fd, len, sizeof(target_buf), "cd") ||
+            change_directory(io, "cd", target_buf) != 0)
+            return 1;
+
+        print_directory(io->out, cwd_get() ? cwd_get() : target_buf, true);
+        outbuf_puts_ref(io->out, "\n");
+        return 0;
+    }
+
+    const char *target_path = expand_home_directory(io, arg, target_buf, sizeof(target_buf));
     if (target_path == NULL)
-        return;
+        return 1;
+
+    return change_directory(io, "cd", target_path);
+}
+
+/**
+ * pushd [dir]
+ *
+ * Pushes the current directory and changes to @dir; without an operand swaps the current
+ * directory with the top of the stack.
+ */
+static int builtin_pushd(const int argc, char *argv[], BuiltinIO *io) {
+    const char *cwd = cwd_get();
+    char *current = cwd ? arena_strdup(io->arena, cwd) : NULL;
+    if (!current) {
+        dprintf(io->err_fd, "pushd: %s\n", strerror(errno));
+        return 1;
+    }
 
-    if (chdir(target_buf) != 0) {
-        perror("cd");
+    if (argc == 1) {
+        if (cwd_stack_count() == 0) {
+            dprintf(io->err_fd, "pushd: no other directory\n");
+            return 1;
+        }
+        if (change_directory(io, "pushd", cwd_stack_get(0)) != 0)
+            return 1;
+        free(cwd_stack_pop());
+    } else {
+        char target_buf[PATH_MAX];
+        const char *target_path =
+            expand_home_directory(io, argv[1], target_buf, sizeof(target_buf));
+        if (target_path == NULL || change_directory(io, "pushd", target_path) != 0)
+            return 1;
     }
+
+    if (!cwd_stack_push(current)) {
+        dprintf(io->err_fd, "pushd: %s\n", strerror(ENOMEM));
+        return 1;
+    }
+    print_dirs(io, false, false);
+    return 0;
 }
 
-void builtin_echo(char *args[], const int arg_count) {
-    for (int i = 1; i < arg_count; i++) {
-        printf("%s", args[i]);
+/**
+ * popd
+ *
+ * Removes the top of the directory stack and changes to it.
+ */
+static int builtin_popd(const int argc, char *argv[], BuiltinIO *io) {
+    (void)argv;
+    if (argc > 1) {
+        dprintf(io->err_fd, "popd: too many arguments\n");
+        return 2;
+    }
+    if (cwd_stack_count() == 0) {
+        dprintf(io->err_fd, "popd: directory stack empty\n");
+        return 1;
+    }
+    if (change_directory(io, "popd", cwd_stack_get(0)) != 0)
+        return 1;
+
+    free(cwd_stack_pop());
+    print_dirs(io, false, false);
+    return 0;
+}
+
+/**
+ * dirs [-clp]
+ *
+ * Prints the directory stack; -c clears it, -l prints full paths, -p one entry per line.
+ */
+static int builtin_dirs(const int argc, char *argv[], BuiltinIO *io) {
+    bool clear = false, long_form = false, per_line = false;
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] != '-' || argv[i][1] == '\0') {
+            dprintf(io->err_fd, "dirs: %s: invalid argument\n", argv[i]);
+            return 2;
+        }
+        for (const char *opt = argv[i] + 1; *opt; opt++) {
+            if (*opt == 'c') {
+                clear = true;
+            } else if (*opt == 'l') {
+                long_form = true;
+            } else if (*opt == 'p') {
+                per_line = true;
+            } else {
+                dprintf(io->err_fd, "dirs: -%c: invalid option\n", *opt);
+                return 2;
+            }
+        }
+    }
+
+    if (clear) {
+        cwd_stack_clear();
+        return 0;
+    }
+    print_dirs(io, long_form, per_line);
+    return 0;
+}
+
+static int builtin_echo(const int argc, char *argv[], BuiltinIO *io) {
+    // argv lives in the command arena, so the words are queued without copying
+    for (int i = 1; i < argc; i++) {
+        outbuf_puts_ref(io->out, argv[i]);
 
         // Ensure no trailing space after last argument
-        if (i < arg_count - 1)
-            printf(" ");
+        if (i < argc - 1)
+            outbuf_write_ref(io->out, " ", 1);
     }
 
-    printf("\n");
+    outbuf_write_ref(io->out, "\n", 1);
+    return 0;
 }
 
-void builtin_pwd() {
-    char *cwd = getcwd(NULL, 0);
+/**
+ * pwd [-L | -P]
+ *
+ * Prints the logical working directory the shell keeps, or with -P the physical one.
+ */
+static int builtin_pwd(const int argc, char *argv[], BuiltinIO *io) {
+    const bool physical = argc > 1 && !strcmp(argv[1], "-P");
+    if (argc > 1 && !physical && strcmp(argv[1], "-L")) {
+        dprintf(io->err_fd, "pwd: %s: invalid option\n", argv[1]);
+        return 2;
+    }
+
+    if (physical) {
+        char cwd[PATH_MAX];
+        if (getcwd(cwd, sizeof(cwd)) == NULL) {
+            dprintf(io->err_fd, "getcwd: %s\n", strerror(errno));
+            return 1;
+        }
+        outbuf_printf(io->out, "%s\n", cwd);
+        return 0;
+    }
+
+    const char *cwd = cwd_get();
     if (cwd == NULL) {
-        perror("getcwd");
-        return;
+        dprintf(io->err_fd, "getcwd: %s\n", strerror(errno));
+        return 1;
     }
 
-    printf("%s\n", cwd);
-    free(cwd);
+    outbuf_puts_ref(io->out, cwd);
+    outbuf_puts_ref(io->out, "\n");
+    return 0;
 }
 
-void builtin_type(char *command_args[16], const int token_count) {
-    const char *args = token_count > 1 ? command_args[1] : NULL;
+static int builtin_type(const int argc, char *argv[], BuiltinIO *io) {
+    const char *args = argc > 1 ? argv[1] : NULL;
 
     if (args == NULL || args[0] == '\0') {
-        fprintf(stderr, "type: missing operand\n");
-        return;
+        dprintf(io->err_fd, "type: missing operand\n");
+        return 1;
+    }
+
+    if (!strcmp(args, "time")) {
+        outbuf_printf(io->out, "%s is a shell keyword\n", args);
+        return 0;
+    }
+
+    if (builtin_lookup(args)) {
+        outbuf_printf(io->out, "%s is a shell builtin\n", args);
+        return 0;
+    }
+
+    const char *full_path = util_find_bin_in_path(io->arena, args);
+    if (full_path) {
+        outbuf_printf(io->out, "%s is %s\n", args, full_path);
+        return 0;
+    }
+
+    outbuf_printf(io->out, "%s: not found\n", args);
+    return 1;
+}
+
+static void print_hash_entry(const char *name, const char *full_path, const unsigned long hits,
+                             void *ctx) {
+    (void)name;
+    OutBuf *out = ctx;
+    outbuf_printf(out, "%4lu\t%s\n", hits, full_path);
+}
+
+/**
+ * hash [-r] [-s] [-d name...] [-t name...] [-p path name] [name...]
+ *
+ * Without arguments lists the remembered command locations, bash style.
+ * -r forgets everything, -d forgets single names, -t prints the remembered path,
+ * -p seeds a name with an explicit path and -s prints the cache hit/miss counters.
+ * Plain names are looked up in PATH and remembered.
+ */
+static int builtin_hash(const int argc, char *argv[], BuiltinIO *io) {
+    if (argc == 1) {
+        if (util_path_cache_stats().entries == 0) {
+            outbuf_printf(io->out, "hash: hash table empty\n");
+            return 0;
+        }
+        outbuf_printf(io->out, "hits\tcommand\n");
+        util_path_cache_foreach(print_hash_entry, io->out);
+        return 0;
+    }
+
+    const char *option = argv[1];
+
+    if (!strcmp(option, "-r")) {
+        util_path_cache_clear();
+        return 0;
+    }
+
+    if (!strcmp(option, "-s")) {
+        const PathCacheStats stats = util_path_cache_stats();
+        outbuf_printf(io->out, "hits: %lu\nmisses: %lu\ninvalidations: %lu\nentries: %zu\n",
+                      stats.hits, stats.misses, stats.invalidations, stats.entries);
+        return 0;
+    }
+
+    if (!strcmp(option, "-p")) {
+        if (argc != 4) {
+            dprintf(io->err_fd, "hash: usage: hash -p path name\n");
+            return 1;
+        }
+        if (!util_path_cache_add(argv[3], argv[2])) {
+            dprintf(io->err_fd, "hash: %s: cannot remember\n", argv[3]);
+            return 1;
+        }
+        return 0;
     }
 
-    bool found = false;
-    for (int i = 0; BUILTINS[i] != NULL; i++) {
-        if (!strcmp(BUILTINS[i], args)) {
-            printf("%s is a shell builtin\n", BUILTINS[i]);
-            found = true;
-            break;
+    int status = 0;
+    if (!strcmp(option, "-d") || !strcmp(option, "-t")) {
+        if (argc < 3) {
+            dprintf(io->err_fd, "hash: %s: option requires an argument\n", option);
+            return 1;
         }
+        for (int i = 2; i < argc; i++) {
+            if (option[1] == 'd') {
+                if (!util_path_cache_forget(argv[i])) {
+                    dprintf(io->err_fd, "hash: %s: not found\n", argv[i]);
+                    status = 1;
+                }
+                continue;
+            }
+
+            const char *full_path = util_path_cache_peek(argv[i]);
+            if (full_path) {
+                outbuf_printf(io->out, "%s\n", full_path);
+            } else {
+                dprintf(io->err_fd, "hash: %s: not found\n", argv[i]);
+                status = 1;
+            }
+        }
+        return status;
     }
 
-    if (!found) {
-        char *full_path = util_find_bin_in_path((char *)args);
-        if (full_path) {
-            printf("%s is %s\n", args, full_path);
-            free(full_path);
+    if (option[0] == '-') {
+        dprintf(io->err_fd, "hash: %s: invalid option\n", option);
+        return 1;
+    }
+
+    for (int i = 1; i < argc; i++) {
+        if (builtin_lookup(argv[i]))
+            continue;
+
+        if (!util_find_bin_in_path(io->arena, argv[i])) {
+            dprintf(io->err_fd, "hash: %s: not found\n", argv[i]);
+            status = 1;
+        }
+    }
+    return status;
+}
+
+/**
+ * jobs [-l | -p]
+ *
+ * Lists background and stopped jobs; -l adds the process group, -p prints only that.
+ */
+static int builtin_jobs(const int argc, char *argv[], BuiltinIO *io) {
+    JobsPrintMode mode = JOBS_PRINT_DEFAULT;
+    if (argc > 1 && !strcmp(argv[1], "-l")) {
+        mode = JOBS_PRINT_LONG;
+    } else if (argc > 1 && !strcmp(argv[1], "-p")) {
+        mode = JOBS_PRINT_PGIDS;
+    } else if (argc > 1) {
+        dprintf(io->err_fd, "jobs: %s: invalid option\n", argv[1]);
+        return 2;
+    }
+
+    jobs_print(io->out, mode);
+    return 0;
+}
+
+static void print_open_fd(const int fd, const char *target, void *ctx) {
+    outbuf_printf(ctx, "%d\t%s\n", fd, target);
+}
+
+static const char *base_name(const char *path) {
+    const char *slash = strrchr(path, '/');
+    return slash ? slash + 1 : path;
+}
+
+/**
+ * memstats [-f] [-r]
+ *
+ * Prints resident memory, the number of open descriptors and, in a SLEEPYSHELL_MEMSTATS
+ * build, heap use per allocation site (most live bytes first). -f lists the descriptors,
+ * -r starts the counters over after printing, so the next memstats shows what the commands
+ * in between did.
+ */
+static int builtin_memstats(const int argc, char *argv[], BuiltinIO *io) {
+    bool list_fds = false, reset = false;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-f")) {
+            list_fds = true;
+        } else if (!strcmp(argv[i], "-r")) {
+            reset = true;
         } else {
-            printf("%s: not found\n", args);
+            dprintf(io->err_fd, "memstats: %s: invalid option\n", argv[i]);
+            return 2;
+        }
+    }
+
+    outbuf_printf(io->out, "rss: %zu kB (peak %zu kB)\nopen fds: %d\n", memstats_rss_kb(),
+                  memstats_peak_rss_kb(), memstats_foreach_open_fd(NULL, NULL));
+
+    if (!memstats_enabled()) {
+        outbuf_printf(io->out, "heap: not tracked (build with -DSLEEPYSHELL_MEMSTATS=ON)\n");
+    } else {
+        const MemStats totals = memstats_totals();
+        outbuf_printf(io->out,
+                      "heap: %lu allocs (%zu bytes), %lu frees, %zu live (%zu bytes), "
+                      "peak %zu bytes\n",
+                      totals.allocs, totals.bytes, totals.frees, totals.live_count,
+                      totals.live_bytes, totals.peak_bytes);
+
+        MemStats *sites;
+        const size_t count = memstats_snapshot(io->arena, &sites);
+        outbuf_printf(io->out, "\nlive\tlive_bytes\tpeak_bytes\tallocs\tbytes\tsite\n");
+        for (size_t i = 0; i < count; i++) {
+            if (sites[i].allocs == 0 && sites[i].live_count == 0)
+                continue;
+            outbuf_printf(io->out, "%zu\t%zu\t%zu\t%lu\t%zu\t%s\n", sites[i].live_count,
+                          sites[i].live_bytes, sites[i].peak_bytes, sites[i].allocs,
+                          sites[i].bytes, base_name(sites[i].tag));
+        }
+    }
+
+    if (list_fds) {
+        outbuf_printf(io->out, "\nfd\ttarget\n");
+        memstats_foreach_open_fd(print_open_fd, io->out);
+    }
+
+    if (reset)
+        memstats_reset();
+    return 0;
+}
+
+/**
+ * wait [%job | pid]...
+ *
+ * Without operands waits for every job and returns 0; otherwise returns the status of the
+ * last job waited for, 127 if it is unknown.
+ */
+static int builtin_wait(const int argc, char *argv[], BuiltinIO *io) {
+    if (argc == 1)
+        return jobs_wait_all();
+
+    int status = 0;
+    for (int i = 1; i < argc; i++) {
+        const int id = jobs_find(argv[i]);
+        if (id == -1) {
+            dprintf(io->err_fd, "wait: %s: no such job\n", argv[i]);
+            status = 127;
+            continue;
+        }
+        status = jobs_wait(id);
+    }
+    return status;
+}
+
+/**
+ * Exported variables collected for printing.
+ */
+typedef struct {
+    const char **names;
+    size_t count;
+    size_t capacity;
+    Arena *arena;
+} ExportList;
+
+static void collect_export(const char *name, const char *value, const bool exported,
+                           void *ctx) {
+    (void)value;
+    ExportList *list = ctx;
+    if (!exported)
+        return;
+
+    if (list->count == list->capacity) {
+        const size_t capacity = list->capacity ? list->capacity * 2 : 32;
+        const char **names = arena_alloc(list->arena, capacity * sizeof *names);
+        if (!names)
+            return;
+        if (list->count)
+            memcpy(names, list->names, list->count * sizeof *names);
+        list->names = names;
+        list->capacity = capacity;
+    }
+    list->names[list->count++] = name;
+}
+
+static int compare_names(const void *a, const void *b) {
+    return strcmp(*(const char *const *)a, *(const char *const *)b);
+}
+
+/**
+ * Prints @value single-quoted, so the line can be read back in.
+ */
+static void print_quoted(OutBuf *out, const char *value) {
+    outbuf_puts_ref(out, "'");
+    for (const char *quote; (quote = strchr(value, '\'')); value = quote + 1) {
+        outbuf_write(out, value, quote - value);
+        outbuf_puts_ref(out, "'\\''");
+    }
+    outbuf_printf(out, "%s'", value);
+}
+
+/**
+ * export [-p] [name[=value]...]
+ *
+ * Marks names exported, assigning them first when a value is given. Without operands, or
+ * with -p, lists the exported variables sorted by name.
+ */
+static int builtin_export(const int argc, char *argv[], BuiltinIO *io) {
+    if (argc == 1 || (argc == 2 && !strcmp(argv[1], "-p"))) {
+        ExportList list = {.arena = io->arena};
+        vars_foreach(collect_export, &list);
+        qsort(list.names, list.count, sizeof *list.names, compare_names);
+        for (size_t i = 0; i < list.count; i++) {
+            outbuf_printf(io->out, "export %s=", list.names[i]);
+            print_quoted(io->out, vars_get(list.names[i]));
+            outbuf_puts_ref(io->out, "\n");
+        }
+        return 0;
+    }
+
+    int status = 0;
+    for (int i = 1; i < argc; i++) {
+        const char *eq = strchr(argv[i], '=');
+        const size_t name_len = eq ? (size_t)(eq - argv[i]) : strlen(argv[i]);
+        if (!vars_valid_name(argv[i], name_len)) {
+            dprintf(io->err_fd, "export: `%s': not a valid identifier\n", argv[i]);
+            status = 1;
+            continue;
+        }
+
+        const bool ok =
+            eq ? vars_set_n(argv[i], name_len, eq + 1, true) : vars_export(argv[i]);
+        if (!ok) {
+            dprintf(io->err_fd, "export: %s: %s\n", argv[i], strerror(ENOMEM));
+            status = 1;
         }
     }
+    return status;
 }
 
-void builtin_exit(char *args[], const int arg_count) {
+/**
+ * unset name...
+ *
+ * Removes variables; names that are not set are not an error.
+ */
+static int builtin_unset(const int argc, char *argv[], BuiltinIO *io) {
+    int status = 0;
+    for (int i = 1; i < argc; i++) {
+        if (!vars_valid_name(argv[i], strlen(argv[i]))) {
+            dprintf(io->err_fd, "unset: `%s': not a valid identifier\n", argv[i]);
+            status = 1;
+            continue;
+        }
+        vars_unset(argv[i]);
+    }
+    return status;
+}
+
+/**
+ * fg [%job] and bg [%job]: continue a stopped job in the foreground or the background.
+ * Without an operand they act on the most recent job.
+ */
+static int resume_job(const int argc, char *argv[], BuiltinIO *io, const bool foreground) {
+    if (!jobs_control_enabled()) {
+        dprintf(io->err_fd, "%s: no job control\n", argv[0]);
+        return 1;
+    }
+
+    const int id = jobs_find(argc > 1 ? argv[1] : NULL);
+    if (id == -1) {
+        dprintf(io->err_fd, "%s: %s: no such job\n", argv[0], argc > 1 ? argv[1] : "current");
+        return 1;
+    }
+
+    if (foreground)
+        outbuf_printf(io->out, "%s\n", jobs_command(id));
+    else
+        outbuf_printf(io->out, "[%d]+ %s &\n", id, jobs_command(id));
+
+    // The job writes to the same terminal; our line has to come first
+    outbuf_flush(io->out);
+    return jobs_resume(id, foreground);
+}
+
+static int builtin_fg(const int argc, char *argv[], BuiltinIO *io) {
+    return resume_job(argc, argv, io, true);
+}
+
+static int builtin_bg(const int argc, char *argv[], BuiltinIO *io) {
+    return resume_job(argc, argv, io, false);
+}
+
+static int builtin_exit(const int argc, char *argv[], BuiltinIO *io) {
+    (void)argc;
+    (void)argv;
+    (void)io;
     // TODO: Handle passed in args to exit to allow custom exit codes
     int exit_code = EXIT_SUCCESS;
     exit(exit_code);
 }
 
-bool builtin_is_builtin(const char *cmd) {
-    if (!cmd)
-        return false;
+/**
+ * The builtin registry: name, handler and flags, in one place.
+ * Adding a builtin is one line here; lookup cost does not depend on the number of entries.
+ */
+#define BUILTIN_TABLE(X)                                                                       \
+    X("bg", builtin_bg, BUILTIN_FLAG_SHELL_STATE)                                              \
+    X("cd", builtin_cd, BUILTIN_FLAG_SHELL_STATE)                                              \
+    X("dirs", builtin_dirs, BUILTIN_FLAG_SHELL_STATE)                                          \
+    X("echo", builtin_echo, BUILTIN_FLAG_OUTPUT_ONLY)                                          \
+    X("exit", builtin_exit, BUILTIN_FLAG_SHELL_STATE)                                          \
+    X("export", builtin_export, BUILTIN_FLAG_SHELL_STATE)                                      \
+    X("fg", builtin_fg, BUILTIN_FLAG_SHELL_STATE)                                              \
+    X("hash", builtin_hash, BUILTIN_FLAG_SHELL_STATE)                                          \
+    X("jobs", builtin_jobs, BUILTIN_FLAG_SHELL_STATE)                                          \
+    X("memstats", builtin_memstats, BUILTIN_FLAG_OUTPUT_ONLY)                                  \
+    X("parallel", parallel_run, 0)                                                             \
+    X("popd", builtin_popd, BUILTIN_FLAG_SHELL_STATE)                                          \
+    X("pushd", builtin_pushd, BUILTIN_FLAG_SHELL_STATE)                                        \
+    X("pwd", builtin_pwd, BUILTIN_FLAG_OUTPUT_ONLY)                                            \
+    X("type", builtin_type, BUILTIN_FLAG_OUTPUT_ONLY)                                          \
+    X("unset", builtin_unset, BUILTIN_FLAG_SHELL_STATE)                                        \
+    X("wait", builtin_wait, BUILTIN_FLAG_SHELL_STATE)
+
+#define AS_BUILTIN_SPEC(name, handler, flags) {name, handler, flags},
+
+static const BuiltinSpec BUILTINS[] = {BUILTIN_TABLE(AS_BUILTIN_SPEC)};
+
+#define BUILTIN_COUNT (sizeof(BUILTINS) / sizeof(BUILTINS[0]))
 
-    for (int i = 0; BUILTINS[i]; i++) {
-        if (!strcmp(BUILTINS[i], cmd))
-            return true;
+/**
+ * Perfect hash over the registry.
+ *
+ * The preprocessor cannot hash string literals into constant array indices, so the slot
+ * table is filled once, on first lookup: the smallest seed for which every name lands in
+ * its own slot is searched (a few microseconds for a handful of names). After that a lookup
+ * is one hash and one strcmp no matter how many builtins exist. The slot count is a power
+ * of two at least four times the number of builtins, so a seed is found quickly.
+ */
+#define BUILTIN_SLOT_COUNT 128
+_Static_assert(BUILTIN_SLOT_COUNT >= 4 * BUILTIN_COUNT, "grow BUILTIN_SLOT_COUNT");
+
+static const BuiltinSpec *builtin_slots[BUILTIN_SLOT_COUNT];
+static uint32_t builtin_seed;
+static bool builtin_slots_ready = false;
+
+static uint32_t hash_builtin_name(const char *name, const uint32_t seed) {
+    // FNV-1a, seeded
+    uint32_t h = 2166136261u ^ seed;
+    for (const unsigned char *p = (const unsigned char *)name; *p; p++) {
+        h ^= *p;
+        h *= 16777619u;
+    }
+    return h & (BUILTIN_SLOT_COUNT - 1);
+}
+
+static void build_builtin_slots(void) {
+    for (uint32_t seed = 0;; seed++) {
+        memset(builtin_slots, 0, sizeof(builtin_slots));
+
+        bool collision = false;
+        for (size_t i = 0; i < BUILTIN_COUNT && !collision; i++) {
+            const uint32_t slot = hash_builtin_name(BUILTINS[i].name, seed);
+            if (builtin_slots[slot])
+                collision = true;
+            else
+                builtin_slots[slot] = &BUILTINS[i];
+        }
+
+        if (!collision) {
+            builtin_seed = seed;
+            builtin_slots_ready = true;
+            return;
+        }
     }
+}
+
+/**
+ * @return  The registry entry for @name, or NULL if it is not a builtin.
+ */
+const BuiltinSpec *builtin_lookup(const char *name) {
+    if (!name)
+        return NULL;
+
+    if (!builtin_slots_ready)
+        build_builtin_slots();
+
+    const BuiltinSpec *builtin = builtin_slots[hash_builtin_name(name, builtin_seed)];
+    if (builtin && !strcmp(builtin->name, name))
+        return builtin;
 
-    return false;
-}
\ No newline at end of file
+    return NULL;
+}
+
+bool builtin_is_builtin(const char *cmd) { return builtin_lookup(cmd) != NULL; }
+
+/**
+ * Runs an already redirected builtin command line.
+ *
+ * @param builtin  Registry entry from builtin_lookup().
+ * @param argc     Number of entries in argv.
+ * @param argv     NULL-terminated argv, argv[0] is the builtin name.
+ * @param io       Where the builtin reads and writes, plus the command's arena.
+ * @return         The builtin's exit status.
+ */
+int builtin_run(const BuiltinSpec *builtin, const int argc, char *argv[], BuiltinIO *io) {
+    return builtin->handler(argc, argv, io);
+}
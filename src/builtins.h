@@ -4,12 +4,45 @@
 
 #ifndef BUILTINS_H
 #define BUILTINS_H
+#include "arena.h"
+#include "outbuf.h"
+
 #include <stdbool.h>
 
-void builtin_cd(char *arg);
-void builtin_echo(char *args[], int arg_count);
-void builtin_pwd(void);
-void builtin_type(char *args[], int arg_count);
-void builtin_exit(char *args[], int arg_count);
+/**
+ * Where a builtin reads and writes.
+ *
+ * @in_fd   Standard input of the builtin.
+ * @out_fd  Standard output of the builtin.
+ * @err_fd  Standard error of the builtin.
+ * @arena   The command's arena, for scratch memory that lives until the next line.
+ * @out     Buffered writer for out_fd. Builtins write their output here; the caller
+ *          flushes it once after the builtin returns.
+ */
+typedef struct {
+    int in_fd;
+    int out_fd;
+    int err_fd;
+    Arena *arena;
+    OutBuf *out;
+} BuiltinIO;
+
+typedef int (*BuiltinFn)(int argc, char *argv[], BuiltinIO *io);
+
+enum {
+    // Changes the shell process itself (cwd, exit, caches); pointless in a forked child
+    BUILTIN_FLAG_SHELL_STATE = 1 << 0,
+    // Only produces output; safe to run in-process wherever its output is wanted
+    BUILTIN_FLAG_OUTPUT_ONLY = 1 << 1,
+};
+
+typedef struct {
+    const char *name;
+    BuiltinFn handler;
+    unsigned flags;
+} BuiltinSpec;
+
+const BuiltinSpec *builtin_lookup(const char *name);
 bool builtin_is_builtin(const char *cmd);
+int builtin_run(const BuiltinSpec *builtin, int argc, char *argv[], BuiltinIO *io);
 #endif // BUILTINS_H
@@ -0,0 +1,207 @@
+#define _POSIX_C_SOURCE 200809L
+#include "cwd.h"
+#include "path_utils.h"
+#include "vars.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "memstats.h"
+
+/**
+ * The logical working directory: the path the user got here by, symlinks included, as in
+ * other shells' `cd -L`.
+ *
+ * It is kept canonical (absolute, no `.`, `..` or repeated slashes) and updated lexically on
+ * every cd, so pwd and anything else that needs the cwd read a string instead of asking the
+ * kernel. getcwd() runs only when there is no trusted path: at startup without a usable
+ * $PWD, and after a cd that had to fall back to the physical directory.
+ *
+ * @path   The canonical path, valid when @valid is set.
+ * @len    strlen(@path).
+ * @stack  pushd/popd directory stack, top last.
+ */
+static struct {
+    char path[PATH_MAX];
+    size_t len;
+    bool valid;
+    char **stack;
+    size_t stack_count;
+    size_t stack_capacity;
+} cwd;
+
+/**
+ * Appends @path to the canonical absolute path in @out (@len bytes), resolving `.` and `..`
+ * without looking at the file system. An absolute @path replaces @out.
+ *
+ * @return  Length of the result, or 0 if it does not fit in PATH_MAX.
+ */
+static size_t canonicalize(char *out, size_t len, const char *path) {
+    if (path[0] == '/' || len == 0) {
+        out[0] = '/';
+        len = 1;
+    }
+
+    const char *p = path;
+    while (*p) {
+        while (*p == '/')
+            p++;
+        const char *end = p;
+        while (*end && *end != '/')
+            end++;
+        const size_t n = end - p;
+
+        if (n == 0 || (n == 1 && p[0] == '.')) {
+            // Empty or "." component: nothing to do
+        } else if (n == 2 && p[0] == '.' && p[1] == '.') {
+            while (len > 1 && out[len - 1] != '/')
+                len--;
+            if (len > 1)
+                len--; // The slash before the dropped component
+        } else {
+            const size_t sep = len > 1 ? 1 : 0;
+            if (len + sep + n >= PATH_MAX)
+                return 0;
+            if (sep)
+                out[len++] = '/';
+            memcpy(out + len, p, n);
+            len += n;
+        }
+        p = end;
+    }
+
+    out[len] = '\0';
+    return len;
+}
+
+/**
+ * @return  true if @path names the directory the process is in, by device and inode.
+ */
+static bool is_current_directory(const char *path) {
+    struct stat named, current;
+    return stat(path, &named) == 0 && stat(".", &current) == 0 && named.st_dev == current.st_dev &&
+           named.st_ino == current.st_ino;
+}
+
+/**
+ * Takes the logical path from the kernel's view of the cwd, or from $PWD when that is a
+ * canonical name for the same directory (it keeps the symlinks the user came through).
+ */
+static bool load_cwd(void) {
+    const char *pwd = vars_get("PWD");
+    if (pwd && pwd[0] == '/') {
+        char canonical[PATH_MAX];
+        const size_t len = canonicalize(canonical, 0, pwd);
+        if (len && !strcmp(canonical, pwd) && is_current_directory(pwd)) {
+            memcpy(cwd.path, canonical, len + 1);
+            cwd.len = len;
+            cwd.valid = true;
+            return true;
+        }
+    }
+
+    if (!getcwd(cwd.path, sizeof(cwd.path)))
+        return false;
+    cwd.len = strlen(cwd.path);
+    cwd.valid = true;
+    vars_set("PWD", cwd.path, false);
+    return true;
+}
+
+/**
+ * @return  The logical working directory, or NULL (with errno set) if it cannot be found,
+ *          e.g. because the directory was removed.
+ */
+const char *cwd_get(void) {
+    if (!cwd.valid && !load_cwd())
+        return NULL;
+    return cwd.path;
+}
+
+/**
+ * Changes directory to @path, relative paths taken from the logical cwd, and updates PWD and
+ * OLDPWD.
+ *
+ * The target is first canonicalized lexically, so `cd ..` leaves a symlinked directory the
+ * way it was entered. If that path does not work (a `..` through a symlink whose target's
+ * parent differs), @path is tried as the kernel resolves it and the cwd is looked up again.
+ *
+ * @return  0, or an errno value.
+ */
+int cwd_change(const char *path) {
+    char target[PATH_MAX];
+    size_t len = 0;
+    const char *previous = cwd_get();
+    if (previous) {
+        memcpy(target, previous, cwd.len + 1);
+        len = canonicalize(target, cwd.len, path);
+    } else if (path[0] == '/') {
+        len = canonicalize(target, 0, path);
+    }
+
+    char *oldpwd = previous ? strdup(previous) : NULL;
+    if (len && chdir(target) == 0) {
+        memcpy(cwd.path, target, len + 1);
+        cwd.len = len;
+        cwd.valid = true;
+    } else if (chdir(path) == 0) {
+        cwd.valid = false;
+    } else {
+        const int err = errno;
+        free(oldpwd);
+        return err;
+    }
+
+    if (oldpwd)
+        vars_set("OLDPWD", oldpwd, false);
+    free(oldpwd);
+    if (cwd_get())
+        vars_set("PWD", cwd.path, false);
+
+    // Relative PATH entries now name other directories
+    util_path_cwd_changed();
+    return 0;
+}
+
+/**
+ * Pushes a copy of @dir onto the directory stack.
+ */
+bool cwd_stack_push(const char *dir) {
+    if (cwd.stack_count == cwd.stack_capacity) {
+        const size_t capacity = cwd.stack_capacity ? cwd.stack_capacity * 2 : 8;
+        char **stack = realloc(cwd.stack, capacity * sizeof *stack);
+        if (!stack)
+            return false;
+        cwd.stack = stack;
+        cwd.stack_capacity = capacity;
+    }
+
+    char *copy = strdup(dir);
+    if (!copy)
+        return false;
+    cwd.stack[cwd.stack_count++] = copy;
+    return true;
+}
+
+/**
+ * @return  The top of the directory stack, to be freed by the caller; NULL if it is empty.
+ */
+char *cwd_stack_pop(void) { return cwd.stack_count ? cwd.stack[--cwd.stack_count] : NULL; }
+
+/**
+ * @return  The entry @index places below the top (0 is the top), NULL past the bottom.
+ */
+const char *cwd_stack_get(const size_t index) {
+    return index < cwd.stack_count ? cwd.stack[cwd.stack_count - 1 - index] : NULL;
+}
+
+size_t cwd_stack_count(void) { return cwd.stack_count; }
+
+void cwd_stack_clear(void) {
+    while (cwd.stack_count)
+        free(cwd.stack[--cwd.stack_count]);
+}
@@ -0,0 +1,15 @@
+#ifndef CWD_H
+#define CWD_H
+#include <stdbool.h>
+#include <stddef.h>
+
+const char *cwd_get(void);
+int cwd_change(const char *path);
+
+bool cwd_stack_push(const char *dir);
+char *cwd_stack_pop(void);
+const char *cwd_stack_get(size_t index);
+size_t cwd_stack_count(void);
+void cwd_stack_clear(void);
+
+#endif // CWD_H
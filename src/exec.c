@@ -0,0 +1,249 @@
+#define _GNU_SOURCE // posix_spawn_file_actions_addtcsetpgrp_np()
+#include "exec.h"
+#include "trace.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char **environ;
+
+// Signals the shell ignores but its children must see at their defaults (job control)
+#define EXEC_MAX_DEFAULT_SIGNALS 8
+static int child_default_signals[EXEC_MAX_DEFAULT_SIGNALS];
+static int child_default_signal_count = 0;
+static sigset_t child_default_sigset;
+
+/**
+ * Makes every child started from now on reset @signals to SIG_DFL. Ignored signals survive
+ * exec, so without this an interactive shell's children could not be interrupted.
+ */
+void exec_set_child_signal_defaults(const int signals[], const int count) {
+    sigemptyset(&child_default_sigset);
+    child_default_signal_count = 0;
+    for (int i = 0; i < count && i < EXEC_MAX_DEFAULT_SIGNALS; i++) {
+        child_default_signals[child_default_signal_count++] = signals[i];
+        sigaddset(&child_default_sigset, signals[i]);
+    }
+}
+
+/**
+ * Process group and signal setup for a freshly forked child, the fork() counterpart of the
+ * spawn attributes used by launch_spawn().
+ *
+ * @param pgid    -1 to stay in the shell's process group, 0 to lead a new one, else the group
+ *                to join.
+ * @param tty_fd  When not -1, the terminal whose foreground group the child's group becomes.
+ */
+void exec_child_setup(const pid_t pgid, const int tty_fd) {
+    // The trace belongs to the shell; a child must not flush its copy of the buffer
+    trace_active = false;
+
+    if (pgid != -1)
+        setpgid(0, pgid);
+    // Still ignoring SIGTTOU here, so a background group may take the terminal
+    if (tty_fd != -1)
+        tcsetpgrp(tty_fd, getpgrp());
+
+    for (int i = 0; i < child_default_signal_count; i++)
+        signal(child_default_signals[i], SIG_DFL);
+}
+
+/**
+ * Expresses the pipe ends and redirections as spawn file actions, in the order they were
+ * written. addopen() opens the file straight onto target_fd in the child, so nothing in the
+ * shell's own fd table is touched. Pipes are wired first so explicit redirections override
+ * them, as in other shells. The terminal is handed over before any of that, while the
+ * child's stdin is still the shell's.
+ */
+static int build_file_actions(posix_spawn_file_actions_t *actions, const RedirSpec specs[],
+                              const int count, const int in_fd, const int out_fd,
+                              const int tty_fd) {
+    int err = posix_spawn_file_actions_init(actions);
+    if (err != 0)
+        return err;
+
+    if (tty_fd != -1 && (err = posix_spawn_file_actions_addtcsetpgrp_np(actions, tty_fd))) {
+        posix_spawn_file_actions_destroy(actions);
+        return err;
+    }
+
+    if (in_fd != -1 && (err = posix_spawn_file_actions_adddup2(actions, in_fd, STDIN_FILENO))) {
+        posix_spawn_file_actions_destroy(actions);
+        return err;
+    }
+
+    if (out_fd != -1 &&
+        (err = posix_spawn_file_actions_adddup2(actions, out_fd, STDOUT_FILENO))) {
+        posix_spawn_file_actions_destroy(actions);
+        return err;
+    }
+
+    for (int i = 0; i < count && err == 0; i++) {
+        const RedirSpec *spec = &specs[i];
+        switch (spec->kind) {
+        case REDIR_OPEN:
+            err = posix_spawn_file_actions_addopen(actions, spec->target_fd, spec->filename,
+                                                   spec->open_flags, 0644);
+            break;
+        case REDIR_DUP:
+        case REDIR_HERE:
+            err = posix_spawn_file_actions_adddup2(actions, spec->source_fd, spec->target_fd);
+            break;
+        case REDIR_CLOSE:
+            err = posix_spawn_file_actions_addclose(actions, spec->target_fd);
+            break;
+        }
+    }
+
+    if (err != 0) {
+        posix_spawn_file_actions_destroy(actions);
+        return err;
+    }
+
+    return 0;
+}
+
+/**
+ * Expresses the process group and the signals to reset as spawn attributes.
+ *
+ * @return  false (and leaves @attr uninitialized) if no attribute is needed.
+ */
+static bool build_spawn_attr(posix_spawnattr_t *attr, const pid_t pgid, int *err) {
+    *err = 0;
+    if (pgid == -1 && child_default_signal_count == 0)
+        return false;
+
+    if ((*err = posix_spawnattr_init(attr)) != 0)
+        return false;
+
+    short flags = 0;
+    if (pgid != -1) {
+        flags |= POSIX_SPAWN_SETPGROUP;
+        *err = posix_spawnattr_setpgroup(attr, pgid);
+    }
+    if (*err == 0 && child_default_signal_count > 0) {
+        flags |= POSIX_SPAWN_SETSIGDEF;
+        *err = posix_spawnattr_setsigdefault(attr, &child_default_sigset);
+    }
+    if (*err == 0)
+        *err = posix_spawnattr_setflags(attr, flags);
+
+    if (*err != 0) {
+        posix_spawnattr_destroy(attr);
+        return false;
+    }
+    return true;
+}
+
+static int launch_spawn(const char *bin_path, char *const argv[], char *const envp[],
+                        const RedirSpec specs[], const int redir_count, const int in_fd,
+                        const int out_fd, const pid_t pgid, const int tty_fd, pid_t *pid_out) {
+    posix_spawn_file_actions_t actions;
+    int err = build_file_actions(&actions, specs, redir_count, in_fd, out_fd, tty_fd);
+    if (err != 0)
+        return err;
+
+    posix_spawnattr_t attr;
+    const bool has_attr = build_spawn_attr(&attr, pgid, &err);
+    if (err == 0)
+        err = posix_spawn(pid_out, bin_path, &actions, has_attr ? &attr : NULL, argv, envp);
+
+    if (has_attr)
+        posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+    return err;
+}
+
+/**
+ * Moves the pipe ends onto stdin/stdout. Only for use in a freshly forked child.
+ */
+static void child_wire_pipes(const int in_fd, const int out_fd) {
+    if (in_fd != -1 && dup2(in_fd, STDIN_FILENO) == -1) {
+        perror("dup2");
+        _exit(1);
+    }
+
+    if (out_fd != -1 && dup2(out_fd, STDOUT_FILENO) == -1) {
+        perror("dup2");
+        _exit(1);
+    }
+}
+
+static int launch_fork(const char *bin_path, char *const argv[], char *const envp[],
+                       const RedirSpec specs[], const int redir_count, const int in_fd,
+                       const int out_fd, const pid_t pgid, const int tty_fd, pid_t *pid_out) {
+    const pid_t pid = fork();
+    if (pid == -1)
+        return errno;
+
+    if (pid == 0) {
+        exec_child_setup(pgid, tty_fd);
+        child_wire_pipes(in_fd, out_fd);
+        if (!apply_all_redirection(specs, redir_count))
+            _exit(1);
+        execve(bin_path, argv, envp);
+        perror("execve failed");
+        _exit(127);
+    }
+
+    // Also from the parent, so the group exists before anyone hands it the terminal
+    if (pgid != -1)
+        setpgid(pid, pgid ? pgid : pid);
+
+    *pid_out = pid;
+    return 0;
+}
+
+/**
+ * Starts @bin_path with @argv, the environment @envp (the shell's own environ if NULL) and
+ * the given redirections applied in the child only.
+ * @in_fd and @out_fd, when not -1, become the child's stdin and stdout before the
+ * redirections are applied (pipeline wiring). @pgid is the child's process group: -1 keeps
+ * the shell's, 0 makes the child the leader of a new one. @tty_fd, when not -1, is the
+ * terminal the child's group takes before exec, so a foreground job that reads or configures
+ * it straight away is not stopped by SIGTTIN or SIGTTOU.
+ *
+ * @return  0 and the child's pid in @pid_out, or an errno value. With EXEC_LAUNCH_SPAWN
+ *          this is also how a failed exec or redirection shows up, with no child left
+ *          behind; the errno alone does not say which of the two failed.
+ */
+int exec_launch(const ExecLaunchMode mode, const char *bin_path, char *const argv[],
+                char *const envp[], const RedirSpec specs[], const int redir_count,
+                const int in_fd, const int out_fd, const pid_t pgid, const int tty_fd,
+                pid_t *pid_out) {
+    if (!envp)
+        envp = environ;
+
+    if (mode == EXEC_LAUNCH_FORK)
+        return launch_fork(bin_path, argv, envp, specs, redir_count, in_fd, out_fd, pgid,
+                           tty_fd, pid_out);
+
+    return launch_spawn(bin_path, argv, envp, specs, redir_count, in_fd, out_fd, pgid, tty_fd,
+                        pid_out);
+}
+
+/**
+ * Waits for exactly @pid (unlike wait(NULL), which reaps whatever child exits first).
+ *
+ * @return  The exit code, 128 + signal number if it was killed, or -1 on error.
+ */
+int exec_wait(const pid_t pid) {
+    int status;
+    while (waitpid(pid, &status, 0) == -1) {
+        if (errno != EINTR) {
+            perror("waitpid");
+            return -1;
+        }
+    }
+
+    if (WIFEXITED(status))
+        return WEXITSTATUS(status);
+    if (WIFSIGNALED(status))
+        return 128 + WTERMSIG(status);
+    return -1;
+}
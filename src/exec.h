@@ -0,0 +1,25 @@
+#ifndef EXEC_H
+#define EXEC_H
+#include "redirection.h"
+
+#include <sys/types.h>
+
+/**
+ * How an external program is started.
+ *
+ * EXEC_LAUNCH_SPAWN  posix_spawn(); glibc implements it with clone(CLONE_VM|CLONE_VFORK), so
+ *                    the cost does not grow with the shell's heap. Redirections become
+ *                    spawn file actions.
+ * EXEC_LAUNCH_FORK   fork() + apply_all_redirection() + execv() in the child. Only needed
+ *                    when the child has to run shell code before exec.
+ */
+typedef enum { EXEC_LAUNCH_SPAWN, EXEC_LAUNCH_FORK } ExecLaunchMode;
+
+int exec_launch(ExecLaunchMode mode, const char *bin_path, char *const argv[],
+                char *const envp[], const RedirSpec specs[], int redir_count, int in_fd,
+                int out_fd, pid_t pgid, int tty_fd, pid_t *pid_out);
+void exec_set_child_signal_defaults(const int signals[], int count);
+void exec_child_setup(pid_t pgid, int tty_fd);
+int exec_wait(pid_t pid);
+
+#endif // EXEC_H
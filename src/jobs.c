@@ -0,0 +1,570 @@
+#define _GNU_SOURCE // pipe2(), wait4()
+#include "jobs.h"
+#include "exec.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "memstats.h"
+
+/**
+ * @pid      The process.
+ * @status   Raw wait status, valid once done.
+ * @done     Exited or was killed, and has been reaped.
+ * @stopped  Stopped by a signal (Ctrl-Z, SIGTTIN, ...) and not continued since.
+ */
+typedef struct {
+    pid_t pid;
+    int status;
+    bool done;
+    bool stopped;
+} JobProcess;
+
+/**
+ * @id          Job number, as in %1.
+ * @pgid        Process group; the shell's own group without job control.
+ * @procs       One entry per started pipeline stage, the last stage last.
+ * @proc_count  Number of entries in procs.
+ * @command     The command line, for display. Owned by table entries.
+ * @reported    The state the user was last told about.
+ * @tmodes      Terminal modes the job left behind when it stopped, restored by fg.
+ * @has_tmodes  tmodes is valid.
+ */
+typedef struct {
+    int id;
+    pid_t pgid;
+    JobProcess *procs;
+    int proc_count;
+    char *command;
+    JobState reported;
+    struct termios tmodes;
+    bool has_tmodes;
+} Job;
+
+// Background and stopped jobs. Foreground jobs only enter the table when they stop.
+static Job *jobs;
+static int job_count;
+static int job_capacity;
+
+static bool job_control = false;
+static pid_t shell_pgid;
+static struct termios shell_tmodes;
+
+// Resource usage of the foreground processes reaped since the last jobs_take_usage()
+static struct rusage foreground_usage;
+
+// Written to by the SIGCHLD handler, drained before each prompt
+static int sigchld_pipe[2] = {-1, -1};
+
+// Ignored by an interactive shell so only the foreground job reacts to them
+static const int JOB_CONTROL_SIGNALS[] = {SIGINT, SIGQUIT, SIGTSTP, SIGTTIN, SIGTTOU};
+
+#define JOB_CONTROL_SIGNAL_COUNT                                                               \
+    (int)(sizeof(JOB_CONTROL_SIGNALS) / sizeof(JOB_CONTROL_SIGNALS[0]))
+
+static void on_sigchld(const int sig) {
+    (void)sig;
+    const int saved_errno = errno;
+    // Only a wakeup; if the pipe is full one is already pending
+    const ssize_t written = write(sigchld_pipe[1], "", 1);
+    (void)written;
+    errno = saved_errno;
+}
+
+/**
+ * Installs the SIGCHLD self-pipe and, for an interactive shell, turns on job control: the
+ * shell gets a process group of its own and the terminal, and ignores the keyboard signals
+ * that are meant for the foreground job.
+ *
+ * @return  false if the SIGCHLD handler could not be installed.
+ */
+bool jobs_init(const bool interactive) {
+    if (pipe2(sigchld_pipe, O_CLOEXEC | O_NONBLOCK) == -1) {
+        perror("pipe2");
+        return false;
+    }
+
+    struct sigaction sa = {0};
+    sa.sa_handler = on_sigchld;
+    sigemptyset(&sa.sa_mask);
+    // Reads and waits simply resume; the pipe tells the input loop what happened
+    sa.sa_flags = SA_RESTART;
+    if (sigaction(SIGCHLD, &sa, NULL) == -1) {
+        perror("sigaction");
+        return false;
+    }
+
+    if (!interactive)
+        return true;
+
+    // Started in the background of another shell: wait until we are given the terminal
+    pid_t pgid;
+    while (tcgetpgrp(STDIN_FILENO) != (pgid = getpgrp()))
+        kill(-pgid, SIGTTIN);
+
+    for (int i = 0; i < JOB_CONTROL_SIGNAL_COUNT; i++)
+        signal(JOB_CONTROL_SIGNALS[i], SIG_IGN);
+    exec_set_child_signal_defaults(JOB_CONTROL_SIGNALS, JOB_CONTROL_SIGNAL_COUNT);
+
+    // A session leader already leads its process group
+    if (setpgid(0, 0) == -1 && errno != EPERM) {
+        perror("setpgid");
+        return true;
+    }
+
+    shell_pgid = getpgrp();
+    if (tcsetpgrp(STDIN_FILENO, shell_pgid) == -1 || tcgetattr(STDIN_FILENO, &shell_tmodes)) {
+        perror("tcsetpgrp");
+        return true;
+    }
+
+    job_control = true;
+    return true;
+}
+
+bool jobs_control_enabled(void) { return job_control; }
+
+/**
+ * Called in a forked child that runs commands for the shell (command substitution): its
+ * commands stay in the child's process group and never take the terminal.
+ */
+void jobs_enter_subshell(void) { job_control = false; }
+
+static void set_process_status(JobProcess *proc, const int status) {
+    if (WIFSTOPPED(status)) {
+        proc->stopped = true;
+    } else if (WIFCONTINUED(status)) {
+        proc->stopped = false;
+    } else {
+        proc->status = status;
+        proc->done = true;
+        proc->stopped = false;
+    }
+}
+
+static JobState job_state(const Job *job) {
+    bool running = false;
+    for (int i = 0; i < job->proc_count; i++) {
+        if (job->procs[i].stopped)
+            return JOB_STOPPED;
+        if (!job->procs[i].done)
+            running = true;
+    }
+    return running ? JOB_RUNNING : JOB_DONE;
+}
+
+/**
+ * @return  Exit status of the job's last process, 128 + signal if it was killed or
+ *          128 + SIGTSTP while the job is stopped.
+ */
+static int job_status(const Job *job) {
+    if (job_state(job) == JOB_STOPPED)
+        return 128 + SIGTSTP;
+
+    const int status = job->procs[job->proc_count - 1].status;
+    if (WIFSIGNALED(status))
+        return 128 + WTERMSIG(status);
+    return WEXITSTATUS(status);
+}
+
+static Job *find_job(const int id) {
+    for (int i = 0; i < job_count; i++) {
+        if (jobs[i].id == id)
+            return &jobs[i];
+    }
+    return NULL;
+}
+
+// The most recent job is the one fg and bg act on by default
+static int current_job_id(void) { return job_count > 0 ? jobs[job_count - 1].id : -1; }
+
+/**
+ * Copies @job into the table, with an owned command string and process list.
+ *
+ * @return  The table entry, valid until the next add or remove.
+ */
+static Job *add_job(const Job *job) {
+    if (job_count == job_capacity) {
+        const int capacity = job_capacity ? job_capacity * 2 : 8;
+        Job *grown = realloc(jobs, capacity * sizeof *grown);
+        if (!grown) {
+            perror("realloc");
+            return NULL;
+        }
+        jobs = grown;
+        job_capacity = capacity;
+    }
+
+    Job *entry = &jobs[job_count];
+    *entry = *job;
+    entry->id = job_count > 0 ? jobs[job_count - 1].id + 1 : 1;
+    entry->procs = malloc(job->proc_count * sizeof *entry->procs);
+    entry->command = strdup(job->command ? job->command : "");
+    if (!entry->procs || !entry->command) {
+        perror("malloc");
+        free(entry->procs);
+        free(entry->command);
+        return NULL;
+    }
+
+    memcpy(entry->procs, job->procs, job->proc_count * sizeof *entry->procs);
+    job_count++;
+    return entry;
+}
+
+static void remove_job(Job *job) {
+    free(job->procs);
+    free(job->command);
+
+    const int index = (int)(job - jobs);
+    memmove(job, job + 1, (job_count - index - 1) * sizeof *job);
+    job_count--;
+}
+
+// Adds a reaped process's resource usage to what jobs_take_usage() reports
+static void add_usage(const struct rusage *usage) {
+    timeradd(&foreground_usage.ru_utime, &usage->ru_utime, &foreground_usage.ru_utime);
+    timeradd(&foreground_usage.ru_stime, &usage->ru_stime, &foreground_usage.ru_stime);
+    if (usage->ru_maxrss > foreground_usage.ru_maxrss)
+        foreground_usage.ru_maxrss = usage->ru_maxrss;
+    foreground_usage.ru_nvcsw += usage->ru_nvcsw;
+    foreground_usage.ru_nivcsw += usage->ru_nivcsw;
+}
+
+/**
+ * Waits until every process of @job has finished or one of them has stopped. A foreground
+ * job gets the terminal meanwhile, and the shell takes it back (and restores its terminal
+ * modes, which e.g. an editor may have changed) afterwards.
+ */
+static void wait_for_job(Job *job, const bool foreground) {
+    const bool take_terminal = foreground && job_control;
+    if (take_terminal) {
+        tcsetpgrp(STDIN_FILENO, job->pgid);
+        if (job->has_tmodes)
+            tcsetattr(STDIN_FILENO, TCSADRAIN, &job->tmodes);
+    }
+
+    const int options = job_control ? WUNTRACED : 0;
+    for (int i = 0; i < job->proc_count && job_state(job) == JOB_RUNNING; i++) {
+        JobProcess *proc = &job->procs[i];
+        while (!proc->done && !proc->stopped) {
+            int status;
+            struct rusage usage;
+            if (wait4(proc->pid, &status, options, &usage) == -1) {
+                if (errno == EINTR)
+                    continue;
+                // Already reaped, e.g. in a forked pipeline stage; nothing more to learn
+                proc->done = true;
+                proc->status = 0;
+                break;
+            }
+            set_process_status(proc, status);
+            if (proc->done)
+                add_usage(&usage);
+        }
+    }
+
+    if (take_terminal) {
+        if (job_state(job) == JOB_STOPPED)
+            job->has_tmodes = tcgetattr(STDIN_FILENO, &job->tmodes) == 0;
+        tcsetpgrp(STDIN_FILENO, shell_pgid);
+        tcsetattr(STDIN_FILENO, TCSADRAIN, &shell_tmodes);
+    }
+}
+
+static void print_job(OutBuf *out, const Job *job, const JobsPrintMode mode) {
+    if (mode == JOBS_PRINT_PGIDS) {
+        outbuf_printf(out, "%d\n", (int)job->pgid);
+        return;
+    }
+
+    char state[64];
+    const JobState current = job_state(job);
+    const int status = job->procs[job->proc_count - 1].status;
+    if (current == JOB_RUNNING)
+        snprintf(state, sizeof(state), "Running");
+    else if (current == JOB_STOPPED)
+        snprintf(state, sizeof(state), "Stopped");
+    else if (WIFSIGNALED(status))
+        snprintf(state, sizeof(state), "%s", strsignal(WTERMSIG(status)));
+    else if (WEXITSTATUS(status) != 0)
+        snprintf(state, sizeof(state), "Exit %d", WEXITSTATUS(status));
+    else
+        snprintf(state, sizeof(state), "Done");
+
+    const char marker = job->id == current_job_id() ? '+' : ' ';
+    const char *suffix = current == JOB_RUNNING ? " &" : "";
+    if (mode == JOBS_PRINT_LONG)
+        outbuf_printf(out, "[%d]%c %d %-20s%s%s\n", job->id, marker, (int)job->pgid, state,
+                      job->command, suffix);
+    else
+        outbuf_printf(out, "[%d]%c  %-24s%s%s\n", job->id, marker, state, job->command, suffix);
+}
+
+/**
+ * Collects the state changes of every table job without blocking. Only the table's own
+ * pids are waited for, so foreground children are never reaped behind anyone's back.
+ */
+static void reap_jobs(void) {
+    for (int i = 0; i < job_count; i++) {
+        for (int k = 0; k < jobs[i].proc_count; k++) {
+            JobProcess *proc = &jobs[i].procs[k];
+            int status;
+            while (!proc->done &&
+                   waitpid(proc->pid, &status, WNOHANG | WUNTRACED | WCONTINUED) > 0)
+                set_process_status(proc, status);
+        }
+    }
+}
+
+/**
+ * Runs a started foreground job to completion.
+ *
+ * @param arena    Scratch memory for the job's process list.
+ * @param pgid     The job's process group, -1 if it runs in the shell's.
+ * @param pids     The started processes, the last pipeline stage last.
+ * @param count    Number of entries in pids, at least one.
+ * @param command  The command line, shown if the job is stopped.
+ * @return         Exit status of the last process, 128 + signal if it was killed. If the job
+ *                 was stopped it is added to the job table and 128 + SIGTSTP is returned.
+ */
+int jobs_run_foreground(Arena *arena, const pid_t pgid, const pid_t pids[], const int count,
+                        const char *command) {
+    JobProcess *procs = arena_alloc(arena, count * sizeof *procs);
+    if (!procs) {
+        perror("arena_alloc");
+        for (int i = 0; i < count; i++)
+            exec_wait(pids[i]);
+        return 1;
+    }
+
+    for (int i = 0; i < count; i++)
+        procs[i] = (JobProcess){.pid = pids[i]};
+
+    Job job = {.pgid = pgid != -1 ? pgid : getpgrp(),
+               .procs = procs,
+               .proc_count = count,
+               .command = (char *)command};
+    wait_for_job(&job, true);
+
+    if (job_state(&job) != JOB_STOPPED)
+        return job_status(&job);
+
+    job.reported = JOB_STOPPED;
+    Job *entry = add_job(&job);
+    if (entry) {
+        OutBuf out;
+        outbuf_init(&out, STDERR_FILENO);
+        outbuf_write(&out, "\n", 1);
+        print_job(&out, entry, JOBS_PRINT_DEFAULT);
+        outbuf_flush(&out);
+    }
+    return 128 + SIGTSTP;
+}
+
+/**
+ * Hands out the resource usage of the foreground processes that finished since the last
+ * call (user and system time and context switches summed, the largest max RSS), as wait4()
+ * reported it, and starts counting afresh.
+ */
+void jobs_take_usage(struct rusage *usage) {
+    *usage = foreground_usage;
+    foreground_usage = (struct rusage){0};
+}
+
+/**
+ * Puts a started job into the table without waiting for it. With job control the job
+ * number and the pid of its last process are printed, as in other shells.
+ *
+ * @return  The job number, or -1 if it could not be remembered.
+ */
+int jobs_add_background(Arena *arena, const pid_t pgid, const pid_t pids[], const int count,
+                        const char *command) {
+    JobProcess *procs = arena_alloc(arena, count * sizeof *procs);
+    if (!procs) {
+        perror("arena_alloc");
+        return -1;
+    }
+
+    for (int i = 0; i < count; i++)
+        procs[i] = (JobProcess){.pid = pids[i]};
+
+    const Job job = {.pgid = pgid != -1 ? pgid : getpgrp(),
+                     .procs = procs,
+                     .proc_count = count,
+                     .command = (char *)command};
+    const Job *entry = add_job(&job);
+    if (!entry)
+        return -1;
+
+    if (job_control)
+        fprintf(stderr, "[%d] %d\n", entry->id, (int)pids[count - 1]);
+    return entry->id;
+}
+
+/**
+ * Called before each prompt. Reaps the jobs whose children changed state since the last call
+ * (the SIGCHLD handler leaves a byte in the self-pipe, so an idle call costs one read) and,
+ * with job control, reports them and forgets the finished ones.
+ */
+void jobs_notify(void) {
+    char buf[64];
+    bool woken = false;
+    while (read(sigchld_pipe[0], buf, sizeof(buf)) > 0)
+        woken = true;
+
+    if (woken)
+        reap_jobs();
+    if (!job_control)
+        return;
+
+    OutBuf out;
+    outbuf_init(&out, STDERR_FILENO);
+    for (int i = 0; i < job_count;) {
+        Job *job = &jobs[i];
+        const JobState state = job_state(job);
+        if (state != job->reported) {
+            print_job(&out, job, JOBS_PRINT_DEFAULT);
+            job->reported = state;
+        }
+
+        if (state == JOB_DONE)
+            remove_job(job);
+        else
+            i++;
+    }
+    outbuf_flush(&out);
+}
+
+/**
+ * Resolves a job spec: %N, %% / %+ / % or NULL for the current job, or the pid of any of a
+ * job's processes.
+ *
+ * @return  The job number, or -1 if there is no such job.
+ */
+int jobs_find(const char *spec) {
+    if (!spec || !strcmp(spec, "%") || !strcmp(spec, "%%") || !strcmp(spec, "%+"))
+        return current_job_id();
+
+    char *end;
+    const long value = strtol(spec[0] == '%' ? spec + 1 : spec, &end, 10);
+    if (*end != '\0' || end == spec || value <= 0)
+        return -1;
+
+    if (spec[0] == '%')
+        return find_job((int)value) ? (int)value : -1;
+
+    for (int i = 0; i < job_count; i++) {
+        for (int k = 0; k < jobs[i].proc_count; k++) {
+            if (jobs[i].procs[k].pid == (pid_t)value)
+                return jobs[i].id;
+        }
+    }
+    return -1;
+}
+
+const char *jobs_command(const int id) {
+    const Job *job = find_job(id);
+    return job ? job->command : NULL;
+}
+
+/**
+ * Lists the table, `jobs` style. Finished jobs are listed once more and then forgotten.
+ */
+void jobs_print(OutBuf *out, const JobsPrintMode mode) {
+    reap_jobs();
+
+    for (int i = 0; i < job_count; i++) {
+        print_job(out, &jobs[i], mode);
+        jobs[i].reported = job_state(&jobs[i]);
+    }
+
+    for (int i = 0; i < job_count;) {
+        if (job_state(&jobs[i]) == JOB_DONE)
+            remove_job(&jobs[i]);
+        else
+            i++;
+    }
+}
+
+/**
+ * Blocks until job @id has finished (or, with job control, stopped) and forgets it if it
+ * finished.
+ *
+ * @return  The job's exit status as in jobs_run_foreground(), 127 if there is no such job.
+ */
+int jobs_wait(const int id) {
+    Job *job = find_job(id);
+    if (!job)
+        return 127;
+
+    wait_for_job(job, false);
+    const int status = job_status(job);
+    if (job_state(job) == JOB_DONE)
+        remove_job(job);
+    return status;
+}
+
+/**
+ * Blocks until every job has finished or stopped.
+ *
+ * @return  0, as `wait` without operands does.
+ */
+int jobs_wait_all(void) {
+    for (int i = 0; i < job_count;) {
+        wait_for_job(&jobs[i], false);
+        if (job_state(&jobs[i]) == JOB_DONE)
+            remove_job(&jobs[i]);
+        else
+            i++;
+    }
+    return 0;
+}
+
+/**
+ * Continues job @id with SIGCONT, in the background or as the foreground job.
+ *
+ * @return  For the foreground, the job's status as in jobs_run_foreground(); otherwise 0.
+ *          1 if there is no such job or it could not be signalled.
+ */
+int jobs_resume(const int id, const bool foreground) {
+    Job *job = find_job(id);
+    if (!job)
+        return 1;
+
+    for (int i = 0; i < job->proc_count; i++)
+        job->procs[i].stopped = false;
+
+    if (kill(-job->pgid, SIGCONT) == -1) {
+        perror("kill");
+        return 1;
+    }
+
+    job->reported = JOB_RUNNING;
+    if (!foreground)
+        return 0;
+
+    wait_for_job(job, true);
+    const int status = job_status(job);
+    if (job_state(job) == JOB_DONE) {
+        remove_job(job);
+        return status;
+    }
+
+    job->reported = JOB_STOPPED;
+    OutBuf out;
+    outbuf_init(&out, STDERR_FILENO);
+    outbuf_write(&out, "\n", 1);
+    print_job(&out, job, JOBS_PRINT_DEFAULT);
+    outbuf_flush(&out);
+    return status;
+}
@@ -0,0 +1,36 @@
+#ifndef JOBS_H
+#define JOBS_H
+#include "arena.h"
+#include "outbuf.h"
+
+#include <stdbool.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+
+typedef enum { JOB_RUNNING, JOB_STOPPED, JOB_DONE } JobState;
+
+typedef enum {
+    JOBS_PRINT_DEFAULT, // [1]+  Running                 sleep 10
+    JOBS_PRINT_LONG,    // [1]+ 4242 Running             sleep 10
+    JOBS_PRINT_PGIDS,   // 4242
+} JobsPrintMode;
+
+bool jobs_init(bool interactive);
+bool jobs_control_enabled(void);
+void jobs_enter_subshell(void);
+
+int jobs_run_foreground(Arena *arena, pid_t pgid, const pid_t pids[], int count,
+                        const char *command);
+int jobs_add_background(Arena *arena, pid_t pgid, const pid_t pids[], int count,
+                        const char *command);
+void jobs_notify(void);
+void jobs_take_usage(struct rusage *usage);
+
+int jobs_find(const char *spec);
+const char *jobs_command(int id);
+void jobs_print(OutBuf *out, JobsPrintMode mode);
+int jobs_wait(int id);
+int jobs_wait_all(void);
+int jobs_resume(int id, bool foreground);
+
+#endif // JOBS_H
@@ -0,0 +1,109 @@
+#define _POSIX_C_SOURCE 200809L
+#include "line_reader.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "memstats.h"
+
+/**
+ * Maps a script read-only. Lines are handed out as (pointer, length) pairs into the mapping,
+ * so nothing is copied and no line is ever truncated.
+ *
+ * @return  false (with errno set) if the file cannot be opened or mapped.
+ */
+bool line_reader_open_file(LineReader *reader, const char *path) {
+    *reader = (LineReader){0};
+
+    const int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        close(fd);
+        return false;
+    }
+
+    // mmap() rejects zero-length mappings; an empty script simply has no lines
+    if (st.st_size == 0) {
+        close(fd);
+        reader->data = "";
+        return true;
+    }
+
+    void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return false;
+
+    posix_madvise(data, st.st_size, POSIX_MADV_SEQUENTIAL);
+
+    reader->data = data;
+    reader->size = st.st_size;
+    reader->mapped = true;
+    return true;
+}
+
+void line_reader_open_string(LineReader *reader, const char *text) {
+    line_reader_open_buffer(reader, text, strlen(text));
+}
+
+/**
+ * Reads the @len bytes at @text, which may contain NULs, like a script file.
+ */
+void line_reader_open_buffer(LineReader *reader, const char *text, const size_t len) {
+    *reader = (LineReader){.data = text, .size = len};
+}
+
+void line_reader_open_stream(LineReader *reader, FILE *stream) {
+    *reader = (LineReader){.stream = stream};
+}
+
+/**
+ * Fetches the next line without its trailing newline.
+ *
+ * @param line  Out: start of the line. Not NUL-terminated for mapped or string input;
+ *              valid until the next call.
+ * @param len   Out: length of the line.
+ * @return      1 on success, 0 at end of input, -1 on read error.
+ */
+int line_reader_next(LineReader *reader, const char **line, size_t *len) {
+    if (reader->data) {
+        if (reader->offset >= reader->size)
+            return 0;
+
+        const char *start = reader->data + reader->offset;
+        const size_t remaining = reader->size - reader->offset;
+        const char *newline = memchr(start, '\n', remaining);
+        const size_t line_len = newline ? (size_t)(newline - start) : remaining;
+
+        *line = start;
+        *len = line_len;
+        reader->offset += line_len + (newline ? 1 : 0);
+        return 1;
+    }
+
+    const ssize_t read = getline(&reader->line_buf, &reader->line_cap, reader->stream);
+    if (read == -1)
+        return ferror(reader->stream) ? -1 : 0;
+
+    size_t line_len = read;
+    if (line_len > 0 && reader->line_buf[line_len - 1] == '\n')
+        line_len--;
+
+    *line = reader->line_buf;
+    *len = line_len;
+    return 1;
+}
+
+void line_reader_close(LineReader *reader) {
+    if (reader->mapped)
+        munmap((void *)reader->data, reader->size);
+    free(reader->line_buf);
+    *reader = (LineReader){0};
+}
@@ -0,0 +1,35 @@
+#ifndef LINE_READER_H
+#define LINE_READER_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/**
+ * Hands out input lines one at a time, without a length limit.
+ *
+ * @data      In-memory input: a mmap'd script file, the -c string or a --serve request. NULL
+ *            for streams.
+ * @size      Bytes in data.
+ * @offset    Start of the next line in data.
+ * @mapped    data is a mapping that must be munmap'd.
+ * @stream    Stream input (stdin) read with getline() when data is NULL.
+ * @line_buf  getline() buffer, reused for every line.
+ */
+typedef struct {
+    const char *data;
+    size_t size;
+    size_t offset;
+    bool mapped;
+    FILE *stream;
+    char *line_buf;
+    size_t line_cap;
+} LineReader;
+
+bool line_reader_open_file(LineReader *reader, const char *path);
+void line_reader_open_string(LineReader *reader, const char *text);
+void line_reader_open_buffer(LineReader *reader, const char *text, size_t len);
+void line_reader_open_stream(LineReader *reader, FILE *stream);
+int line_reader_next(LineReader *reader, const char **line, size_t *len);
+void line_reader_close(LineReader *reader);
+
+#endif // LINE_READER_H
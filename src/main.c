@@ -1,237 +1,299 @@
 #define _POSIX_C_SOURCE 200809L
-#include "builtins.h"
-#include "path_utils.h"
+#include "jobs.h"
+#include "line_reader.h"
+#include "pipeline.h"
+#include "redirection.h"
+#include "serve.h"
+#include "term/complete.h"
+#include "term/history.h"
 #include "term/term.h"
 #include "tokenizer.h"
+#include "trace.h"
+#include "vars.h"
+#include "wildcard.h"
 
 #include <assert.h>
 #include <ctype.h>
-#include <fcntl.h>
+#include <errno.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/wait.h>
 #include <unistd.h>
 
-#define INPUT_SIZE 101
-#define MAX_ARGS 16
-#define MAX_TOKEN_COUNT (MAX_ARGS + 1)
+#include "memstats.h"
+
+// Everything a command line allocates; reset at the start of each line
+static Arena command_arena;
+
+// Exit status of the last line that ran, for $?
+static int last_status;
+
+// Where here-document bodies are read from: the input the current line came from
+static LineReader *input_reader;
+static bool input_interactive;
+
+// Here-document text is written to its memfd in chunks of this size
+#define HERE_DOCUMENT_CHUNK (256 * 1024)
 
 /**
- * @target_fd   The file descriptor we’ll redirect (e.g. STDOUT_FILENO).
- * @saved_fd    Backup of the original target_fd (initialized to –1).
- * @filename    NULL or a strdup’d string that the caller must free.
- * @open_flags  Flags passed to open(), e.g. O_WRONLY|O_CREAT|O_TRUNC.
+ * Parameter lookup for the tokenizer: the special parameters `$?` and `$$`, then the shell's
+ * variables.
  */
-typedef struct {
-    int target_fd;
-    int saved_fd;
-    char *filename;
-    int open_flags;
-} RedirSpec;
-
-static bool is_stdout_redirect(const char *c) {
-    return strcmp(c, ">") == 0 || strcmp(c, "1>") == 0;
+static const char *lookup_parameter(void *ctx, const char *name, const size_t len) {
+    (void)ctx;
+    if (len == 1 && (name[0] == '?' || name[0] == '$')) {
+        char *value = arena_alloc(&command_arena, 16);
+        if (value)
+            snprintf(value, 16, "%d", name[0] == '?' ? last_status : (int)getpid());
+        return value;
+    }
+    return vars_get_n(name, len);
 }
 
-static bool is_stdin_redirect(const char *c) { return strcmp(c, "<") == 0; }
-
-static bool is_stdout_append(const char *c) { return strcmp(c, ">>") == 0; }
+static int expand_pattern(void *ctx, Arena *arena, const char *pattern, char ***matches_out) {
+    (void)ctx;
+    return wildcard_expand(arena, pattern, matches_out);
+}
 
-static bool is_stderr_redirect(const char *c) { return strcmp(c, "2>") == 0; }
+static const char *substitute_command(void *ctx, Arena *arena, const char *command, size_t len);
+static int read_here_document(void *ctx, Arena *arena, const char *delimiter, bool strip_tabs,
+                              bool expand);
 
-static bool is_stderr_append(const char *c) { return strcmp(c, "2>>") == 0; }
+static const TokenizerHooks expansion_hooks = {.lookup = lookup_parameter,
+                                               .substitute = substitute_command,
+                                               .glob = expand_pattern,
+                                               .here_document = read_here_document};
 
 /**
- * extract_redirection - remove I/O redirections from argv
- * @tokens:     array of malloc'd strings
- * @token_count: original count
- * @new_token_count: out: new count after removing ops+filenames
- * @redir_specs_count_out: out: number of specs (always 3)
- *
- * Returns a malloc'd RedirSpec[3] (stdout, stderr, stdin), with
- * .filename == NULL if untouched, or a strdup'd target on success.
- * Returns NULL on parse or alloc failure (tokens[] left intact).
+ * Runs the command of a `$(...)` and returns its output minus trailing newlines. The command
+ * is tokenized with the same hooks, so substitutions nest. Its status becomes $?.
  */
-RedirSpec *extract_redirection(char *tokens[], int token_count, int *new_token_count,
-                               int *redir_specs_count_out) {
-    assert(new_token_count && redir_specs_count_out);
-    assert(token_count < MAX_TOKEN_COUNT);
-
-    char *kept_tokens[MAX_TOKEN_COUNT];
-    char *dropped_tokens[MAX_TOKEN_COUNT];
-    int dropped_tokens_index = 0;
-    int write_index = 0;
-
-    const int redir_spec_count = 3;
-    *redir_specs_count_out = redir_spec_count;
-    RedirSpec *redir_specs = calloc(redir_spec_count, sizeof *redir_specs);
-    if (!redir_specs) {
-        perror("calloc");
+static const char *substitute_command(void *ctx, Arena *arena, const char *command,
+                                      const size_t len) {
+    (void)ctx;
+    char **tokens;
+    bool *operators;
+    uint64_t trace_start = trace_begin();
+    const int token_count =
+        tokenize_input_expand(arena, command, len, &expansion_hooks, &tokens, &operators);
+    trace_end(TRACE_TOKENIZE, trace_start, NULL);
+    if (token_count < 0)
         return NULL;
+
+    OutCapture capture = {0};
+    if (token_count > 0) {
+        Pipeline pipeline;
+        trace_start = trace_begin();
+        const bool parsed = pipeline_parse(arena, tokens, operators, token_count, &pipeline);
+        trace_end(TRACE_PARSE, trace_start, NULL);
+        last_status = parsed ? pipeline_capture(arena, &pipeline, &capture) : 2;
     }
 
-    const int default_fds[3] = {STDOUT_FILENO, STDERR_FILENO, STDIN_FILENO};
-    for (int i = 0; i < redir_spec_count; i++) {
-        redir_specs[i].target_fd = default_fds[i];
-        redir_specs[i].saved_fd = -1;
+    while (capture.len > 0 && capture.data[capture.len - 1] == '\n')
+        capture.len--;
+    char *output = arena_strndup(arena, capture.data ? capture.data : "", capture.len);
+    free(capture.data);
+    return output;
+}
+
+/**
+ * Reads the lines of a here-document up to @delimiter from the shell's input into a sealed
+ * memfd. Unless the delimiter was quoted, each line is expanded as it is read.
+ *
+ * @return  The memfd, released after the line has run; -1 on error.
+ */
+static int read_here_document(void *ctx, Arena *arena, const char *delimiter,
+                              const bool strip_tabs, const bool expand) {
+    (void)ctx;
+    const int fd = here_document_create();
+    if (fd == -1) {
+        perror("memfd_create");
+        return -1;
     }
 
-    for (int i = 0; i < token_count; i++) {
-        int fd = -1;
-        int open_flags = 0;
-
-        if (is_stdout_redirect(tokens[i])) {
-            fd = STDOUT_FILENO;
-            open_flags = O_WRONLY | O_CREAT | O_TRUNC;
-        } else if (is_stdout_append(tokens[i])) {
-            fd = STDOUT_FILENO;
-            open_flags = O_WRONLY | O_CREAT | O_APPEND;
-        } else if (is_stderr_redirect(tokens[i])) {
-            fd = STDERR_FILENO;
-            open_flags = O_WRONLY | O_CREAT | O_TRUNC;
-        } else if (is_stderr_append(tokens[i])) {
-            fd = STDERR_FILENO;
-            open_flags = O_WRONLY | O_CREAT | O_APPEND;
-        } else if (is_stdin_redirect(tokens[i])) {
-            fd = STDIN_FILENO;
-            open_flags = O_RDONLY;
+    const size_t delimiter_len = strlen(delimiter);
+    OutCapture body = {0};
+    bool ok = true;
+    bool terminated = false;
+    while (ok && input_reader) {
+        if (input_interactive)
+            printf("> ");
+
+        const char *line;
+        size_t len;
+        if (line_reader_next(input_reader, &line, &len) <= 0)
+            break;
+        while (strip_tabs && len > 0 && line[0] == '\t') {
+            line++;
+            len--;
+        }
+        if (len == delimiter_len && !memcmp(line, delimiter, len)) {
+            terminated = true;
+            break;
         }
 
-        if (fd != -1) {
-            if (i + 1 >= token_count) {
-                fprintf(stderr, "syntax error: expected file after '%s'\n", tokens[i]);
-                goto error;
-            }
-            for (int j = 0; j < redir_spec_count; j++) {
-                if (redir_specs[j].target_fd == fd) {
-                    // POSIX shell behavior: last redirection to the same FD wins
-                    free(redir_specs[j].filename);
-                    // Copy filename
-                    redir_specs[j].filename = strdup(tokens[i + 1]);
-                    if (!redir_specs[j].filename) {
-                        perror("strdup");
-                        goto error;
-                    }
-                    redir_specs[j].open_flags = open_flags;
-                }
-            }
-            // Trash the redir token and filename, defer freeing until after we know parse succeeded
-            dropped_tokens[dropped_tokens_index++] = tokens[i];
-            dropped_tokens[dropped_tokens_index++] = tokens[i + 1];
-            i++; // Skip the filename
-            continue;
+        if (expand && !(line = tokenize_here_document(arena, line, len, &expansion_hooks, &len)))
+            ok = false;
+        ok = ok && outcapture_append(&body, line, len) && outcapture_append(&body, "\n", 1);
+        if (ok && body.len >= HERE_DOCUMENT_CHUNK) {
+            ok = here_document_write(fd, body.data, body.len);
+            body.len = 0;
         }
-        kept_tokens[write_index++] = tokens[i];
     }
 
-    for (int i = 0; i < dropped_tokens_index; i++) {
-        free(dropped_tokens[i]);
+    ok = ok && here_document_write(fd, body.data, body.len) && here_document_seal(fd);
+    free(body.data);
+    if (!ok) {
+        perror("here-document");
+        return -1;
     }
-
-    // Copy back & terminate
-    for (int i = 0; i < write_index; i++)
-        tokens[i] = kept_tokens[i];
-
-    tokens[write_index] = NULL;
-    *new_token_count = write_index;
-
-    // Clear any stale pointers
-    for (int i = write_index + 1; i < token_count; i++)
-        tokens[i] = NULL;
-
-    return redir_specs;
-
-error:
-    for (int j = 0; j < redir_spec_count; j++)
-        free(redir_specs[j].filename);
-    free(redir_specs);
-    return NULL;
+    if (!terminated)
+        fprintf(stderr, "sleepyshell: here-document delimited by end of input (wanted `%s')\n",
+                delimiter);
+    return fd;
 }
 
-void restore_all_redirection(RedirSpec specs[], const int count) {
-    for (int i = 0; i < count; i++) {
-        RedirSpec *spec = &specs[i];
-
-        if (spec->saved_fd == -1)
-            continue;
-
-        if (dup2(spec->saved_fd, spec->target_fd) == -1) {
-            perror("dup2");
-            continue;
-        }
-
-        close(spec->saved_fd);
-
-        spec->saved_fd = -1;
+/**
+ * @return  true if @line has a `<<`, so running it may read more input.
+ */
+static bool has_here_document(const char *line, const size_t len) {
+    for (const char *p = line; (p = memchr(p, '<', line + len - p)) && p + 1 < line + len; p++) {
+        if (p[1] == '<')
+            return true;
     }
+    return false;
 }
 
-bool apply_all_redirection(RedirSpec specs[], const int count) {
-    for (int i = 0; i < count; i++) {
-        RedirSpec *spec = &specs[i];
+/**
+ * Tokenizes and runs one input line.
+ *
+ * @return  Exit status of the line, or -1 if there was nothing to run.
+ */
+static int run_line(const char *line, const size_t len) {
+    // Comment lines, including a script's #! line
+    size_t start = 0;
+    while (start < len && (line[start] == ' ' || line[start] == '\t'))
+        start++;
+    if (start < len && line[start] == '#')
+        return -1;
+
+    arena_reset(&command_arena);
+
+    // Reading a here-document's body reuses the buffer of a stream's current line
+    if (input_reader && !input_reader->data && has_here_document(line, len)) {
+        if (!(line = arena_strndup(&command_arena, line, len)))
+            return 1;
+    }
 
-        if (!spec->filename)
-            continue;
+    char **tokens;
+    bool *operators;
+    uint64_t trace_start = trace_begin();
+    const int token_count =
+        tokenize_input_expand(&command_arena, line, len, &expansion_hooks, &tokens, &operators);
+    trace_end(TRACE_TOKENIZE, trace_start, NULL);
+    if (token_count < 0)
+        return 2;
+    if (token_count == 0)
+        return -1;
+
+    Pipeline pipeline;
+    trace_start = trace_begin();
+    const bool parsed =
+        pipeline_parse(&command_arena, tokens, operators, token_count, &pipeline);
+    trace_end(TRACE_PARSE, trace_start, NULL);
+    if (!parsed)
+        return 2;
+
+    const int status = pipeline_run(&command_arena, &pipeline);
+    return status;
+}
 
-        int fd = open(spec->filename, spec->open_flags, 0644);
-        if (fd == -1) {
-            perror("open");
-            restore_all_redirection(specs, count);
-            return false;
-        }
+/**
+ * Runs every line @reader produces.
+ *
+ * @return  Exit status of the last command that ran.
+ */
+static int run_lines(LineReader *reader, const bool interactive) {
+    int status = 0;
+    input_reader = reader;
+    input_interactive = interactive;
 
-        spec->saved_fd = dup(spec->target_fd);
-        if (spec->saved_fd == -1) {
-            perror("dup");
-            close(fd);
-            continue;
+    while (1) {
+        // Finished background jobs are reported here, before the prompt, as in other shells
+        jobs_notify();
+        if (interactive)
+            printf("$ ");
+
+        const char *line;
+        size_t len;
+        const uint64_t trace_start = trace_begin();
+        const int result = line_reader_next(reader, &line, &len);
+        trace_end(TRACE_READ, trace_start, NULL);
+        if (result == 0) {
+            if (interactive)
+                printf("\nexit\n");
+            return status;
         }
-
-        if (dup2(fd, spec->target_fd) == -1) {
-            perror("dup2");
-            close(fd);
-            continue;
+        if (result < 0) {
+            perror("getline");
+            return 1;
         }
 
-        close(fd);
+        const int line_status = run_line(line, len);
+        release_here_documents();
+        if (line_status != -1)
+            status = last_status = line_status;
     }
+}
 
-    return true;
+/**
+ * Runs one request of a --serve connection, which may hold several lines (and the bodies of
+ * their here-documents).
+ */
+static int run_script(const char *script, const size_t len) {
+    LineReader reader;
+    line_reader_open_buffer(&reader, script, len);
+    const int status = run_lines(&reader, false);
+    line_reader_close(&reader);
+    return status;
 }
 
-static void execute_command(const char *program_name, char *argv[16], RedirSpec specs[],
-                            int redir_count) {
-    char *bin_full_path = util_find_bin_in_path(program_name);
-    if (bin_full_path == NULL) {
-        printf("%s: command not found\n", program_name);
+#define HISTORY_FILE ".sleepyshell_history"
+
+static void open_history(void) {
+    const char *home = vars_get("HOME");
+    if (!home || !*home)
         return;
-    }
 
-    pid_t pid = fork();
-    if (pid == 0) {
-        apply_all_redirection(specs, redir_count);
-        execv(bin_full_path, argv);
-        perror("execv failed");
-        exit(1);
-    }
+    char path[4096];
+    if (snprintf(path, sizeof(path), "%s/" HISTORY_FILE, home) >= (int)sizeof(path))
+        return;
 
-    wait(NULL);
-    free(bin_full_path);
+    if (!history_open(path))
+        fprintf(stderr, "sleepyshell: %s: %s\n", path, strerror(errno));
 }
 
+extern char **environ;
+
 int main(int argc, char *argv[]) {
+    if (!vars_init(environ))
+        fprintf(stderr, "sleepyshell: cannot import the environment\n");
+
     // TODO: Finish rawmode implementation. This is just for test
     // TODO: If TERM env var is null we use fgets and bypass raw
 
     if (argc > 1 && strcmp(argv[1], "-raw") == 0) {
         term_enable_raw_mode();
+        open_history();
 
         printf("Raw mode enabled. Press 'q' to quit.\n");
 
         while (1) {
             char *input = term_read_input_raw();
+            if (!input)
+                break;
+            history_add(input);
             free(input);
             /*char c;
             if (read(STDIN_FILENO, &c, 1) == -1) {
@@ -246,74 +308,52 @@ int main(int argc, char *argv[]) {
             ;
         }
 
+        history_close();
+        complete_shutdown();
         term_disable_raw_mode();
         return 0;
     }
-    while (1) {
-        setbuf(stdout, NULL);
-        printf("$ ");
-
-        char input[INPUT_SIZE];
-        if (!fgets(input, INPUT_SIZE, stdin)) {
-            if (feof(stdin)) {
-                printf("\nexit\n");
-                return 0;
-            }
-            perror("fgets");
-            printf("\n");
-            return 1;
+    LineReader reader;
+    bool interactive = false;
+    const bool serve = argc > 1 && strcmp(argv[1], "--serve") == 0;
+
+    if (serve) {
+        if (argc < 3) {
+            fprintf(stderr, "sleepyshell: --serve: option requires a socket path\n");
+            return 2;
         }
-
-        input[strcspn(input, "\n")] = '\0';
-        char *tokens[MAX_TOKEN_COUNT];
-        int token_count = tokenize_input(input, tokens, MAX_TOKEN_COUNT);
-        if (token_count <= 0) {
-            continue;
+    } else if (argc > 1 && strcmp(argv[1], "-c") == 0) {
+        if (argc < 3) {
+            fprintf(stderr, "sleepyshell: -c: option requires an argument\n");
+            return 2;
         }
-
-        const char *command = tokens[0];
-        int cleaned_count = token_count;
-        int redir_specs_count = 0;
-
-        RedirSpec *specs =
-            extract_redirection(tokens, token_count, &cleaned_count, &redir_specs_count);
-        if (!specs) {
-            fprintf(stderr, "Failed to parse redirections\n");
-            free_tokens(tokens, token_count);
-            continue;
+        line_reader_open_string(&reader, argv[2]);
+    } else if (argc > 1) {
+        if (!line_reader_open_file(&reader, argv[1])) {
+            fprintf(stderr, "sleepyshell: %s: %s\n", argv[1], strerror(errno));
+            return 127;
         }
+    } else {
+        // Only a terminal gets prompts and unbuffered output; piped input runs like a script
+        interactive = isatty(STDIN_FILENO);
+        if (interactive)
+            setbuf(stdout, NULL);
+        line_reader_open_stream(&reader, stdin);
+    }
 
-        token_count = cleaned_count;
-        if (builtin_is_builtin(command)) {
-            apply_all_redirection(specs, redir_specs_count);
-            if (!strcmp(command, "exit")) {
-                free_tokens(tokens, token_count);
-                builtin_exit(tokens, token_count);
-                break;
-            }
+    const char *trace_path = vars_get("SLEEPYSHELL_TRACE");
+    if (trace_path && !*trace_path)
+        trace_path = NULL;
 
-            if (!strcmp(command, "echo")) {
-                builtin_echo(tokens, token_count);
-            } else if (!strcmp(command, "pwd")) {
-                builtin_pwd();
-            } else if (!strcmp(command, "cd")) {
-                char *arg = token_count > 1 ? tokens[1] : NULL;
-                builtin_cd(arg);
-            } else if (!strcmp(command, "type")) {
-                builtin_type(tokens, token_count);
-            }
-        } else {
-            execute_command(command, tokens, specs, redir_specs_count);
-        }
+    // Each connection sets up its own job handling, and its own trace
+    if (serve)
+        return serve_run(argv[2], trace_path, run_script);
 
-        // cleanup
-        restore_all_redirection(specs, redir_specs_count);
-        free_tokens(tokens, token_count);
-        for (int i = 0; i < redir_specs_count; i++) {
-            free(specs[i].filename);
-        }
-        free(specs);
-    }
+    if (trace_path && !trace_open(trace_path))
+        fprintf(stderr, "sleepyshell: %s: %s\n", trace_path, strerror(errno));
 
-    return 0;
-}
\ No newline at end of file
+    jobs_init(interactive);
+    const int status = run_lines(&reader, interactive);
+    line_reader_close(&reader);
+    return status;
+}
@@ -0,0 +1,398 @@
+#define _POSIX_C_SOURCE 200809L
+#define MEMSTATS_IMPLEMENTATION
+#include "memstats.h"
+
+#include <dirent.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#ifdef SLEEPYSHELL_MEMSTATS
+
+/**
+ * A block handed out by one of the wrappers, remembered until it is freed so its bytes go
+ * back to the site that allocated it.
+ */
+typedef struct {
+    void *ptr;
+    size_t size;
+    const char *tag;
+} LiveBlock;
+
+/**
+ * Both tables use open addressing with linear probing and stay at most half full.
+ *
+ * @lock            Guards everything; the completion thread allocates too.
+ * @sites           Counters per call site, keyed by the address of the tag literal.
+ * @blocks          Live blocks, keyed by address.
+ * @totals          Counters for the whole shell.
+ * @atfork_set      The fork handlers are installed.
+ */
+static struct {
+    pthread_mutex_t lock;
+    MemStats *sites;
+    size_t site_capacity;
+    size_t site_count;
+    LiveBlock *blocks;
+    size_t block_capacity;
+    size_t block_count;
+    MemStats totals;
+    bool atfork_set;
+} stats = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+static size_t hash_pointer(const void *p) {
+    return (size_t)(((uint64_t)(uintptr_t)p * 0x9e3779b97f4a7c15ull) >> 32);
+}
+
+// A child forked while another thread held the lock would otherwise never get it
+static void lock_for_fork(void) { pthread_mutex_lock(&stats.lock); }
+static void unlock_after_fork(void) { pthread_mutex_unlock(&stats.lock); }
+
+static MemStats *find_site(const char *tag) {
+    if (2 * (stats.site_count + 1) > stats.site_capacity) {
+        const size_t capacity = stats.site_capacity ? stats.site_capacity * 2 : 256;
+        MemStats *sites = calloc(capacity, sizeof *sites);
+        if (!sites)
+            return NULL;
+        for (size_t i = 0; i < stats.site_capacity; i++) {
+            if (!stats.sites[i].tag)
+                continue;
+            size_t j = hash_pointer(stats.sites[i].tag) & (capacity - 1);
+            while (sites[j].tag)
+                j = (j + 1) & (capacity - 1);
+            sites[j] = stats.sites[i];
+        }
+        free(stats.sites);
+        stats.sites = sites;
+        stats.site_capacity = capacity;
+    }
+
+    const size_t mask = stats.site_capacity - 1;
+    size_t i = hash_pointer(tag) & mask;
+    while (stats.sites[i].tag && stats.sites[i].tag != tag)
+        i = (i + 1) & mask;
+    if (!stats.sites[i].tag) {
+        stats.sites[i].tag = tag;
+        stats.site_count++;
+    }
+    return &stats.sites[i];
+}
+
+static void count_alloc(MemStats *s, const size_t size) {
+    s->allocs++;
+    s->bytes += size;
+    s->live_count++;
+    s->live_bytes += size;
+    if (s->live_bytes > s->peak_bytes)
+        s->peak_bytes = s->live_bytes;
+}
+
+static void count_free(MemStats *s, const size_t size) {
+    s->frees++;
+    s->live_count--;
+    s->live_bytes -= size;
+}
+
+static bool grow_blocks(void) {
+    const size_t capacity = stats.block_capacity ? stats.block_capacity * 2 : 4096;
+    LiveBlock *blocks = calloc(capacity, sizeof *blocks);
+    if (!blocks)
+        return false;
+    for (size_t i = 0; i < stats.block_capacity; i++) {
+        if (!stats.blocks[i].ptr)
+            continue;
+        size_t j = hash_pointer(stats.blocks[i].ptr) & (capacity - 1);
+        while (blocks[j].ptr)
+            j = (j + 1) & (capacity - 1);
+        blocks[j] = stats.blocks[i];
+    }
+    free(stats.blocks);
+    stats.blocks = blocks;
+    stats.block_capacity = capacity;
+    return true;
+}
+
+/**
+ * Removes @ptr from the live blocks and credits its site.
+ *
+ * Deletion shifts later entries of the probe run back into the hole, so lookups never need
+ * tombstones. Blocks the wrappers never saw (getline()'s buffer, say) are not found and
+ * simply not counted.
+ *
+ * @return  The entry that was removed; its ptr is NULL if @ptr was not listed.
+ */
+static LiveBlock forget_block(void *ptr) {
+    if (stats.block_count == 0)
+        return (LiveBlock){0};
+
+    const size_t mask = stats.block_capacity - 1;
+    size_t i = hash_pointer(ptr) & mask;
+    while (stats.blocks[i].ptr && stats.blocks[i].ptr != ptr)
+        i = (i + 1) & mask;
+    if (!stats.blocks[i].ptr)
+        return (LiveBlock){0};
+
+    const LiveBlock block = stats.blocks[i];
+    size_t hole = i;
+    for (size_t j = (i + 1) & mask; stats.blocks[j].ptr; j = (j + 1) & mask) {
+        // An entry may fill the hole if the hole lies between its home slot and j
+        const size_t home = hash_pointer(stats.blocks[j].ptr) & mask;
+        if (((j - home) & mask) >= ((j - hole) & mask)) {
+            stats.blocks[hole] = stats.blocks[j];
+            hole = j;
+        }
+    }
+    stats.blocks[hole].ptr = NULL;
+    stats.block_count--;
+
+    MemStats *site = find_site(block.tag);
+    if (site)
+        count_free(site, block.size);
+    count_free(&stats.totals, block.size);
+    return block;
+}
+
+static void remember_block(void *ptr, const size_t size, const char *tag) {
+    if (!stats.atfork_set) {
+        pthread_atfork(lock_for_fork, unlock_after_fork, unlock_after_fork);
+        stats.atfork_set = true;
+    }
+
+    // An address already listed was freed or moved behind the wrappers' backs (by libc)
+    forget_block(ptr);
+
+    MemStats *site = find_site(tag);
+    if (!site || (2 * (stats.block_count + 1) > stats.block_capacity && !grow_blocks()))
+        return;
+
+    const size_t mask = stats.block_capacity - 1;
+    size_t i = hash_pointer(ptr) & mask;
+    while (stats.blocks[i].ptr)
+        i = (i + 1) & mask;
+    stats.blocks[i] = (LiveBlock){.ptr = ptr, .size = size, .tag = tag};
+    stats.block_count++;
+
+    count_alloc(site, size);
+    count_alloc(&stats.totals, size);
+}
+
+bool memstats_enabled(void) { return true; }
+
+void *memstats_malloc(const size_t size, const char *tag) {
+    void *ptr = malloc(size);
+    if (ptr) {
+        pthread_mutex_lock(&stats.lock);
+        remember_block(ptr, size, tag);
+        pthread_mutex_unlock(&stats.lock);
+    }
+    return ptr;
+}
+
+void *memstats_calloc(const size_t count, const size_t size, const char *tag) {
+    void *ptr = calloc(count, size);
+    if (ptr) {
+        pthread_mutex_lock(&stats.lock);
+        remember_block(ptr, count * size, tag);
+        pthread_mutex_unlock(&stats.lock);
+    }
+    return ptr;
+}
+
+void *memstats_realloc(void *ptr, const size_t size, const char *tag) {
+    // Held across the call: once the old block is released, another thread may be given it.
+    // The old block is forgotten first, as afterwards its address may not be used at all.
+    pthread_mutex_lock(&stats.lock);
+    const LiveBlock old = ptr ? forget_block(ptr) : (LiveBlock){0};
+    void *moved = realloc(ptr, size);
+    if (moved)
+        remember_block(moved, size, tag);
+    else if (size != 0 && old.ptr)
+        remember_block(old.ptr, old.size, old.tag); // Failed: @ptr is still allocated
+    pthread_mutex_unlock(&stats.lock);
+    return moved;
+}
+
+char *memstats_strdup(const char *s, const char *tag) {
+    const size_t len = strlen(s);
+    char *copy = memstats_malloc(len + 1, tag);
+    if (copy)
+        memcpy(copy, s, len + 1);
+    return copy;
+}
+
+char *memstats_strndup(const char *s, const size_t n, const char *tag) {
+    const size_t len = strnlen(s, n);
+    char *copy = memstats_malloc(len + 1, tag);
+    if (copy) {
+        memcpy(copy, s, len);
+        copy[len] = '\0';
+    }
+    return copy;
+}
+
+void memstats_free(void *ptr) {
+    if (!ptr)
+        return;
+    // Forgotten before it is freed, so no other thread can be handed the address first
+    pthread_mutex_lock(&stats.lock);
+    forget_block(ptr);
+    pthread_mutex_unlock(&stats.lock);
+    free(ptr);
+}
+
+MemStats memstats_totals(void) {
+    pthread_mutex_lock(&stats.lock);
+    const MemStats totals = stats.totals;
+    pthread_mutex_unlock(&stats.lock);
+    return totals;
+}
+
+static int by_live_bytes(const void *a, const void *b) {
+    const MemStats *x = a, *y = b;
+    if (x->live_bytes != y->live_bytes)
+        return x->live_bytes < y->live_bytes ? 1 : -1;
+    if (x->bytes != y->bytes)
+        return x->bytes < y->bytes ? 1 : -1;
+    return strcmp(x->tag, y->tag);
+}
+
+/**
+ * Copies the per-site counters into @arena, most live bytes first.
+ *
+ * @return  Number of sites in @sites_out.
+ */
+size_t memstats_snapshot(Arena *arena, MemStats **sites_out) {
+    // Allocating may itself be counted, so not under the lock
+    pthread_mutex_lock(&stats.lock);
+    const size_t count = stats.site_count;
+    pthread_mutex_unlock(&stats.lock);
+    MemStats *sites = arena_alloc(arena, (count + 16) * sizeof *sites);
+    if (!sites)
+        return 0;
+
+    size_t n = 0;
+    pthread_mutex_lock(&stats.lock);
+    for (size_t i = 0; i < stats.site_capacity && n < count + 16; i++) {
+        if (stats.sites[i].tag)
+            sites[n++] = stats.sites[i];
+    }
+    pthread_mutex_unlock(&stats.lock);
+
+    qsort(sites, n, sizeof *sites, by_live_bytes);
+    *sites_out = sites;
+    return n;
+}
+
+/**
+ * Starts the allocation, byte and peak counters over; what is live stays live.
+ */
+void memstats_reset(void) {
+    pthread_mutex_lock(&stats.lock);
+    for (size_t i = 0; i < stats.site_capacity; i++) {
+        MemStats *s = &stats.sites[i];
+        s->allocs = s->frees = 0;
+        s->bytes = 0;
+        s->peak_bytes = s->live_bytes;
+    }
+    stats.totals.allocs = stats.totals.frees = 0;
+    stats.totals.bytes = 0;
+    stats.totals.peak_bytes = stats.totals.live_bytes;
+    pthread_mutex_unlock(&stats.lock);
+}
+
+#else
+
+bool memstats_enabled(void) { return false; }
+
+void *memstats_malloc(const size_t size, const char *tag) {
+    (void)tag;
+    return malloc(size);
+}
+
+void *memstats_calloc(const size_t count, const size_t size, const char *tag) {
+    (void)tag;
+    return calloc(count, size);
+}
+
+void *memstats_realloc(void *ptr, const size_t size, const char *tag) {
+    (void)tag;
+    return realloc(ptr, size);
+}
+
+char *memstats_strdup(const char *s, const char *tag) {
+    (void)tag;
+    return strdup(s);
+}
+
+char *memstats_strndup(const char *s, const size_t n, const char *tag) {
+    (void)tag;
+    return strndup(s, n);
+}
+
+void memstats_free(void *ptr) { free(ptr); }
+
+MemStats memstats_totals(void) { return (MemStats){0}; }
+
+size_t memstats_snapshot(Arena *arena, MemStats **sites_out) {
+    (void)arena;
+    *sites_out = NULL;
+    return 0;
+}
+
+void memstats_reset(void) {}
+
+#endif
+
+/**
+ * @return  Resident set size of the shell in kB, 0 if it cannot be read.
+ */
+size_t memstats_rss_kb(void) {
+    FILE *statm = fopen("/proc/self/statm", "re");
+    if (!statm)
+        return 0;
+    unsigned long size, resident;
+    const bool ok = fscanf(statm, "%lu %lu", &size, &resident) == 2;
+    fclose(statm);
+    return ok ? resident * (size_t)sysconf(_SC_PAGESIZE) / 1024 : 0;
+}
+
+size_t memstats_peak_rss_kb(void) {
+    struct rusage usage;
+    return getrusage(RUSAGE_SELF, &usage) == 0 ? (size_t)usage.ru_maxrss : 0;
+}
+
+/**
+ * Calls @visit (if not NULL) for each descriptor the shell has open, in ascending order, with
+ * what it refers to.
+ *
+ * @return  Number of open descriptors, or -1 if /proc/self/fd cannot be read.
+ */
+int memstats_foreach_open_fd(const OpenFdVisitor visit, void *ctx) {
+    DIR *dir = opendir("/proc/self/fd");
+    if (!dir)
+        return -1;
+
+    int count = 0;
+    const struct dirent *entry;
+    while ((entry = readdir(dir))) {
+        if (entry->d_name[0] == '.')
+            continue;
+        const int fd = atoi(entry->d_name);
+        if (fd == dirfd(dir))
+            continue;
+        count++;
+        if (!visit)
+            continue;
+
+        char path[32], target[PATH_MAX];
+        snprintf(path, sizeof(path), "/proc/self/fd/%d", fd);
+        const ssize_t n = readlink(path, target, sizeof(target) - 1);
+        target[n < 0 ? 0 : n] = '\0';
+        visit(fd, target, ctx);
+    }
+    closedir(dir);
+    return count;
+}
@@ -0,0 +1,72 @@
+#ifndef MEMSTATS_H
+#define MEMSTATS_H
+#include "arena.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Heap accounting for a call site (or, for the totals, the whole shell). Filled in only
+ * when the shell is built with -DSLEEPYSHELL_MEMSTATS=ON.
+ *
+ * @tag         "file.c:line" of the allocating call; NULL for the totals.
+ * @allocs      malloc/calloc/realloc/strdup/strndup calls that returned memory.
+ * @frees       Blocks from this site given back with free() or moved by realloc().
+ * @bytes       Bytes requested in total.
+ * @live_count  Blocks from this site still allocated.
+ * @live_bytes  Bytes in those blocks.
+ * @peak_bytes  Highest @live_bytes seen since the last reset.
+ */
+typedef struct {
+    const char *tag;
+    unsigned long allocs;
+    unsigned long frees;
+    size_t bytes;
+    size_t live_count;
+    size_t live_bytes;
+    size_t peak_bytes;
+} MemStats;
+
+typedef void (*OpenFdVisitor)(int fd, const char *target, void *ctx);
+
+bool memstats_enabled(void);
+MemStats memstats_totals(void);
+size_t memstats_snapshot(Arena *arena, MemStats **sites_out);
+void memstats_reset(void);
+size_t memstats_rss_kb(void);
+size_t memstats_peak_rss_kb(void);
+int memstats_foreach_open_fd(OpenFdVisitor visit, void *ctx);
+
+void *memstats_malloc(size_t size, const char *tag);
+void *memstats_calloc(size_t count, size_t size, const char *tag);
+void *memstats_realloc(void *ptr, size_t size, const char *tag);
+char *memstats_strdup(const char *s, const char *tag);
+char *memstats_strndup(const char *s, size_t n, const char *tag);
+void memstats_free(void *ptr);
+
+/*
+ * In a SLEEPYSHELL_MEMSTATS build, every file that includes this header (last, after the
+ * system headers) has its heap calls counted under the call site's "file:line".
+ */
+#if defined(SLEEPYSHELL_MEMSTATS) && !defined(MEMSTATS_IMPLEMENTATION)
+#define MEMSTATS_STRINGIFY_(x) #x
+#define MEMSTATS_STRINGIFY(x) MEMSTATS_STRINGIFY_(x)
+#define MEMSTATS_TAG __FILE__ ":" MEMSTATS_STRINGIFY(__LINE__)
+
+#undef malloc
+#undef calloc
+#undef realloc
+#undef strdup
+#undef strndup
+#undef free
+#define malloc(size) memstats_malloc((size), MEMSTATS_TAG)
+#define calloc(count, size) memstats_calloc((count), (size), MEMSTATS_TAG)
+#define realloc(ptr, size) memstats_realloc((ptr), (size), MEMSTATS_TAG)
+#define strdup(s) memstats_strdup((s), MEMSTATS_TAG)
+#define strndup(s, n) memstats_strndup((s), (n), MEMSTATS_TAG)
+#define free(ptr) memstats_free(ptr)
+#endif
+
+#endif // MEMSTATS_H
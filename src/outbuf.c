@@ -0,0 +1,214 @@
+#define _POSIX_C_SOURCE 200809L
+#include "outbuf.h"
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "memstats.h"
+
+void outbuf_init(OutBuf *out, const int fd) {
+    out->fd = fd;
+    out->capture = NULL;
+    out->iov_count = 0;
+    out->storage_used = 0;
+    out->error = 0;
+}
+
+/**
+ * Sets up @out to collect its output in @capture instead of writing it anywhere.
+ */
+void outbuf_init_capture(OutBuf *out, OutCapture *capture) {
+    outbuf_init(out, -1);
+    out->capture = capture;
+}
+
+/**
+ * Makes room for @extra more bytes, doubling so repeated appends stay linear.
+ */
+bool outcapture_reserve(OutCapture *capture, const size_t extra) {
+    if (capture->cap - capture->len >= extra)
+        return true;
+
+    size_t cap = capture->cap ? capture->cap * 2 : 4096;
+    while (cap - capture->len < extra)
+        cap *= 2;
+
+    char *data = realloc(capture->data, cap);
+    if (!data)
+        return false;
+    capture->data = data;
+    capture->cap = cap;
+    return true;
+}
+
+bool outcapture_append(OutCapture *capture, const char *s, const size_t n) {
+    if (!outcapture_reserve(capture, n))
+        return false;
+    memcpy(capture->data + capture->len, s, n);
+    capture->len += n;
+    return true;
+}
+
+/**
+ * Writes all of @buf, retrying on partial writes and EINTR.
+ */
+bool write_all(const int fd, const void *buf, size_t len) {
+    const char *p = buf;
+    while (len > 0) {
+        const ssize_t n = write(fd, p, len);
+        if (n == -1) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+/**
+ * Writes every pending segment, usually in one writev() call. Partial writes resume
+ * from the first unwritten byte.
+ *
+ * @return  false if a write failed; the error is kept in out->error.
+ */
+bool outbuf_flush(OutBuf *out) {
+    for (int i = 0; out->capture && i < out->iov_count && out->error == 0; i++) {
+        if (!outcapture_append(out->capture, out->iov[i].iov_base, out->iov[i].iov_len))
+            out->error = ENOMEM;
+    }
+
+    int index = out->capture ? out->iov_count : 0;
+    while (index < out->iov_count && out->error == 0) {
+        const ssize_t n = writev(out->fd, out->iov + index, out->iov_count - index);
+        if (n == -1) {
+            if (errno != EINTR)
+                out->error = errno;
+            continue;
+        }
+
+        size_t written = n;
+        while (index < out->iov_count && written >= out->iov[index].iov_len) {
+            written -= out->iov[index].iov_len;
+            index++;
+        }
+        if (written > 0) {
+            out->iov[index].iov_base = (char *)out->iov[index].iov_base + written;
+            out->iov[index].iov_len -= written;
+        }
+    }
+
+    out->iov_count = 0;
+    out->storage_used = 0;
+    return out->error == 0;
+}
+
+/**
+ * Queues @n bytes at @s without copying. @s must stay valid until the next flush.
+ */
+bool outbuf_write_ref(OutBuf *out, const char *s, const size_t n) {
+    if (n == 0)
+        return out->error == 0;
+
+    if (out->iov_count == OUTBUF_MAX_IOV && !outbuf_flush(out))
+        return false;
+
+    out->iov[out->iov_count++] = (struct iovec){.iov_base = (void *)s, .iov_len = n};
+    return out->error == 0;
+}
+
+bool outbuf_puts_ref(OutBuf *out, const char *s) { return outbuf_write_ref(out, s, strlen(s)); }
+
+/**
+ * Appends the storage range [start, start + n) as a segment, extending the previous
+ * segment when it ends exactly where this one starts.
+ */
+static bool queue_storage(OutBuf *out, const size_t start, const size_t n) {
+    char *p = out->storage + start;
+    if (out->iov_count > 0) {
+        struct iovec *last = &out->iov[out->iov_count - 1];
+        if ((char *)last->iov_base + last->iov_len == p) {
+            last->iov_len += n;
+            out->storage_used = start + n;
+            return true;
+        }
+    }
+
+    out->storage_used = start + n;
+    return outbuf_write_ref(out, p, n);
+}
+
+/**
+ * Queues a copy of @n bytes at @s. Chunks too large for the storage are written straight
+ * through after the pending output.
+ */
+bool outbuf_write(OutBuf *out, const char *s, const size_t n) {
+    if (n > OUTBUF_STORAGE_SIZE) {
+        if (!outbuf_flush(out))
+            return false;
+        if (out->capture) {
+            if (!outcapture_append(out->capture, s, n))
+                out->error = ENOMEM;
+            return out->error == 0;
+        }
+        if (!write_all(out->fd, s, n)) {
+            out->error = errno;
+            return false;
+        }
+        return true;
+    }
+
+    if (OUTBUF_STORAGE_SIZE - out->storage_used < n || out->iov_count == OUTBUF_MAX_IOV) {
+        if (!outbuf_flush(out))
+            return false;
+    }
+
+    const size_t start = out->storage_used;
+    memcpy(out->storage + start, s, n);
+    return queue_storage(out, start, n);
+}
+
+bool outbuf_printf(OutBuf *out, const char *fmt, ...) {
+    va_list args;
+
+    for (int attempt = 0; attempt < 2; attempt++) {
+        const size_t room = OUTBUF_STORAGE_SIZE - out->storage_used;
+        va_start(args, fmt);
+        const int len = vsnprintf(out->storage + out->storage_used, room, fmt, args);
+        va_end(args);
+
+        if (len < 0) {
+            out->error = EINVAL;
+            return false;
+        }
+
+        if ((size_t)len < room && out->iov_count < OUTBUF_MAX_IOV)
+            return queue_storage(out, out->storage_used, len);
+
+        // Did not fit: make room, or fall back to a temporary for huge output
+        if (attempt == 0 && (size_t)len < OUTBUF_STORAGE_SIZE) {
+            if (!outbuf_flush(out))
+                return false;
+            continue;
+        }
+
+        char *tmp = malloc((size_t)len + 1);
+        if (!tmp) {
+            out->error = ENOMEM;
+            return false;
+        }
+        va_start(args, fmt);
+        vsnprintf(tmp, (size_t)len + 1, fmt, args);
+        va_end(args);
+        const bool ok = outbuf_write(out, tmp, len);
+        free(tmp);
+        return ok;
+    }
+
+    return false;
+}
@@ -0,0 +1,54 @@
+#ifndef OUTBUF_H
+#define OUTBUF_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/uio.h>
+
+#define OUTBUF_MAX_IOV 64
+#define OUTBUF_STORAGE_SIZE 4096
+
+/**
+ * Growable heap buffer that collects output in memory, e.g. for command substitution.
+ * The owner frees @data.
+ */
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+} OutCapture;
+
+/**
+ * Output buffer for builtins, flushed with a single writev() per command.
+ *
+ * Bytes are either referenced in place (outbuf_write_ref, for strings that outlive the
+ * flush such as argv) or copied into the inline storage (outbuf_write, outbuf_printf).
+ * The buffer flushes itself early only when the iovec array or the storage fills up.
+ *
+ * @fd            Destination; the builtin's (possibly redirected) output fd.
+ * @capture       When set, flushing appends to it instead of writing to @fd.
+ * @iov           Pending segments, in output order.
+ * @storage_used  Bytes of storage referenced by pending segments.
+ * @error         errno of the first failed write, 0 if none.
+ */
+typedef struct {
+    int fd;
+    OutCapture *capture;
+    struct iovec iov[OUTBUF_MAX_IOV];
+    int iov_count;
+    char storage[OUTBUF_STORAGE_SIZE];
+    size_t storage_used;
+    int error;
+} OutBuf;
+
+void outbuf_init(OutBuf *out, int fd);
+void outbuf_init_capture(OutBuf *out, OutCapture *capture);
+bool outbuf_write_ref(OutBuf *out, const char *s, size_t n);
+bool outbuf_puts_ref(OutBuf *out, const char *s);
+bool outbuf_write(OutBuf *out, const char *s, size_t n);
+bool outbuf_printf(OutBuf *out, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+bool outbuf_flush(OutBuf *out);
+bool write_all(int fd, const void *buf, size_t len);
+bool outcapture_reserve(OutCapture *capture, size_t extra);
+bool outcapture_append(OutCapture *capture, const char *s, size_t n);
+
+#endif // OUTBUF_H
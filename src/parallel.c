@@ -0,0 +1,430 @@
+#define _GNU_SOURCE // pipe2(), _SC_NPROCESSORS_ONLN
+#include "parallel.h"
+#include "exec.h"
+#include "path_utils.h"
+#include "vars.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "memstats.h"
+
+#define PARALLEL_SEPARATOR ":::"
+#define PARALLEL_PLACEHOLDER "{}"
+#define PARALLEL_READ_CHUNK 65536
+// GNU parallel's convention: the exit status counts failed jobs, 101 means "more than 100"
+#define PARALLEL_MAX_FAILED_STATUS 101
+
+/**
+ * A worker slot and the job running in it.
+ *
+ * @pid         The job's process.
+ * @fd          Read end of the pipe collecting the job's stdout and stderr, -1 if idle.
+ * @output      Everything the job wrote so far; kept between jobs and reused.
+ * @len         Bytes in output.
+ * @cap         Bytes allocated for output.
+ * @started_ns  When the job was started, for its latency.
+ */
+typedef struct {
+    pid_t pid;
+    int fd;
+    char *output;
+    size_t len;
+    size_t cap;
+    uint64_t started_ns;
+} ParallelSlot;
+
+/**
+ * @words        The command template; "{}" inside a word is replaced by the argument.
+ * @word_count   Number of entries in words.
+ * @placeholder  Some word contains "{}"; otherwise the argument is appended.
+ * @bin_path     words[0] resolved once for every job.
+ * @args         One job per argument.
+ * @arg_count    Number of entries in args.
+ */
+typedef struct {
+    char **words;
+    int word_count;
+    bool placeholder;
+    const char *bin_path;
+    char **args;
+    size_t arg_count;
+} ParallelPlan;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static char *substitute(Arena *arena, const char *word, const char *arg) {
+    const size_t arg_len = strlen(arg);
+    size_t len = 0;
+    for (const char *p = word; *p;) {
+        if (!strncmp(p, PARALLEL_PLACEHOLDER, 2)) {
+            len += arg_len;
+            p += 2;
+        } else {
+            len++;
+            p++;
+        }
+    }
+
+    char *result = arena_alloc(arena, len + 1);
+    if (!result)
+        return NULL;
+
+    char *out = result;
+    for (const char *p = word; *p;) {
+        if (!strncmp(p, PARALLEL_PLACEHOLDER, 2)) {
+            memcpy(out, arg, arg_len);
+            out += arg_len;
+            p += 2;
+        } else {
+            *out++ = *p++;
+        }
+    }
+    *out = '\0';
+    return result;
+}
+
+static char **build_argv(Arena *arena, const ParallelPlan *plan, char *arg) {
+    const int argc = plan->word_count + (plan->placeholder ? 0 : 1);
+    char **argv = arena_alloc(arena, (argc + 1) * sizeof *argv);
+    if (!argv)
+        return NULL;
+
+    for (int i = 0; i < plan->word_count; i++) {
+        argv[i] = strstr(plan->words[i], PARALLEL_PLACEHOLDER)
+                      ? substitute(arena, plan->words[i], arg)
+                      : plan->words[i];
+        if (!argv[i])
+            return NULL;
+    }
+    if (!plan->placeholder)
+        argv[plan->word_count] = arg;
+    argv[argc] = NULL;
+    return argv;
+}
+
+/**
+ * Reads one argument per line from @fd until EOF. The text and the array live in @arena.
+ */
+static bool read_args(Arena *arena, const int fd, ParallelPlan *plan) {
+    size_t len = 0;
+    size_t cap = PARALLEL_READ_CHUNK;
+    char *text = arena_alloc(arena, cap);
+    if (!text)
+        return false;
+
+    while (1) {
+        if (cap - len < PARALLEL_READ_CHUNK) {
+            char *grown = arena_grow(arena, text, len, cap * 2);
+            if (!grown)
+                return false;
+            text = grown;
+            cap *= 2;
+        }
+
+        const ssize_t n = read(fd, text + len, cap - len - 1);
+        if (n == 0)
+            break;
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        len += n;
+    }
+    text[len] = '\0';
+
+    size_t lines = 0;
+    for (size_t i = 0; i < len; i++)
+        lines += text[i] == '\n';
+
+    plan->args = arena_alloc(arena, (lines + 1) * sizeof *plan->args);
+    if (!plan->args)
+        return false;
+
+    plan->arg_count = 0;
+    for (char *line = text; line < text + len;) {
+        char *end = memchr(line, '\n', text + len - line);
+        if (!end)
+            end = text + len;
+        *end = '\0';
+        if (end > line)
+            plan->args[plan->arg_count++] = line;
+        line = end + 1;
+    }
+    return true;
+}
+
+static bool launch_job(Arena *arena, ParallelSlot *slot, const ParallelPlan *plan, char *arg,
+                       const int null_fd, BuiltinIO *io) {
+    // Both output streams go into one pipe so a job's lines stay in order
+    static const RedirSpec merge_stderr = {
+        .kind = REDIR_DUP, .target_fd = STDERR_FILENO, .source_fd = STDOUT_FILENO};
+
+    char **argv = build_argv(arena, plan, arg);
+    if (!argv) {
+        dprintf(io->err_fd, "parallel: out of memory\n");
+        return false;
+    }
+
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) == -1) {
+        dprintf(io->err_fd, "parallel: pipe2: %s\n", strerror(errno));
+        return false;
+    }
+
+    const int err = exec_launch(EXEC_LAUNCH_SPAWN, plan->bin_path, argv, vars_envp(),
+                                &merge_stderr, 1, null_fd, fds[1], -1, -1, &slot->pid);
+    close(fds[1]);
+    if (err != 0) {
+        close(fds[0]);
+        dprintf(io->err_fd, "parallel: %s: %s\n", plan->words[0], strerror(err));
+        return false;
+    }
+
+    slot->fd = fds[0];
+    slot->len = 0;
+    slot->started_ns = now_ns();
+    return true;
+}
+
+/**
+ * Reads what the job in @slot has written.
+ *
+ * @return  false once the job has closed its end of the pipe.
+ */
+static bool collect_output(ParallelSlot *slot) {
+    if (slot->cap - slot->len < PARALLEL_READ_CHUNK) {
+        const size_t cap = slot->cap ? slot->cap * 2 : PARALLEL_READ_CHUNK;
+        char *grown = realloc(slot->output, cap);
+        if (!grown)
+            return false;
+        slot->output = grown;
+        slot->cap = cap;
+    }
+
+    const ssize_t n = read(slot->fd, slot->output + slot->len, slot->cap - slot->len);
+    if (n > 0) {
+        slot->len += n;
+        return true;
+    }
+    return n < 0 && errno == EINTR;
+}
+
+/**
+ * Reaps the finished job in @slot and writes its output as one block.
+ *
+ * @return  The job's exit status.
+ */
+static int finish_job(ParallelSlot *slot, BuiltinIO *io) {
+    close(slot->fd);
+    slot->fd = -1;
+
+    const int status = exec_wait(slot->pid);
+    if (slot->len > 0) {
+        outbuf_write_ref(io->out, slot->output, slot->len);
+        outbuf_flush(io->out);
+    }
+    return status;
+}
+
+static int compare_u64(const void *a, const void *b) {
+    const uint64_t x = *(const uint64_t *)a;
+    const uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void print_summary(BuiltinIO *io, uint64_t latencies[], const size_t done,
+                          const size_t failed, const int workers, const uint64_t wall_ns) {
+    const double wall_s = wall_ns / 1e9;
+    dprintf(io->err_fd, "parallel: %zu jobs (%zu failed) on %d workers in %.3f s, %.1f jobs/s\n",
+            done, failed, workers, wall_s, wall_s > 0 ? done / wall_s : 0.0);
+    if (done == 0)
+        return;
+
+    qsort(latencies, done, sizeof *latencies, compare_u64);
+    uint64_t total = 0;
+    for (size_t i = 0; i < done; i++)
+        total += latencies[i];
+
+    dprintf(io->err_fd,
+            "parallel: latency ms min %.2f avg %.2f p50 %.2f p95 %.2f max %.2f\n",
+            latencies[0] / 1e6, total / 1e6 / done, latencies[done / 2] / 1e6,
+            latencies[done * 95 / 100] / 1e6, latencies[done - 1] / 1e6);
+}
+
+/**
+ * Runs every job of @plan with at most @workers in flight. A new job starts as soon as any
+ * running one exits; the shell sleeps in poll() on the jobs' output pipes meanwhile.
+ *
+ * @return  The number of failed jobs (capped), or 130 if a job was interrupted by Ctrl-C,
+ *          after which no new jobs are started.
+ */
+static int run_jobs(Arena *arena, const ParallelPlan *plan, const int workers, BuiltinIO *io) {
+    ParallelSlot *slots = calloc(workers, sizeof *slots);
+    struct pollfd *pfds = calloc(workers, sizeof *pfds);
+    int *pfd_slots = calloc(workers, sizeof *pfd_slots);
+    uint64_t *latencies = malloc((plan->arg_count ? plan->arg_count : 1) * sizeof *latencies);
+    const int null_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    if (!slots || !pfds || !pfd_slots || !latencies || null_fd == -1) {
+        dprintf(io->err_fd, "parallel: %s\n", strerror(errno));
+        free(slots);
+        free(pfds);
+        free(pfd_slots);
+        free(latencies);
+        if (null_fd != -1)
+            close(null_fd);
+        return 1;
+    }
+
+    for (int i = 0; i < workers; i++)
+        slots[i].fd = -1;
+
+    const uint64_t start_ns = now_ns();
+    size_t next = 0;
+    size_t done = 0;
+    size_t failed = 0;
+    int active = 0;
+    bool interrupted = false;
+
+    while (1) {
+        for (int i = 0; i < workers && next < plan->arg_count && !interrupted; i++) {
+            if (slots[i].fd != -1)
+                continue;
+            if (launch_job(arena, &slots[i], plan, plan->args[next], null_fd, io))
+                active++;
+            else
+                failed++;
+            next++;
+        }
+
+        if (active == 0)
+            break;
+
+        int nfds = 0;
+        for (int i = 0; i < workers; i++) {
+            if (slots[i].fd == -1)
+                continue;
+            pfds[nfds] = (struct pollfd){.fd = slots[i].fd, .events = POLLIN};
+            pfd_slots[nfds++] = i;
+        }
+
+        if (poll(pfds, nfds, -1) == -1) {
+            if (errno == EINTR)
+                continue;
+            dprintf(io->err_fd, "parallel: poll: %s\n", strerror(errno));
+            interrupted = true;
+            continue;
+        }
+
+        for (int k = 0; k < nfds; k++) {
+            if (!pfds[k].revents)
+                continue;
+
+            ParallelSlot *slot = &slots[pfd_slots[k]];
+            if (collect_output(slot))
+                continue;
+
+            const int status = finish_job(slot, io);
+            latencies[done++] = now_ns() - slot->started_ns;
+            active--;
+            if (status != 0)
+                failed++;
+            if (status == 128 + SIGINT)
+                interrupted = true;
+        }
+    }
+
+    print_summary(io, latencies, done, failed, workers, now_ns() - start_ns);
+
+    for (int i = 0; i < workers; i++)
+        free(slots[i].output);
+    free(slots);
+    free(pfds);
+    free(pfd_slots);
+    free(latencies);
+    close(null_fd);
+
+    if (interrupted)
+        return 128 + SIGINT;
+    return failed > PARALLEL_MAX_FAILED_STATUS ? PARALLEL_MAX_FAILED_STATUS : (int)failed;
+}
+
+/**
+ * parallel [-j N] command [word...] [::: arg...]
+ *
+ * Runs command once per argument, taken after ":::" or one per line from stdin. "{}" in the
+ * words is replaced by the argument; without "{}" the argument is appended. Up to N jobs
+ * (default: online CPUs) run at once. Each job's stdout and stderr are collected and written
+ * as one block when it exits, so lines of different jobs never interleave. A throughput and
+ * latency summary goes to stderr at the end.
+ */
+int parallel_run(const int argc, char *argv[], BuiltinIO *io) {
+    long workers = sysconf(_SC_NPROCESSORS_ONLN);
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-'; i++) {
+        if (!strcmp(argv[i], "--")) {
+            i++;
+            break;
+        }
+
+        const char *value = NULL;
+        if (!strcmp(argv[i], "-j") && i + 1 < argc)
+            value = argv[++i];
+        else if (!strncmp(argv[i], "-j", 2) && argv[i][2] != '\0')
+            value = argv[i] + 2;
+
+        char *end;
+        if (!value || (workers = strtol(value, &end, 10)) <= 0 || *end != '\0') {
+            dprintf(io->err_fd, "parallel: usage: parallel [-j N] command [word...] "
+                                "[::: arg...]\n");
+            return 2;
+        }
+    }
+
+    ParallelPlan plan = {.words = &argv[i]};
+    while (i < argc && strcmp(argv[i], PARALLEL_SEPARATOR) != 0) {
+        if (strstr(argv[i], PARALLEL_PLACEHOLDER))
+            plan.placeholder = true;
+        plan.word_count++;
+        i++;
+    }
+
+    if (plan.word_count == 0) {
+        dprintf(io->err_fd, "parallel: missing command\n");
+        return 2;
+    }
+
+    if (i < argc) {
+        plan.args = &argv[i + 1];
+        plan.arg_count = argc - i - 1;
+    } else if (!read_args(io->arena, io->in_fd, &plan)) {
+        dprintf(io->err_fd, "parallel: reading arguments: %s\n", strerror(errno));
+        return 1;
+    }
+
+    plan.bin_path = util_find_bin_in_path(io->arena, plan.words[0]);
+    if (!plan.bin_path) {
+        dprintf(io->err_fd, "parallel: %s: command not found\n", plan.words[0]);
+        return 127;
+    }
+
+    if (workers < 1)
+        workers = 1;
+    if ((size_t)workers > plan.arg_count && plan.arg_count > 0)
+        workers = (long)plan.arg_count;
+
+    return run_jobs(io->arena, &plan, (int)workers, io);
+}
@@ -0,0 +1,7 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+#include "builtins.h"
+
+int parallel_run(int argc, char *argv[], BuiltinIO *io);
+
+#endif // PARALLEL_H
@@ -1,59 +1,504 @@
 #define _POSIX_C_SOURCE 200809L
+#include "path_utils.h"
+#include "vars.h"
+
+#include <dirent.h>
+#include <limits.h>
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <time.h>
 #include <unistd.h>
 
+#include "memstats.h"
+
+#define PATH_CACHE_INITIAL_BUCKETS 64
+// PATH directories are re-stat'ed at most this often to notice installs/removals
+#define PATH_CACHE_RECHECK_NS 1000000000L
+
+typedef struct PathCacheEntry {
+    char *name;
+    char *full_path;
+    unsigned long hits;
+    uint32_t hash;
+    bool pinned; // Seeded with `hash -p`, survives directory mtime invalidation
+    struct PathCacheEntry *next;
+} PathCacheEntry;
+
+typedef struct {
+    char *dir;
+    bool exists;
+    struct timespec mtime;
+} PathDir;
+
 /**
- * Searches the PATH environment variable for the given executable name.
+ * The command-location cache.
  *
- * @param program_name  Name of the binary to search for (e.g., "ls", "grep").
- * @return              Malloc'd full path to the binary, or NULL if not found.
- *                      Caller is responsible for freeing the result.
+ * @buckets      Chained hash table keyed by program name.
+ * @path_value   Copy of $PATH the cache was built against, NULL if never built.
+ * @dirs         Non-empty PATH elements in search order, with their last seen mtime.
+ * @max_dir_len  Length of the longest entry in dirs, to size the candidate buffer.
+ * @last_check   Monotonic time of the last directory mtime check.
+ */
+static struct {
+    PathCacheEntry **buckets;
+    size_t bucket_count;
+    size_t entry_count;
+    char *path_value;
+    PathDir *dirs;
+    size_t dir_count;
+    size_t max_dir_len;
+    struct timespec last_check;
+    PathCacheStats stats;
+} cache;
+
+static uint32_t hash_name(const char *name) {
+    // FNV-1a
+    uint32_t h = 2166136261u;
+    for (const unsigned char *p = (const unsigned char *)name; *p; p++) {
+        h ^= *p;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static long elapsed_ns(const struct timespec *from, const struct timespec *to) {
+    return (to->tv_sec - from->tv_sec) * 1000000000L + (to->tv_nsec - from->tv_nsec);
+}
+
+static void stat_dir(PathDir *dir) {
+    struct stat st;
+    if (stat(dir->dir, &st) == 0) {
+        dir->exists = true;
+        dir->mtime = st.st_mtim;
+    } else {
+        dir->exists = false;
+        dir->mtime = (struct timespec){0};
+    }
+}
+
+static void free_entry(PathCacheEntry *entry) {
+    free(entry->name);
+    free(entry->full_path);
+    free(entry);
+}
+
+static void clear_entries(const bool keep_pinned) {
+    for (size_t i = 0; i < cache.bucket_count; i++) {
+        PathCacheEntry **link = &cache.buckets[i];
+        while (*link) {
+            PathCacheEntry *entry = *link;
+            if (keep_pinned && entry->pinned) {
+                link = &entry->next;
+                continue;
+            }
+            *link = entry->next;
+            free_entry(entry);
+            cache.entry_count--;
+        }
+    }
+}
+
+static void free_dirs(void) {
+    for (size_t i = 0; i < cache.dir_count; i++)
+        free(cache.dirs[i].dir);
+    free(cache.dirs);
+    cache.dirs = NULL;
+    cache.dir_count = 0;
+    cache.max_dir_len = 0;
+    free(cache.path_value);
+    cache.path_value = NULL;
+}
+
+/**
+ * Splits @path into cache.dirs and snapshots each directory's mtime.
+ * Empty PATH elements are skipped, matching the old strtok() based search.
+ */
+static bool load_dirs(const char *path) {
+    free_dirs();
+
+    cache.path_value = strdup(path);
+    if (!cache.path_value)
+        return false;
+
+    size_t max_dirs = 1;
+    for (const char *p = path; *p; p++) {
+        if (*p == ':')
+            max_dirs++;
+    }
+
+    cache.dirs = calloc(max_dirs, sizeof *cache.dirs);
+    if (!cache.dirs) {
+        free_dirs();
+        return false;
+    }
+
+    const char *start = path;
+    while (true) {
+        const char *end = strchr(start, ':');
+        const size_t len = end ? (size_t)(end - start) : strlen(start);
+
+        if (len > 0) {
+            char *dir = strndup(start, len);
+            if (!dir) {
+                free_dirs();
+                return false;
+            }
+            cache.dirs[cache.dir_count].dir = dir;
+            if (len > cache.max_dir_len)
+                cache.max_dir_len = len;
+            stat_dir(&cache.dirs[cache.dir_count]);
+            cache.dir_count++;
+        }
+
+        if (!end)
+            break;
+        start = end + 1;
+    }
+
+    return true;
+}
+
+/**
+ * Drops stale entries before a lookup.
+ *
+ * A different $PATH clears everything. Otherwise, at most once per PATH_CACHE_RECHECK_NS,
+ * every PATH directory is stat'ed and any mtime change (a binary was added, removed or
+ * renamed) clears all entries except the ones pinned with `hash -p`.
+ *
+ * @return false if there is no usable PATH.
  */
-char *util_find_bin_in_path(const char *program_name) {
-    const char *path = getenv("PATH");
-    if (path == NULL)
+static bool validate_cache(void) {
+    const char *path = vars_get("PATH");
+    if (path == NULL) {
+        clear_entries(false);
+        free_dirs();
+        return false;
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    if (cache.path_value == NULL || strcmp(cache.path_value, path) != 0) {
+        if (cache.path_value != NULL)
+            cache.stats.invalidations++;
+        clear_entries(false);
+        cache.last_check = now;
+        return load_dirs(path);
+    }
+
+    if (elapsed_ns(&cache.last_check, &now) < PATH_CACHE_RECHECK_NS)
+        return true;
+
+    cache.last_check = now;
+    bool changed = false;
+    for (size_t i = 0; i < cache.dir_count; i++) {
+        PathDir *dir = &cache.dirs[i];
+        const bool existed = dir->exists;
+        const struct timespec old = dir->mtime;
+
+        stat_dir(dir);
+        if (dir->exists != existed || dir->mtime.tv_sec != old.tv_sec ||
+            dir->mtime.tv_nsec != old.tv_nsec)
+            changed = true;
+    }
+
+    if (changed) {
+        cache.stats.invalidations++;
+        clear_entries(true);
+    }
+
+    return true;
+}
+
+static PathCacheEntry *find_entry(const char *name, const uint32_t hash) {
+    if (cache.bucket_count == 0)
+        return NULL;
+
+    for (PathCacheEntry *entry = cache.buckets[hash & (cache.bucket_count - 1)]; entry;
+         entry = entry->next) {
+        if (entry->hash == hash && !strcmp(entry->name, name))
+            return entry;
+    }
+
+    return NULL;
+}
+
+static bool grow_buckets(void) {
+    const size_t new_count =
+        cache.bucket_count ? cache.bucket_count * 2 : PATH_CACHE_INITIAL_BUCKETS;
+    PathCacheEntry **new_buckets = calloc(new_count, sizeof *new_buckets);
+    if (!new_buckets)
+        return false;
+
+    for (size_t i = 0; i < cache.bucket_count; i++) {
+        PathCacheEntry *entry = cache.buckets[i];
+        while (entry) {
+            PathCacheEntry *next = entry->next;
+            PathCacheEntry **slot = &new_buckets[entry->hash & (new_count - 1)];
+            entry->next = *slot;
+            *slot = entry;
+            entry = next;
+        }
+    }
+
+    free(cache.buckets);
+    cache.buckets = new_buckets;
+    cache.bucket_count = new_count;
+    return true;
+}
+
+/**
+ * Inserts or replaces the cache entry for @name. Failure to allocate is not an error for
+ * callers, the lookup just stays uncached.
+ */
+static PathCacheEntry *store_entry(const char *name, const char *full_path, const bool pinned) {
+    const uint32_t hash = hash_name(name);
+    PathCacheEntry *entry = find_entry(name, hash);
+    if (entry) {
+        char *copy = strdup(full_path);
+        if (!copy)
+            return NULL;
+        free(entry->full_path);
+        entry->full_path = copy;
+        entry->pinned = pinned;
+        return entry;
+    }
+
+    // Keep the load factor at or below 1
+    if (cache.entry_count >= cache.bucket_count && !grow_buckets())
         return NULL;
 
-    char *local_path = strdup(path);
-    if (local_path == NULL)
+    entry = calloc(1, sizeof *entry);
+    if (!entry)
         return NULL;
 
-    char *folder_path = strtok(local_path, ":");
-    size_t buffer_size = 1024;
-    char *full_path = malloc(buffer_size);
-    if (full_path == NULL) {
-        free(local_path);
+    entry->name = strdup(name);
+    entry->full_path = strdup(full_path);
+    if (!entry->name || !entry->full_path) {
+        free_entry(entry);
         return NULL;
     }
+    entry->hash = hash;
+    entry->pinned = pinned;
 
-    while (folder_path != NULL) {
-        // Add 1 for '/' and 1 for '\0' terminator
-        const size_t full_path_size = strlen(folder_path) + 1 + strlen(program_name) + 1;
-        if (buffer_size < full_path_size) {
-            char *temp = realloc(full_path, full_path_size);
-            if (temp == NULL) {
-                free(full_path);
-                free(local_path);
-                return NULL;
-            }
-            full_path = temp;
-            buffer_size = full_path_size;
-        }
+    PathCacheEntry **slot = &cache.buckets[hash & (cache.bucket_count - 1)];
+    entry->next = *slot;
+    *slot = entry;
+    cache.entry_count++;
+    return entry;
+}
+
+/**
+ * Walks the PATH directories in order and returns an arena copy of the path to the first
+ * executable named @program_name, or NULL. One candidate buffer sized for the longest
+ * directory is reused for every probe.
+ */
+static char *search_dirs(Arena *arena, const char *program_name) {
+    const size_t name_len = strlen(program_name);
+
+    // Add 1 for '/' and 1 for '\0' terminator
+    char *full_path = arena_alloc(arena, cache.max_dir_len + 1 + name_len + 1);
+    if (full_path == NULL)
+        return NULL;
+
+    for (size_t i = 0; i < cache.dir_count; i++) {
+        const PathDir *dir = &cache.dirs[i];
+        if (!dir->exists)
+            continue;
 
-        sprintf(full_path, "%s/%s", folder_path, program_name);
+        const size_t dir_len = strlen(dir->dir);
+        memcpy(full_path, dir->dir, dir_len);
+        full_path[dir_len] = '/';
+        memcpy(full_path + dir_len + 1, program_name, name_len + 1);
 
-        if (access(full_path, X_OK) == 0) {
-            free(local_path);
+        if (access(full_path, X_OK) == 0)
             return full_path;
+    }
+
+    return NULL;
+}
+
+/**
+ * Searches the PATH environment variable for the given executable name.
+ *
+ * Results are remembered in the command-location cache, so repeated lookups of the same
+ * name cost a hash probe instead of one access() per PATH directory.
+ *
+ * @param arena         Allocator for the returned path.
+ * @param program_name  Name of the binary to search for (e.g., "ls", "grep").
+ * @return              Full path to the binary in @arena, or NULL if not found.
+ */
+char *util_find_bin_in_path(Arena *arena, const char *program_name) {
+    if (!validate_cache())
+        return NULL;
+
+    // Names with a slash are never looked up through the table, same as in bash
+    const bool cacheable = strchr(program_name, '/') == NULL;
+
+    if (cacheable) {
+        PathCacheEntry *entry = find_entry(program_name, hash_name(program_name));
+        if (entry) {
+            cache.stats.hits++;
+            entry->hits++;
+            return arena_strdup(arena, entry->full_path);
+        }
+        cache.stats.misses++;
+    }
+
+    char *full_path = search_dirs(arena, program_name);
+    if (full_path && cacheable) {
+        PathCacheEntry *entry = store_entry(program_name, full_path, false);
+        if (entry)
+            entry->hits = 1;
+    }
+
+    return full_path;
+}
+
+bool util_path_cache_add(const char *program_name, const char *full_path) {
+    if (strchr(program_name, '/') != NULL)
+        return false;
+
+    // Make sure a later PATH comparison does not throw the seeded entry away
+    validate_cache();
+
+    return store_entry(program_name, full_path, true) != NULL;
+}
+
+bool util_path_cache_forget(const char *program_name) {
+    const uint32_t hash = hash_name(program_name);
+    if (cache.bucket_count == 0)
+        return false;
+
+    PathCacheEntry **link = &cache.buckets[hash & (cache.bucket_count - 1)];
+    while (*link) {
+        PathCacheEntry *entry = *link;
+        if (entry->hash == hash && !strcmp(entry->name, program_name)) {
+            *link = entry->next;
+            free_entry(entry);
+            cache.entry_count--;
+            return true;
         }
+        link = &entry->next;
+    }
 
-        folder_path = strtok(NULL, ":");
+    return false;
+}
+
+void util_path_cache_clear(void) { clear_entries(false); }
+
+/**
+ * Caches every executable in the absolute PATH directories at once; where two directories
+ * hold the same name, the earlier one wins, as in a lookup. Meant for a server that forks a
+ * process per connection, so each starts warm instead of resolving every command anew.
+ * Relative directories are left to lookups, since what they name depends on the cwd.
+ *
+ * @return  Number of names cached.
+ */
+size_t util_path_cache_fill(void) {
+    if (!validate_cache())
+        return 0;
+
+    size_t filled = 0;
+    char *full_path = malloc(cache.max_dir_len + 1 + NAME_MAX + 1);
+    if (!full_path)
+        return 0;
+
+    for (size_t i = 0; i < cache.dir_count; i++) {
+        const PathDir *dir = &cache.dirs[i];
+        DIR *stream = dir->exists && dir->dir[0] == '/' ? opendir(dir->dir) : NULL;
+        if (!stream)
+            continue;
+
+        const size_t dir_len = strlen(dir->dir);
+        memcpy(full_path, dir->dir, dir_len);
+        full_path[dir_len] = '/';
+
+        const struct dirent *ent;
+        while ((ent = readdir(stream))) {
+            const char *name = ent->d_name;
+            if (!strcmp(name, ".") || !strcmp(name, "..") || find_entry(name, hash_name(name)))
+                continue;
+
+            strcpy(full_path + dir_len + 1, name);
+            if (access(full_path, X_OK) == 0 && store_entry(name, full_path, false))
+                filled++;
+        }
+        closedir(stream);
     }
 
-    free(local_path);
     free(full_path);
-    return NULL;
+    return filled;
+}
+
+const char *util_path_cache_peek(const char *program_name) {
+    const PathCacheEntry *entry = find_entry(program_name, hash_name(program_name));
+    return entry ? entry->full_path : NULL;
+}
+
+void util_path_cache_foreach(PathCacheVisitor visit, void *ctx) {
+    for (size_t i = 0; i < cache.bucket_count; i++) {
+        for (const PathCacheEntry *entry = cache.buckets[i]; entry; entry = entry->next)
+            visit(entry->name, entry->full_path, entry->hits, ctx);
+    }
+}
+
+PathCacheStats util_path_cache_stats(void) {
+    PathCacheStats stats = cache.stats;
+    stats.entries = cache.entry_count;
+    return stats;
+}
+
+/**
+ * Calls @visit for every existing PATH directory, in search order, from the same directory
+ * list util_find_bin_in_path() walks. @index is the directory's position in PATH among
+ * the non-empty elements.
+ *
+ * @return  false if there is no usable PATH.
+ */
+bool util_path_foreach_dir(PathDirVisitor visit, void *ctx) {
+    if (!validate_cache())
+        return false;
+
+    for (size_t i = 0; i < cache.dir_count; i++) {
+        if (cache.dirs[i].exists)
+            visit(cache.dirs[i].dir, i, ctx);
+    }
+    return true;
+}
+
+/**
+ * Called after the shell changed directory. Relative PATH entries (like `.` or `bin`) now
+ * name other directories, so they are re-stat'ed and the locations found through them are
+ * forgotten; absolute entries are unaffected.
+ */
+void util_path_cwd_changed(void) {
+    bool relative = false;
+    for (size_t i = 0; i < cache.dir_count; i++) {
+        if (cache.dirs[i].dir[0] != '/') {
+            stat_dir(&cache.dirs[i]);
+            relative = true;
+        }
+    }
+    if (!relative)
+        return;
+
+    for (size_t i = 0; i < cache.bucket_count; i++) {
+        PathCacheEntry **link = &cache.buckets[i];
+        while (*link) {
+            PathCacheEntry *entry = *link;
+            if (entry->pinned || entry->full_path[0] == '/') {
+                link = &entry->next;
+                continue;
+            }
+            *link = entry->next;
+            free_entry(entry);
+            cache.entry_count--;
+        }
+    }
 }
@@ -3,6 +3,37 @@
 //
 #ifndef PATH_UTILS_H
 #define PATH_UTILS_H
+#include "arena.h"
 
-char *util_find_bin_in_path(const char *program_name);
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * @hits           Lookups answered from the cache.
+ * @misses         Lookups that had to walk the PATH directories.
+ * @invalidations  Times the cache was dropped because PATH or a PATH directory changed.
+ * @entries        Names currently cached.
+ */
+typedef struct {
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long invalidations;
+    size_t entries;
+} PathCacheStats;
+
+typedef void (*PathDirVisitor)(const char *dir, size_t index, void *ctx);
+typedef void (*PathCacheVisitor)(const char *name, const char *full_path, unsigned long hits,
+                                 void *ctx);
+
+char *util_find_bin_in_path(Arena *arena, const char *program_name);
+
+bool util_path_cache_add(const char *program_name, const char *full_path);
+bool util_path_cache_forget(const char *program_name);
+void util_path_cache_clear(void);
+size_t util_path_cache_fill(void);
+const char *util_path_cache_peek(const char *program_name);
+void util_path_cache_foreach(PathCacheVisitor visit, void *ctx);
+PathCacheStats util_path_cache_stats(void);
+bool util_path_foreach_dir(PathDirVisitor visit, void *ctx);
+void util_path_cwd_changed(void);
 #endif // PATH_UTILS_H
@@ -0,0 +1,661 @@
+#define _GNU_SOURCE // pipe2(), F_SETPIPE_SZ
+#include "pipeline.h"
+#include "builtins.h"
+#include "exec.h"
+#include "jobs.h"
+#include "path_utils.h"
+#include "trace.h"
+#include "vars.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "memstats.h"
+
+// Pipes are grown to this size so throughput-heavy stages do not ping-pong on 64 KiB.
+// Best effort: unprivileged users are capped by /proc/sys/fs/pipe-max-size.
+#define PIPELINE_PIPE_SIZE (1 << 20)
+
+#define EXIT_CANNOT_EXECUTE 126
+#define EXIT_COMMAND_NOT_FOUND 127
+
+static bool is_pipe_token(const char *token, const bool is_operator) {
+    return is_operator && !strcmp(token, "|");
+}
+
+static bool is_background_token(const char *token, const bool is_operator) {
+    return is_operator && !strcmp(token, "&");
+}
+
+/**
+ * @return  true if every redirection of @stage is aimed at @target_fd.
+ */
+static bool only_redirects(const PipelineStage *stage, const int target_fd) {
+    for (int i = 0; i < stage->redir_count; i++) {
+        if (stage->specs[i].target_fd != target_fd)
+            return false;
+    }
+    return true;
+}
+
+/**
+ * Hands the redirections of a command-less stage to its neighbour. They go in front of the
+ * neighbour's own, so those still win. `< big.log | grep x` becomes `grep x < big.log`, so
+ * the file is read by grep directly and no bytes pass through the shell or an extra pipe.
+ */
+static bool move_redirects(Arena *arena, PipelineStage *from, PipelineStage *to) {
+    if (from->redir_count == 0)
+        return true;
+
+    const int count = from->redir_count + to->redir_count;
+    RedirSpec *specs = arena_alloc(arena, count * sizeof *specs);
+    if (!specs) {
+        perror("arena_alloc");
+        return false;
+    }
+
+    memcpy(specs, from->specs, from->redir_count * sizeof *specs);
+    memcpy(specs + from->redir_count, to->specs, to->redir_count * sizeof *specs);
+    to->specs = specs;
+    to->redir_count = count;
+    from->redir_count = 0;
+    return true;
+}
+
+/**
+ * Only `< file | ...` at the head and `... | > file` at the tail make sense without a
+ * command; they are folded into the neighbouring stage.
+ */
+static bool fold_null_stages(Arena *arena, Pipeline *pipeline) {
+    if (pipeline->stage_count < 2)
+        return true;
+
+    PipelineStage *head = &pipeline->stages[0];
+    if (head->argc == 0) {
+        if (!only_redirects(head, STDIN_FILENO)) {
+            fprintf(stderr, "syntax error: only '<' may start a pipeline without a command\n");
+            return false;
+        }
+        if (!move_redirects(arena, head, &pipeline->stages[1]))
+            return false;
+        memmove(head, head + 1, (pipeline->stage_count - 1) * sizeof *head);
+        pipeline->stage_count--;
+    }
+
+    PipelineStage *tail = &pipeline->stages[pipeline->stage_count - 1];
+    if (tail->argc == 0 && pipeline->stage_count > 1) {
+        if (!only_redirects(tail, STDOUT_FILENO)) {
+            fprintf(stderr, "syntax error: only '>' may end a pipeline without a command\n");
+            return false;
+        }
+        if (!move_redirects(arena, tail, tail - 1))
+            return false;
+        pipeline->stage_count--;
+    }
+
+    for (int i = 0; i < pipeline->stage_count; i++) {
+        if (pipeline->stages[i].argc == 0 && pipeline->stage_count > 1) {
+            fprintf(stderr, "syntax error: empty command in pipeline\n");
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Splits tokens at "|" and extracts each stage's redirections. The stages point into
+ * tokens[], and both live in @arena. A trailing "&" marks the pipeline as a background job.
+ *
+ * @param operators  Parallel to tokens[], as from tokenize_input_expand(): only these tokens
+ *                   can be a "|", "&" or redirection, a quoted one is a word.
+ */
+bool pipeline_parse(Arena *arena, char *tokens[], bool operators[], int token_count,
+                    Pipeline *out) {
+    *out = (Pipeline){0};
+
+    // `time` is a keyword, not a command: it times the whole pipeline after it
+    if (token_count > 0 && !strcmp(tokens[0], "time")) {
+        out->timed = true;
+        tokens++;
+        operators++;
+        token_count--;
+    }
+
+    // A trailing '&' runs the whole pipeline in the background
+    const int last = token_count - 1;
+    if (token_count > 1 && is_background_token(tokens[last], operators[last])) {
+        out->background = true;
+        tokens[--token_count] = NULL;
+    }
+
+    int stage_count = 1;
+    for (int i = 0; i < token_count; i++) {
+        if (is_background_token(tokens[i], operators[i])) {
+            fprintf(stderr, "syntax error near unexpected token '&'\n");
+            return false;
+        }
+
+        if (!is_pipe_token(tokens[i], operators[i]))
+            continue;
+
+        if (i == 0 || i == token_count - 1 || is_pipe_token(tokens[i + 1], operators[i + 1])) {
+            fprintf(stderr, "syntax error near unexpected token '|'\n");
+            return false;
+        }
+        stage_count++;
+    }
+
+    out->stages = arena_alloc(arena, stage_count * sizeof *out->stages);
+    if (!out->stages) {
+        perror("arena_alloc");
+        return false;
+    }
+
+    int start = 0;
+    for (int i = 0; i <= token_count; i++) {
+        if (i < token_count && !is_pipe_token(tokens[i], operators[i]))
+            continue;
+
+        // Drop the "|" so each stage's slice is NULL-terminated in place
+        if (i < token_count)
+            tokens[i] = NULL;
+
+        PipelineStage *stage = &out->stages[out->stage_count];
+        int cleaned_count = i - start;
+        const uint64_t trace_start = trace_begin();
+        stage->specs = extract_redirection(arena, &tokens[start], &operators[start], i - start,
+                                           &cleaned_count, &stage->redir_count);
+        trace_end(TRACE_REDIRECT, trace_start, NULL);
+        if (!stage->specs) {
+            fprintf(stderr, "Failed to parse redirections\n");
+            return false;
+        }
+
+        stage->argv = &tokens[start];
+        stage->argc = cleaned_count;
+        out->stage_count++;
+        start = i + 1;
+    }
+
+    return fold_null_stages(arena, out);
+}
+
+/**
+ * The command line as `jobs` shows it, rebuilt from the stages' words.
+ */
+static const char *describe_pipeline(Arena *arena, const Pipeline *pipeline) {
+    size_t len = 1;
+    for (int i = 0; i < pipeline->stage_count; i++) {
+        for (int k = 0; k < pipeline->stages[i].argc; k++)
+            len += strlen(pipeline->stages[i].argv[k]) + 3;
+    }
+
+    char *text = arena_alloc(arena, len);
+    if (!text)
+        return "";
+
+    char *p = text;
+    for (int i = 0; i < pipeline->stage_count; i++) {
+        if (i > 0)
+            p = stpcpy(p, " | ");
+        for (int k = 0; k < pipeline->stages[i].argc; k++) {
+            if (k > 0)
+                *p++ = ' ';
+            p = stpcpy(p, pipeline->stages[i].argv[k]);
+        }
+    }
+    *p = '\0';
+    return text;
+}
+
+/**
+ * Process group for a new job's first process: a group of its own under job control, so the
+ * terminal's signals reach the job and not the shell.
+ */
+static pid_t new_job_pgid(void) { return jobs_control_enabled() ? 0 : -1; }
+
+/**
+ * Terminal a new job's processes take before exec. A foreground job under job control gets
+ * it straight away rather than once the shell waits for it; the shell hands it over again
+ * then, for a job that had nothing to exec.
+ */
+static int new_job_tty(const bool background) {
+    return jobs_control_enabled() && !background ? STDIN_FILENO : -1;
+}
+
+/**
+ * Reports a failed spawn of @bin_full_path. posix_spawn() returns the same errno for a
+ * redirection target that could not be opened as for a binary that could not be executed,
+ * so the two are told apart afterwards: if the binary is still there, the redirections are
+ * opened again in the shell to find, and report, the one that fails. The spawn already did
+ * everything up to that point, so this creates or truncates nothing new.
+ *
+ * @return  Exit status for the command: 1 for a redirection, 127 if the binary is gone, 126
+ *          if it could not be executed.
+ */
+static int report_spawn_error(Arena *arena, const PipelineStage *stage, const char *bin_full_path,
+                              const int in_fd, const int out_fd, const int err) {
+    const char *program_name = stage->argv[0];
+    if (access(bin_full_path, X_OK) == 0) {
+        RedirFdTable fds;
+        if (!build_redirection_table(arena, &fds, stage->specs, stage->redir_count, in_fd,
+                                     out_fd))
+            return 1;
+        release_redirection_table(&fds);
+    } else if (errno == ENOENT) {
+        // A remembered location that vanished must not keep failing
+        util_path_cache_forget(program_name);
+    }
+
+    fprintf(stderr, "%s: %s\n", program_name, strerror(err));
+    return err == ENOENT ? EXIT_COMMAND_NOT_FOUND : EXIT_CANNOT_EXECUTE;
+}
+
+static int execute_command(Arena *arena, const Pipeline *pipeline) {
+    const PipelineStage *stage = &pipeline->stages[0];
+    const char *program_name = stage->argv[0];
+    uint64_t trace_start = trace_begin();
+    char *bin_full_path = util_find_bin_in_path(arena, program_name);
+    trace_end(TRACE_RESOLVE, trace_start, program_name);
+    if (bin_full_path == NULL) {
+        fprintf(stderr, "%s: command not found\n", program_name);
+        return EXIT_COMMAND_NOT_FOUND;
+    }
+
+    pid_t pid;
+    const pid_t pgid = new_job_pgid();
+    trace_start = trace_begin();
+    const int err = exec_launch(EXEC_LAUNCH_SPAWN, bin_full_path, stage->argv, vars_envp(),
+                                stage->specs, stage->redir_count, -1, -1, pgid,
+                                new_job_tty(false), &pid);
+    trace_end(TRACE_SPAWN, trace_start, bin_full_path);
+    if (err != 0)
+        return report_spawn_error(arena, stage, bin_full_path, -1, -1, err);
+
+    const char *command = describe_pipeline(arena, pipeline);
+    trace_start = trace_begin();
+    const int status = jobs_run_foreground(arena, pgid == -1 ? -1 : pid, &pid, 1, command);
+    trace_end(TRACE_WAIT, trace_start, command);
+    return status;
+}
+
+/**
+ * Runs a builtin with its redirections resolved into an fd table, so the shell's own
+ * stdin/stdout/stderr are never dup2()ed and need no restoring. Its output is collected in
+ * one OutBuf and written with a single writev() when it returns.
+ *
+ * @param builtin  Registry entry, or NULL for a command-less `> file`, which only opens.
+ * @param in_fd    When not -1, the builtin's stdin before redirections (pipeline wiring).
+ * @param out_fd   When not -1, the builtin's stdout before redirections (pipeline wiring).
+ * @param capture  When not NULL, collects the builtin's output instead of its stdout.
+ */
+static int run_builtin(Arena *arena, const BuiltinSpec *builtin, PipelineStage *stage,
+                       const int in_fd, const int out_fd, OutCapture *capture) {
+    RedirFdTable fds;
+    if (!build_redirection_table(arena, &fds, stage->specs, stage->redir_count, in_fd, out_fd))
+        return 1;
+
+    int status = 0;
+    if (builtin) {
+        OutBuf out;
+        if (capture)
+            outbuf_init_capture(&out, capture);
+        else
+            outbuf_init(&out, fds.fds[STDOUT_FILENO]);
+
+        BuiltinIO io = {fds.fds[STDIN_FILENO], fds.fds[STDOUT_FILENO], fds.fds[STDERR_FILENO],
+                        arena, &out};
+        const uint64_t trace_start = trace_begin();
+        status = builtin_run(builtin, stage->argc, stage->argv, &io);
+        trace_end(TRACE_BUILTIN, trace_start, builtin->name);
+        if (!outbuf_flush(&out)) {
+            dprintf(io.err_fd, "%s: write error: %s\n", stage->argv[0], strerror(out.error));
+            status = status ? status : 1;
+        }
+    }
+
+    release_redirection_table(&fds);
+    return status;
+}
+
+/**
+ * Builtins inside a pipeline or in the background need a process of their own so they run
+ * concurrently with the shell; this is the one place that still requires a plain fork().
+ * The pipe ends go straight into the builtin's fd table.
+ */
+static pid_t launch_builtin_stage(Arena *arena, const BuiltinSpec *builtin,
+                                  PipelineStage *stage, const int in_fd, const int out_fd,
+                                  const pid_t pgid, const int tty_fd) {
+    const uint64_t trace_start = trace_begin();
+    const pid_t pid = fork();
+    if (pid == -1) {
+        perror("fork");
+        return -1;
+    }
+
+    if (pid == 0) {
+        exec_child_setup(pgid, tty_fd);
+        _exit(run_builtin(arena, builtin, stage, in_fd, out_fd, NULL));
+    }
+
+    if (pgid != -1)
+        setpgid(pid, pgid ? pgid : pid);
+    trace_end(TRACE_FORK, trace_start, builtin->name);
+    return pid;
+}
+
+/**
+ * @param status_out  Out: the stage's exit status when it could not be started.
+ * @return            The started process, or -1.
+ */
+static pid_t launch_stage(Arena *arena, PipelineStage *stage, const int in_fd,
+                          const int out_fd, const pid_t pgid, const int tty_fd,
+                          int *status_out) {
+    *status_out = EXIT_COMMAND_NOT_FOUND;
+    const char *program_name = stage->argv[0];
+    const BuiltinSpec *builtin = builtin_lookup(program_name);
+    if (builtin)
+        return launch_builtin_stage(arena, builtin, stage, in_fd, out_fd, pgid, tty_fd);
+
+    uint64_t trace_start = trace_begin();
+    char *bin_full_path = util_find_bin_in_path(arena, program_name);
+    trace_end(TRACE_RESOLVE, trace_start, program_name);
+    if (bin_full_path == NULL) {
+        fprintf(stderr, "%s: command not found\n", program_name);
+        return -1;
+    }
+
+    pid_t pid;
+    trace_start = trace_begin();
+    const int err = exec_launch(EXEC_LAUNCH_SPAWN, bin_full_path, stage->argv, vars_envp(),
+                                stage->specs, stage->redir_count, in_fd, out_fd, pgid, tty_fd,
+                                &pid);
+    trace_end(TRACE_SPAWN, trace_start, bin_full_path);
+    if (err != 0) {
+        *status_out = report_spawn_error(arena, stage, bin_full_path, in_fd, out_fd, err);
+        return -1;
+    }
+
+    return pid;
+}
+
+/**
+ * Starts every stage before waiting on any of them. The shell closes each pipe end as soon
+ * as the stage using it is launched, so readers see EOF when their writer exits. All stages
+ * share one process group, led by the first stage that started.
+ *
+ * A background pipeline goes into the job table instead of being waited for. Without job
+ * control it reads from /dev/null, so it cannot steal the shell's input.
+ *
+ * @return  Exit status of the last stage; 0 for a started background job.
+ */
+static int run_pipeline(Arena *arena, Pipeline *pipeline) {
+    const int count = pipeline->stage_count;
+    pid_t *pids = arena_alloc(arena, count * sizeof *pids);
+    if (!pids) {
+        perror("arena_alloc");
+        return 1;
+    }
+
+    int launched = 0;
+    bool last_failed = false;
+    int failed_status = EXIT_COMMAND_NOT_FOUND;
+    pid_t pgid = new_job_pgid();
+    const int tty_fd = new_job_tty(pipeline->background);
+    int prev_read = -1;
+    if (pipeline->background && pgid == -1)
+        prev_read = open("/dev/null", O_RDONLY | O_CLOEXEC);
+
+    for (int i = 0; i < count; i++) {
+        int fds[2] = {-1, -1};
+        if (i < count - 1) {
+            if (pipe2(fds, O_CLOEXEC) == -1) {
+                perror("pipe2");
+                break;
+            }
+            fcntl(fds[1], F_SETPIPE_SZ, PIPELINE_PIPE_SIZE);
+        }
+
+        int launch_status;
+        const pid_t pid = launch_stage(arena, &pipeline->stages[i], prev_read, fds[1], pgid,
+                                       tty_fd, &launch_status);
+        if (pid > 0) {
+            pids[launched++] = pid;
+            if (pgid == 0)
+                pgid = pid;
+        }
+        if (i == count - 1 && pid <= 0) {
+            last_failed = true;
+            failed_status = launch_status;
+        }
+
+        if (prev_read != -1)
+            close(prev_read);
+        if (fds[1] != -1)
+            close(fds[1]);
+        prev_read = fds[0];
+    }
+
+    if (prev_read != -1)
+        close(prev_read);
+
+    if (launched == 0)
+        return failed_status;
+
+    const char *command = describe_pipeline(arena, pipeline);
+    if (pipeline->background)
+        return jobs_add_background(arena, pgid, pids, launched, command) == -1 ? 1 : 0;
+
+    const uint64_t trace_start = trace_begin();
+    int status = jobs_run_foreground(arena, pgid, pids, launched, command);
+    trace_end(TRACE_WAIT, trace_start, command);
+    if (last_failed)
+        status = failed_status;
+
+    return status;
+}
+
+static double seconds(const struct timeval *tv) { return tv->tv_sec + tv->tv_usec / 1e6; }
+
+static void print_duration(OutBuf *out, const char *label, const double total) {
+    const int minutes = (int)(total / 60);
+    outbuf_printf(out, "%s\t%dm%.3fs\n", label, minutes, total - minutes * 60);
+}
+
+/**
+ * Prints what `time` reports, to the shell's stderr like other shells. User and system
+ * time cover the waited-for processes and the shell's own work for the pipeline, so
+ * in-process builtins are counted too; max RSS and context switches are the children's.
+ */
+static void report_time(const double real, const struct rusage *self_before) {
+    struct rusage children;
+    struct rusage self;
+    jobs_take_usage(&children);
+    getrusage(RUSAGE_SELF, &self);
+
+    const double user = seconds(&children.ru_utime) + seconds(&self.ru_utime) -
+                        seconds(&self_before->ru_utime);
+    const double sys = seconds(&children.ru_stime) + seconds(&self.ru_stime) -
+                       seconds(&self_before->ru_stime);
+
+    OutBuf out;
+    outbuf_init(&out, STDERR_FILENO);
+    outbuf_write(&out, "\n", 1);
+    print_duration(&out, "real", real);
+    print_duration(&out, "user", user);
+    print_duration(&out, "sys", sys);
+    outbuf_printf(&out, "maxrss\t%ld KiB\n", children.ru_maxrss);
+    outbuf_printf(&out, "ctxsw\t%ld voluntary, %ld involuntary\n", children.ru_nvcsw,
+                  children.ru_nivcsw);
+    outbuf_flush(&out);
+}
+
+/**
+ * @return  Length of the name in @word if it is a `NAME=value` assignment, else 0.
+ */
+static size_t assignment_name_length(const char *word) {
+    const char *eq = strchr(word, '=');
+    return eq && vars_valid_name(word, eq - word) ? (size_t)(eq - word) : 0;
+}
+
+// A stage made only of `NAME=value` words, with no redirections
+static bool only_assignments(const PipelineStage *stage) {
+    if (stage->argc == 0 || stage->redir_count > 0)
+        return false;
+    for (int i = 0; i < stage->argc; i++) {
+        if (!assignment_name_length(stage->argv[i]))
+            return false;
+    }
+    return true;
+}
+
+/**
+ * A line made only of `NAME=value` words sets shell variables. Each keeps its export state,
+ * so only already exported names reach the environment of later commands.
+ */
+static bool run_assignments(const PipelineStage *stage, int *status) {
+    if (!only_assignments(stage))
+        return false;
+
+    *status = 0;
+    for (int i = 0; i < stage->argc; i++) {
+        const size_t name_len = assignment_name_length(stage->argv[i]);
+        if (!vars_set_n(stage->argv[i], name_len, stage->argv[i] + name_len + 1, false)) {
+            fprintf(stderr, "%.*s: cannot assign\n", (int)name_len, stage->argv[i]);
+            *status = 1;
+        }
+    }
+    return true;
+}
+
+static int run_untimed(Arena *arena, Pipeline *pipeline) {
+    if (pipeline->stage_count == 1 && !pipeline->background) {
+        PipelineStage *stage = &pipeline->stages[0];
+        int status;
+        if (run_assignments(stage, &status))
+            return status;
+
+        const BuiltinSpec *builtin = stage->argc > 0 ? builtin_lookup(stage->argv[0]) : NULL;
+        if (stage->argc == 0 || builtin)
+            return run_builtin(arena, builtin, stage, -1, -1, NULL);
+
+        return execute_command(arena, pipeline);
+    }
+
+    return run_pipeline(arena, pipeline);
+}
+
+/**
+ * Runs a parsed pipeline to completion, or starts it as a background job.
+ *
+ * @return  Exit status of the (last) command, 127 if it could not be found.
+ */
+int pipeline_run(Arena *arena, Pipeline *pipeline) {
+    // Buffered script output must reach the fd before any command writes to it
+    fflush(stdout);
+
+    if (!pipeline->timed || pipeline->background)
+        return run_untimed(arena, pipeline);
+
+    struct rusage self_before;
+    struct rusage stale;
+    jobs_take_usage(&stale);
+    getrusage(RUSAGE_SELF, &self_before);
+    const uint64_t start = trace_now();
+
+    const int status = run_untimed(arena, pipeline);
+
+    report_time((trace_now() - start) / 1e9, &self_before);
+    return status;
+}
+
+/**
+ * Reads @fd until end of file, appending to @capture.
+ */
+static bool read_all(const int fd, OutCapture *capture) {
+    while (true) {
+        if (!outcapture_reserve(capture, 4096))
+            return false;
+        const ssize_t n = read(fd, capture->data + capture->len, capture->cap - capture->len);
+        if (n == 0)
+            return true;
+        if (n == -1) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        capture->len += n;
+    }
+}
+
+static int wait_for_exit(const pid_t pid) {
+    int status;
+    while (waitpid(pid, &status, 0) == -1) {
+        if (errno != EINTR)
+            return 1;
+    }
+    return WIFSIGNALED(status) ? 128 + WTERMSIG(status) : WEXITSTATUS(status);
+}
+
+/**
+ * Runs @pipeline for command substitution, appending what it writes to stdout to @capture.
+ *
+ * A builtin that only produces output runs in the shell itself, writing into @capture
+ * directly: `$(pwd)` costs no fork. A single other command is started with its stdout on a
+ * pipe that is read into @capture. Anything else runs in a forked copy of the shell with
+ * job control off, so shell-state builtins and assignments there cannot change the shell.
+ *
+ * @return  Exit status of the (last) command.
+ */
+int pipeline_capture(Arena *arena, Pipeline *pipeline, OutCapture *capture) {
+    PipelineStage *stage = &pipeline->stages[0];
+    const bool simple = pipeline->stage_count == 1 && !pipeline->background &&
+                        !pipeline->timed && stage->argc > 0 && !only_assignments(stage);
+    if (simple && stage->redir_count == 0) {
+        const BuiltinSpec *builtin = builtin_lookup(stage->argv[0]);
+        if (builtin && builtin->flags & BUILTIN_FLAG_OUTPUT_ONLY)
+            return run_builtin(arena, builtin, stage, -1, -1, capture);
+    }
+
+    fflush(stdout);
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) == -1) {
+        perror("pipe2");
+        return 1;
+    }
+
+    pid_t pid;
+    int launch_status = 1;
+    if (simple) {
+        pid = launch_stage(arena, stage, -1, fds[1], -1, -1, &launch_status);
+    } else {
+        pid = fork();
+        if (pid == 0) {
+            exec_child_setup(-1, -1);
+            jobs_enter_subshell();
+            if (dup2(fds[1], STDOUT_FILENO) == -1)
+                _exit(1);
+            const int status = pipeline_run(arena, pipeline);
+            fflush(stdout);
+            _exit(status);
+        }
+        if (pid == -1)
+            perror("fork");
+    }
+    close(fds[1]);
+
+    if (pid != -1 && !read_all(fds[0], capture))
+        perror("read");
+    close(fds[0]);
+    if (pid == -1)
+        return launch_status;
+
+    return wait_for_exit(pid);
+}
@@ -0,0 +1,43 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+#include "arena.h"
+#include "outbuf.h"
+#include "redirection.h"
+
+#include <stdbool.h>
+
+/**
+ * One command of an `a | b | c` pipeline.
+ *
+ * @argv         NULL-terminated slice of the tokenizer output, redirections removed.
+ *               Like everything else here it lives in the command's arena.
+ * @argc         Number of words in argv.
+ * @specs        Redirections from extract_redirection().
+ * @redir_count  Number of entries in specs.
+ */
+typedef struct {
+    char **argv;
+    int argc;
+    RedirSpec *specs;
+    int redir_count;
+} PipelineStage;
+
+/**
+ * @stages       The commands, in pipe order.
+ * @stage_count  Number of entries in stages.
+ * @background   Started as a job with a trailing '&' instead of being waited for.
+ * @timed        Prefixed with `time`: resource usage is reported when it finishes.
+ */
+typedef struct {
+    PipelineStage *stages;
+    int stage_count;
+    bool background;
+    bool timed;
+} Pipeline;
+
+bool pipeline_parse(Arena *arena, char *tokens[], bool operators[], int token_count,
+                    Pipeline *out);
+int pipeline_run(Arena *arena, Pipeline *pipeline);
+int pipeline_capture(Arena *arena, Pipeline *pipeline, OutCapture *capture);
+
+#endif // PIPELINE_H
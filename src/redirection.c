@@ -0,0 +1,425 @@
+#define _GNU_SOURCE // memfd_create(), F_ADD_SEALS
+#include "redirection.h"
+#include "outbuf.h"
+
+#include <assert.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "memstats.h"
+
+typedef enum {
+    OP_NONE,
+    OP_READ,        // <
+    OP_READ_WRITE,  // <>
+    OP_WRITE,       // >
+    OP_APPEND,      // >>
+    OP_DUP_IN,      // <&
+    OP_DUP_OUT,     // >&
+    OP_HERE_DOC,    // << and <<-
+    OP_HERE_STRING, // <<<
+} RedirOp;
+
+/**
+ * The memfds behind the current command line's here-documents and here-strings. They
+ * outlive extract_redirection() because specs only name them, and are closed together by
+ * release_here_documents() once the line has run.
+ */
+static struct {
+    int *fds;
+    size_t count;
+    size_t capacity;
+} here_documents;
+
+static bool is_fd_word(const char *s) {
+    if (!*s)
+        return false;
+    for (; *s; s++) {
+        if (!isdigit((unsigned char)*s))
+            return false;
+    }
+    return true;
+}
+
+/**
+ * Recognizes a redirection operator token as the tokenizer emits it: an optional single
+ * digit fd (or '&' for stdout and stderr), the operator, and for the '&' forms an optional
+ * attached fd number or '-', as in `2>&1` or `>&-`.
+ *
+ * @param token     The token to look at.
+ * @param fd_out    Out: the explicit fd, or -1 if none was written.
+ * @param both_out  Out: true for `&>` and `&>>`.
+ * @param word_out  Out: the attached operand, "" if the operand is the next token.
+ * @return          OP_NONE if @token is a plain word.
+ */
+static RedirOp parse_operator(const char *token, int *fd_out, bool *both_out,
+                              const char **word_out) {
+    const char *p = token;
+    *fd_out = -1;
+    *both_out = false;
+
+    if (isdigit((unsigned char)p[0]) && (p[1] == '<' || p[1] == '>')) {
+        *fd_out = p[0] - '0';
+        p++;
+    } else if (p[0] == '&' && p[1] == '>') {
+        *both_out = true;
+        p++;
+    }
+
+    RedirOp op;
+    size_t op_len = 2;
+    if (p[0] == '<' && p[1] == '<') {
+        op = p[2] == '<' ? OP_HERE_STRING : OP_HERE_DOC;
+        op_len = p[2] == '<' || p[2] == '-' ? 3 : 2;
+    } else if (p[0] == '<') {
+        op = p[1] == '>' ? OP_READ_WRITE : p[1] == '&' ? OP_DUP_IN : OP_READ;
+    } else if (p[0] == '>') {
+        op = p[1] == '>' ? OP_APPEND : p[1] == '&' ? OP_DUP_OUT : OP_WRITE;
+    } else {
+        return OP_NONE;
+    }
+    p += op == OP_READ || op == OP_WRITE ? 1 : op_len;
+
+    if (*both_out && op != OP_WRITE && op != OP_APPEND)
+        return OP_NONE;
+
+    // Only the '&' forms carry their operand
+    const bool is_dup = op == OP_DUP_IN || op == OP_DUP_OUT;
+    if (*p && !(is_dup && (is_fd_word(p) || !strcmp(p, "-"))))
+        return OP_NONE;
+
+    *word_out = p;
+    return op;
+}
+
+static RedirSpec open_spec(const int target_fd, char *filename, const int open_flags) {
+    return (RedirSpec){
+        .kind = REDIR_OPEN, .target_fd = target_fd, .filename = filename, .open_flags = open_flags};
+}
+
+static RedirSpec dup_spec(const int target_fd, const int source_fd) {
+    return (RedirSpec){.kind = REDIR_DUP, .target_fd = target_fd, .source_fd = source_fd};
+}
+
+/**
+ * Creates an empty here-document: an anonymous memfd that nothing on disk refers to. The
+ * shell keeps it until release_here_documents(); commands get it as a dup2'd copy.
+ *
+ * The memfd is moved above the redirectable fds, as other shells do with their own
+ * descriptors: at the lowest free number, `cat 5>out <<EOF` would open out over it before
+ * it is copied onto stdin.
+ *
+ * @return  The descriptor (close-on-exec), or -1 with errno set.
+ */
+int here_document_create(void) {
+    if (here_documents.count == here_documents.capacity) {
+        const size_t capacity = here_documents.capacity ? here_documents.capacity * 2 : 8;
+        int *fds = realloc(here_documents.fds, capacity * sizeof *fds);
+        if (!fds)
+            return -1;
+        here_documents.fds = fds;
+        here_documents.capacity = capacity;
+    }
+
+    const int memfd = memfd_create("sleepyshell-heredoc", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (memfd == -1)
+        return -1;
+
+    const int fd = fcntl(memfd, F_DUPFD_CLOEXEC, REDIR_FD_LIMIT);
+    const int saved_errno = errno;
+    close(memfd);
+    if (fd == -1) {
+        errno = saved_errno;
+        return -1;
+    }
+
+    here_documents.fds[here_documents.count++] = fd;
+    return fd;
+}
+
+bool here_document_write(const int fd, const char *data, const size_t len) {
+    return write_all(fd, data, len);
+}
+
+/**
+ * Makes a written here-document read-only for good and rewinds it for its reader. The
+ * seals are what let a command treat it like any regular file: its size cannot change under
+ * it, and no one can write to it again.
+ */
+bool here_document_seal(const int fd) {
+    if (lseek(fd, 0, SEEK_SET) == -1)
+        return false;
+    return fcntl(fd, F_ADD_SEALS, F_SEAL_WRITE | F_SEAL_GROW | F_SEAL_SHRINK | F_SEAL_SEAL) == 0;
+}
+
+/**
+ * Closes the shell's copies of every here-document made since the last call. Commands that
+ * were given one hold their own descriptor and keep reading.
+ */
+void release_here_documents(void) {
+    for (size_t i = 0; i < here_documents.count; i++)
+        close(here_documents.fds[i]);
+    here_documents.count = 0;
+}
+
+/**
+ * Builds the here-document for `<<<word`: the word and a newline.
+ *
+ * @return  The memfd, or -1 after reporting the error.
+ */
+static int here_string(const char *word) {
+    const int fd = here_document_create();
+    const bool ok = fd != -1 && here_document_write(fd, word, strlen(word)) &&
+                    here_document_write(fd, "\n", 1) && here_document_seal(fd);
+    if (!ok) {
+        perror("here-string");
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * extract_redirection - remove I/O redirections from argv
+ * @arena:      allocator for the returned specs
+ * @tokens:     NULL-terminated token array, compacted in place
+ * @operators:  parallel to @tokens, true for unquoted operators; compacted along with it
+ * @token_count: original count
+ * @new_token_count: out: new count after removing ops+filenames
+ * @redir_specs_count_out: out: number of specs
+ *
+ * Returns an arena-allocated RedirSpec[] in the order the redirections were written;
+ * `&>file` yields two entries (open stdout, then dup it onto stderr).
+ * Returns NULL on parse or alloc failure; tokens[] may then be partially compacted.
+ */
+RedirSpec *extract_redirection(Arena *arena, char *tokens[], bool operators[], int token_count,
+                               int *new_token_count, int *redir_specs_count_out) {
+    assert(new_token_count && redir_specs_count_out);
+
+    int write_index = 0;
+    int spec_count = 0;
+
+    // Every operator yields at most two specs
+    RedirSpec *redir_specs = arena_alloc(arena, (2 * token_count + 1) * sizeof *redir_specs);
+    if (!redir_specs) {
+        perror("arena_alloc");
+        return NULL;
+    }
+
+    for (int i = 0; i < token_count; i++) {
+        int fd;
+        bool both;
+        const char *attached;
+        // A quoted ">" is a word that only looks like an operator
+        const RedirOp op =
+            operators[i] ? parse_operator(tokens[i], &fd, &both, &attached) : OP_NONE;
+
+        if (op == OP_NONE) {
+            // Never runs ahead of i, so compacting in place is safe
+            operators[write_index] = operators[i];
+            tokens[write_index++] = tokens[i];
+            continue;
+        }
+
+        char *word = (char *)attached;
+        if (*word == '\0') {
+            if (i + 1 >= token_count || operators[i + 1]) {
+                fprintf(stderr, "syntax error: expected file after '%s'\n", tokens[i]);
+                return NULL;
+            }
+            word = tokens[++i];
+        }
+
+        const bool explicit_fd = fd != -1;
+        if (!explicit_fd)
+            fd = op == OP_READ || op == OP_READ_WRITE || op == OP_DUP_IN || op == OP_HERE_DOC ||
+                         op == OP_HERE_STRING
+                     ? STDIN_FILENO
+                     : STDOUT_FILENO;
+
+        switch (op) {
+        case OP_READ:
+            redir_specs[spec_count++] = open_spec(fd, word, O_RDONLY);
+            break;
+        case OP_READ_WRITE:
+            redir_specs[spec_count++] = open_spec(fd, word, O_RDWR | O_CREAT);
+            break;
+        case OP_WRITE:
+        case OP_APPEND:
+            redir_specs[spec_count++] =
+                open_spec(fd, word, O_WRONLY | O_CREAT | (op == OP_APPEND ? O_APPEND : O_TRUNC));
+            if (both)
+                redir_specs[spec_count++] = dup_spec(STDERR_FILENO, STDOUT_FILENO);
+            break;
+        case OP_DUP_IN:
+        case OP_DUP_OUT:
+            if (!strcmp(word, "-")) {
+                redir_specs[spec_count++] = (RedirSpec){.kind = REDIR_CLOSE, .target_fd = fd};
+            } else if (is_fd_word(word)) {
+                if (strlen(word) > 1) {
+                    fprintf(stderr, "%s: bad file descriptor\n", word);
+                    return NULL;
+                }
+                redir_specs[spec_count++] = dup_spec(fd, word[0] - '0');
+            } else if (op == OP_DUP_OUT && !explicit_fd) {
+                // `>&file` is the old spelling of `&>file`
+                redir_specs[spec_count++] = open_spec(fd, word, O_WRONLY | O_CREAT | O_TRUNC);
+                redir_specs[spec_count++] = dup_spec(STDERR_FILENO, STDOUT_FILENO);
+            } else {
+                fprintf(stderr, "%s: ambiguous redirect\n", word);
+                return NULL;
+            }
+            break;
+        case OP_HERE_DOC:
+            // The tokenizer has already read the body and left its memfd's number as the word
+            if (!is_fd_word(word)) {
+                fprintf(stderr, "%s: here-document not available here\n", word);
+                return NULL;
+            }
+            redir_specs[spec_count++] =
+                (RedirSpec){.kind = REDIR_HERE, .target_fd = fd, .source_fd = atoi(word)};
+            break;
+        case OP_HERE_STRING: {
+            const int source_fd = here_string(word);
+            if (source_fd == -1)
+                return NULL;
+            redir_specs[spec_count++] =
+                (RedirSpec){.kind = REDIR_HERE, .target_fd = fd, .source_fd = source_fd};
+            break;
+        }
+        case OP_NONE:
+            break;
+        }
+    }
+
+    for (int i = write_index; i < token_count; i++)
+        tokens[i] = NULL;
+    *new_token_count = write_index;
+    *redir_specs_count_out = spec_count;
+
+    return redir_specs;
+}
+
+/**
+ * Resolves a builtin's redirections into @table without touching the shell's fds 0-2.
+ * Each file is opened once (close-on-exec, the shell never execs with them); duplications
+ * and closes only edit the table.
+ *
+ * @param arena   Allocator for the list of opened descriptors.
+ * @param table   Out: the builtin's descriptors. Release it when the builtin returns.
+ * @param specs   Redirections in the order they were written.
+ * @param count   Number of entries in specs.
+ * @param in_fd   When not -1, fd 0 before the redirections (pipeline wiring).
+ * @param out_fd  When not -1, fd 1 before the redirections (pipeline wiring).
+ * @return        false, with nothing left open, if a file could not be opened or a
+ *                duplicated fd is not open.
+ */
+bool build_redirection_table(Arena *arena, RedirFdTable *table, const RedirSpec specs[],
+                             const int count, const int in_fd, const int out_fd) {
+    for (int fd = 0; fd < REDIR_FD_LIMIT; fd++)
+        table->fds[fd] = fd <= STDERR_FILENO ? fd : -1;
+    if (in_fd != -1)
+        table->fds[STDIN_FILENO] = in_fd;
+    if (out_fd != -1)
+        table->fds[STDOUT_FILENO] = out_fd;
+
+    table->opened = NULL;
+    table->opened_count = 0;
+    if (count == 0)
+        return true;
+
+    table->opened = arena_alloc(arena, count * sizeof *table->opened);
+    if (!table->opened) {
+        perror("arena_alloc");
+        return false;
+    }
+
+    for (int i = 0; i < count; i++) {
+        const RedirSpec *spec = &specs[i];
+
+        switch (spec->kind) {
+        case REDIR_OPEN: {
+            const int fd = open(spec->filename, spec->open_flags | O_CLOEXEC, 0644);
+            if (fd == -1) {
+                fprintf(stderr, "%s: %s\n", spec->filename, strerror(errno));
+                release_redirection_table(table);
+                return false;
+            }
+            table->opened[table->opened_count++] = fd;
+            table->fds[spec->target_fd] = fd;
+            break;
+        }
+        case REDIR_DUP:
+            if (table->fds[spec->source_fd] == -1) {
+                fprintf(stderr, "%d: bad file descriptor\n", spec->source_fd);
+                release_redirection_table(table);
+                return false;
+            }
+            table->fds[spec->target_fd] = table->fds[spec->source_fd];
+            break;
+        case REDIR_CLOSE:
+            table->fds[spec->target_fd] = -1;
+            break;
+        case REDIR_HERE:
+            table->fds[spec->target_fd] = spec->source_fd;
+            break;
+        }
+    }
+
+    return true;
+}
+
+void release_redirection_table(RedirFdTable *table) {
+    for (int i = 0; i < table->opened_count; i++)
+        close(table->opened[i]);
+    table->opened_count = 0;
+}
+
+/**
+ * Applies @specs to the calling process's real descriptors with open()/dup2()/close().
+ * Only for a forked child that is about to exec; the shell itself uses
+ * build_redirection_table() and posix_spawn() uses file actions.
+ */
+bool apply_all_redirection(const RedirSpec specs[], const int count) {
+    for (int i = 0; i < count; i++) {
+        const RedirSpec *spec = &specs[i];
+
+        switch (spec->kind) {
+        case REDIR_OPEN: {
+            const int fd = open(spec->filename, spec->open_flags, 0644);
+            if (fd == -1) {
+                perror(spec->filename);
+                return false;
+            }
+            if (fd != spec->target_fd) {
+                if (dup2(fd, spec->target_fd) == -1) {
+                    perror("dup2");
+                    close(fd);
+                    return false;
+                }
+                close(fd);
+            }
+            break;
+        }
+        case REDIR_DUP:
+        case REDIR_HERE:
+            if (spec->source_fd != spec->target_fd &&
+                dup2(spec->source_fd, spec->target_fd) == -1) {
+                perror("dup2");
+                return false;
+            }
+            break;
+        case REDIR_CLOSE:
+            close(spec->target_fd);
+            break;
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,67 @@
+#ifndef REDIRECTION_H
+#define REDIRECTION_H
+#include "arena.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// File descriptors 0-9 can be redirected, like in dash; enough for `3>log 2>&3` style uses
+#define REDIR_FD_LIMIT 10
+
+/**
+ * REDIR_OPEN   Open filename onto target_fd (`N>file`, `N>>file`, `N<file`, `N<>file`).
+ * REDIR_DUP    Make target_fd a copy of source_fd (`N>&M`, `N<&M`).
+ * REDIR_CLOSE  Close target_fd (`N>&-`, `N<&-`).
+ * REDIR_HERE   Make target_fd read the here-document or here-string in source_fd, a sealed
+ *              memfd the shell holds until release_here_documents() (`N<<EOF`, `N<<<word`).
+ */
+typedef enum { REDIR_OPEN, REDIR_DUP, REDIR_CLOSE, REDIR_HERE } RedirKind;
+
+/**
+ * One redirection operation. A command's redirections are applied in the order they were
+ * written, so `>out 2>&1` and `2>&1 >out` mean different things.
+ *
+ * @kind        What to do with target_fd.
+ * @target_fd   The file descriptor being redirected (e.g. STDOUT_FILENO).
+ * @source_fd   REDIR_DUP and REDIR_HERE: the descriptor target_fd becomes a copy of.
+ * @filename    REDIR_OPEN only: the target word; lives in the command's arena.
+ * @open_flags  REDIR_OPEN only: flags passed to open(), e.g. O_WRONLY|O_CREAT|O_TRUNC.
+ */
+typedef struct {
+    RedirKind kind;
+    int target_fd;
+    int source_fd;
+    char *filename;
+    int open_flags;
+} RedirSpec;
+
+/**
+ * The descriptors a builtin sees, after its redirections.
+ *
+ * Builtins never have their redirections applied to the shell's own fds 0-2. Instead each
+ * redirectable fd is mapped to a real descriptor: files are opened once, `N>&M` only copies
+ * a table entry, and nothing has to be restored afterwards.
+ *
+ * @fds           Real descriptor behind fd 0..REDIR_FD_LIMIT-1, or -1 if closed.
+ * @opened        Descriptors opened for this command, closed by release_redirection_table().
+ * @opened_count  Number of entries in opened.
+ */
+typedef struct {
+    int fds[REDIR_FD_LIMIT];
+    int *opened;
+    int opened_count;
+} RedirFdTable;
+
+RedirSpec *extract_redirection(Arena *arena, char *tokens[], bool operators[], int token_count,
+                               int *new_token_count, int *redir_specs_count_out);
+bool build_redirection_table(Arena *arena, RedirFdTable *table, const RedirSpec specs[],
+                             int count, int in_fd, int out_fd);
+void release_redirection_table(RedirFdTable *table);
+bool apply_all_redirection(const RedirSpec specs[], int count);
+
+int here_document_create(void);
+bool here_document_write(int fd, const char *data, size_t len);
+bool here_document_seal(int fd);
+void release_here_documents(void);
+
+#endif // REDIRECTION_H
@@ -0,0 +1,234 @@
+#define _GNU_SOURCE // accept4(), MSG_CMSG_CLOEXEC
+#include "serve.h"
+#include "jobs.h"
+#include "path_utils.h"
+#include "trace.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "memstats.h"
+
+/**
+ * Reads exactly @len bytes.
+ *
+ * @return  false on error or if the peer closed the connection first.
+ */
+static bool read_full(const int fd, void *buf, size_t len) {
+    char *p = buf;
+    while (len > 0) {
+        const ssize_t n = read(fd, p, len);
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+/**
+ * Receives the length word of a request together with the descriptors attached to it.
+ *
+ * @param fds  Out: the client's stdin, stdout and stderr (close-on-exec).
+ * @return     1 for a request, 0 if the client closed the connection, -1 for a malformed
+ *             request (nothing is left open).
+ */
+static int receive_header(const int conn, uint32_t *len_out, int fds[3]) {
+    union {
+        char buf[CMSG_SPACE(3 * sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    struct iovec iov = {.iov_base = len_out, .iov_len = sizeof *len_out};
+    struct msghdr msg = {.msg_iov = &iov,
+                         .msg_iovlen = 1,
+                         .msg_control = control.buf,
+                         .msg_controllen = sizeof(control.buf)};
+
+    ssize_t n;
+    do {
+        n = recvmsg(conn, &msg, MSG_CMSG_CLOEXEC);
+    } while (n == -1 && errno == EINTR);
+    if (n <= 0)
+        return n == 0 ? 0 : -1;
+
+    int count = 0;
+    for (struct cmsghdr *c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg, c)) {
+        if (c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_RIGHTS)
+            continue;
+        const size_t received = (c->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        for (size_t i = 0; i < received; i++) {
+            int fd;
+            memcpy(&fd, CMSG_DATA(c) + i * sizeof(int), sizeof fd);
+            if (count < 3)
+                fds[count++] = fd;
+            else
+                close(fd);
+        }
+    }
+
+    // The rest of the length word may come in a later segment
+    const bool ok = count == 3 && !(msg.msg_flags & MSG_CTRUNC) &&
+                    read_full(conn, (char *)len_out + n, sizeof *len_out - n) &&
+                    *len_out <= SERVE_MAX_SCRIPT;
+    if (!ok) {
+        for (int i = 0; i < count; i++)
+            close(fds[i]);
+        return -1;
+    }
+    return 1;
+}
+
+/**
+ * Runs a connection's requests one after another, in a process of its own. Variables, the
+ * cwd and the PATH cache carry over from one request to the next, like lines typed into
+ * one shell.
+ */
+static void serve_connection(const int conn, const ServeScriptFn run_script) {
+    const int null_fd = open("/dev/null", O_RDWR | O_CLOEXEC);
+    char *script = NULL;
+    size_t capacity = 0;
+
+    while (1) {
+        uint32_t len;
+        int fds[3];
+        const int received = receive_header(conn, &len, fds);
+        if (received < 0)
+            fprintf(stderr, "sleepyshell: --serve: malformed request\n");
+        if (received <= 0)
+            break;
+
+        if (len + 1 > capacity) {
+            char *grown = realloc(script, len + 1);
+            if (!grown) {
+                perror("realloc");
+                break;
+            }
+            script = grown;
+            capacity = len + 1;
+        }
+        if (!read_full(conn, script, len)) {
+            for (int fd = 0; fd < 3; fd++)
+                close(fds[fd]);
+            break;
+        }
+        script[len] = '\0';
+
+        // The script runs with the client's descriptors as its own 0-2
+        for (int fd = 0; fd < 3; fd++) {
+            dup2(fds[fd], fd);
+            close(fds[fd]);
+        }
+
+        const int32_t status = run_script(script, len);
+        fflush(stdout);
+        fflush(stderr);
+
+        // Let go of the client's descriptors, so a pipe it reads from sees EOF
+        for (int fd = 0; null_fd != -1 && fd < 3; fd++)
+            dup2(null_fd, fd);
+
+        if (send(conn, &status, sizeof status, MSG_NOSIGNAL) != sizeof status)
+            break;
+    }
+
+    free(script);
+}
+
+/**
+ * Starts tracing a connection process into @trace_path.<pid>. The server itself runs no
+ * commands and is only ever killed, so each connection writes, and finishes, its own file.
+ */
+static void trace_connection(const char *trace_path) {
+    char path[4096];
+    if (snprintf(path, sizeof(path), "%s.%d", trace_path, (int)getpid()) >= (int)sizeof(path))
+        return;
+    if (!trace_open(path))
+        fprintf(stderr, "sleepyshell: %s: %s\n", path, strerror(errno));
+}
+
+/**
+ * Serves scripts sent to a Unix domain socket at @socket_path until the process is killed.
+ *
+ * Every connection is handled by a forked copy of the server, so connections run
+ * concurrently, start from the server's warm state (variables, the cached envp, PATH cache)
+ * without paying for startup, and cannot disturb each other. The server runs no commands
+ * itself, so it fills its PATH cache with every executable before accepting; a connection's
+ * own lookups, and anything else it changes, last only until it closes.
+ *
+ * @param trace_path  When not NULL, each connection is traced into a file of its own, named
+ *                    after it with the connection process's pid appended.
+ * @return            Exit status for the shell, if the socket cannot be set up or accept()
+ *                    fails.
+ */
+int serve_run(const char *socket_path, const char *trace_path, const ServeScriptFn run_script) {
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    const size_t path_len = strlen(socket_path);
+    if (path_len >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "sleepyshell: %s: socket path too long\n", socket_path);
+        return 2;
+    }
+    memcpy(addr.sun_path, socket_path, path_len + 1);
+
+    const int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listener == -1) {
+        perror("socket");
+        return 1;
+    }
+
+    // A socket left behind by an earlier server is replaced; any other file is kept
+    struct stat st;
+    if (lstat(socket_path, &st) == 0 && S_ISSOCK(st.st_mode))
+        unlink(socket_path);
+
+    if (bind(listener, (struct sockaddr *)&addr, sizeof(addr)) == -1 ||
+        listen(listener, SOMAXCONN) == -1) {
+        fprintf(stderr, "sleepyshell: %s: %s\n", socket_path, strerror(errno));
+        close(listener);
+        return 1;
+    }
+
+    util_path_cache_fill();
+
+    // Finished connection processes are reaped by the kernel
+    struct sigaction sa = {.sa_handler = SIG_DFL, .sa_flags = SA_NOCLDWAIT};
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGCHLD, &sa, NULL);
+
+    while (1) {
+        const int conn = accept4(listener, NULL, NULL, SOCK_CLOEXEC);
+        if (conn == -1) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            perror("accept4");
+            close(listener);
+            return 1;
+        }
+
+        const pid_t pid = fork();
+        if (pid == 0) {
+            close(listener);
+            // The connection waits for its own commands; this replaces the reaping above
+            if (!jobs_init(false))
+                _exit(1);
+            if (trace_path)
+                trace_connection(trace_path);
+            serve_connection(conn, run_script);
+            trace_close();
+            _exit(0);
+        }
+        if (pid == -1)
+            perror("fork");
+        close(conn);
+    }
+}
@@ -0,0 +1,36 @@
+#ifndef SERVE_H
+#define SERVE_H
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * Server mode protocol, over a SOCK_STREAM Unix domain socket. A connection carries any
+ * number of requests, one at a time.
+ *
+ * Request:   a uint32_t script length in host byte order, then the script (one or more
+ *            command lines). The first byte of the length carries SCM_RIGHTS with exactly
+ *            three descriptors: the stdin, stdout and stderr the script runs with.
+ * Response:  an int32_t exit status in host byte order, sent once the script has finished
+ *            and its output has been flushed.
+ *
+ * Output goes straight to the client's descriptors, so it needs no framing and is never
+ * copied through the socket.
+ */
+
+// Longest script a request may carry
+#define SERVE_MAX_SCRIPT (16u << 20)
+
+/**
+ * Runs @script (@len bytes, NUL-terminated) in the connection's session.
+ *
+ * @return  Exit status of the last command.
+ */
+typedef int (*ServeScriptFn)(const char *script, size_t len);
+
+int serve_run(const char *socket_path, const char *trace_path, ServeScriptFn run_script);
+
+int serve_connect(const char *socket_path);
+bool serve_send_request(int sock, const char *script, size_t len, const int fds[3]);
+bool serve_read_status(int sock, int *status_out);
+
+#endif // SERVE_H
@@ -0,0 +1,111 @@
+#define _POSIX_C_SOURCE 200809L
+#include "serve.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/**
+ * Connects to a sleepyshell --serve socket.
+ *
+ * @return  The connected socket, or -1 with errno set.
+ */
+int serve_connect(const char *socket_path) {
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    const size_t path_len = strlen(socket_path);
+    if (path_len >= sizeof(addr.sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    memcpy(addr.sun_path, socket_path, path_len + 1);
+
+    const int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock == -1)
+        return -1;
+    if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+        const int err = errno;
+        close(sock);
+        errno = err;
+        return -1;
+    }
+    return sock;
+}
+
+/**
+ * Sends @script (@len bytes) to run with @fds as its stdin, stdout and stderr.
+ *
+ * @return  false with errno set if the request could not be sent in full.
+ */
+bool serve_send_request(const int sock, const char *script, const size_t len, const int fds[3]) {
+    if (len > SERVE_MAX_SCRIPT) {
+        errno = E2BIG;
+        return false;
+    }
+
+    union {
+        char buf[CMSG_SPACE(3 * sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    memset(&control, 0, sizeof(control));
+
+    uint32_t header = len;
+    struct iovec iov[2] = {{.iov_base = &header, .iov_len = sizeof header},
+                           {.iov_base = (void *)script, .iov_len = len}};
+    struct msghdr msg = {.msg_iov = iov,
+                         .msg_iovlen = 2,
+                         .msg_control = control.buf,
+                         .msg_controllen = sizeof(control.buf)};
+    struct cmsghdr *c = CMSG_FIRSTHDR(&msg);
+    c->cmsg_level = SOL_SOCKET;
+    c->cmsg_type = SCM_RIGHTS;
+    c->cmsg_len = CMSG_LEN(3 * sizeof(int));
+    memcpy(CMSG_DATA(c), fds, 3 * sizeof(int));
+
+    ssize_t sent;
+    do {
+        sent = sendmsg(sock, &msg, MSG_NOSIGNAL);
+    } while (sent == -1 && errno == EINTR);
+    if (sent == -1)
+        return false;
+
+    // The descriptors went with the first byte; a long script may need more sends
+    size_t done = sent;
+    const size_t total = sizeof header + len;
+    while (done < total) {
+        const char *p = done < sizeof header ? (const char *)&header + done
+                                             : script + (done - sizeof header);
+        const size_t n = done < sizeof header ? sizeof header - done : total - done;
+        const ssize_t w = send(sock, p, n, MSG_NOSIGNAL);
+        if (w == -1 && errno == EINTR)
+            continue;
+        if (w == -1)
+            return false;
+        done += w;
+    }
+    return true;
+}
+
+/**
+ * Waits for the exit status of the last request.
+ *
+ * @return  false if the server closed the connection (e.g. the script ran `exit`) or on error.
+ */
+bool serve_read_status(const int sock, int *status_out) {
+    int32_t status;
+    char *p = (char *)&status;
+    size_t left = sizeof status;
+    while (left > 0) {
+        const ssize_t n = read(sock, p, left);
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        p += n;
+        left -= n;
+    }
+    *status_out = status;
+    return true;
+}
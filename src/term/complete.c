@@ -0,0 +1,486 @@
+// inotify, and getdents64 through syscall()
+#define _GNU_SOURCE
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "../path_utils.h"
+#include "../vars.h"
+#include "complete.h"
+
+#include "../memstats.h"
+
+// PATH directories past this many are not offered for completion
+#define COMPLETE_MAX_DIRS 64
+#define DENTS_BUFFER_SIZE 32768
+#define WATCH_MASK                                                                             \
+    (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB | IN_DELETE_SELF |        \
+     IN_MOVE_SELF)
+
+struct linux_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+typedef void (*DentVisitor)(const char *name, unsigned char type, void *ctx);
+
+/**
+ * Lists @dir_fd with getdents64(), a batch of entries per syscall, calling @visit for every
+ * entry except "." and "..".
+ */
+static void scan_dir(const int dir_fd, DentVisitor visit, void *ctx) {
+    static char buf[DENTS_BUFFER_SIZE];
+
+    while (true) {
+        const long n = syscall(SYS_getdents64, dir_fd, buf, sizeof(buf));
+        if (n <= 0)
+            return;
+
+        for (long off = 0; off < n;) {
+            const struct linux_dirent64 *d = (const struct linux_dirent64 *)(buf + off);
+            off += d->d_reclen;
+
+            const char *name = d->d_name;
+            if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+                continue;
+            visit(name, d->d_type, ctx);
+        }
+    }
+}
+
+/**
+ * A node of the executable-name trie. Siblings are kept sorted by @c so a walk yields names
+ * in bytewise order. Nodes live in one array and link by index; index 0 is the root.
+ *
+ * @child    First child, 0 if none.
+ * @sibling  Next sibling, 0 if none.
+ * @count    Names in this subtree that exist in at least one PATH directory.
+ * @dirs     Bit i set if PATH directory i holds an executable with the name ending here.
+ * @c        The byte this node adds to its parent's prefix.
+ */
+typedef struct {
+    uint32_t child;
+    uint32_t sibling;
+    uint32_t count;
+    uint64_t dirs;
+    unsigned char c;
+} TrieNode;
+
+/**
+ * Every executable on PATH, kept current by inotify instead of rescans.
+ *
+ * @path_value  $PATH the trie was built from, NULL if it has not been built.
+ * @dirs        The watched PATH directories; @watches holds each one's watch descriptor.
+ * @notify_fd   Non-blocking inotify instance, drained before each completion.
+ */
+static struct {
+    TrieNode *nodes;
+    uint32_t node_count;
+    uint32_t node_cap;
+    char *path_value;
+    char *dirs[COMPLETE_MAX_DIRS];
+    int watches[COMPLETE_MAX_DIRS];
+    size_t dir_count;
+    int notify_fd;
+    bool stale;
+} trie = {.notify_fd = -1};
+
+static uint32_t trie_new_node(const unsigned char c) {
+    if (trie.node_count == trie.node_cap) {
+        const uint32_t cap = trie.node_cap ? trie.node_cap * 2 : 4096;
+        TrieNode *grown = realloc(trie.nodes, cap * sizeof(*grown));
+        if (!grown)
+            return 0;
+        trie.nodes = grown;
+        trie.node_cap = cap;
+    }
+
+    trie.nodes[trie.node_count] = (TrieNode){.c = c};
+    return trie.node_count++;
+}
+
+static uint32_t trie_find_child(const uint32_t node, const unsigned char c) {
+    for (uint32_t child = trie.nodes[node].child; child; child = trie.nodes[child].sibling) {
+        if (trie.nodes[child].c == c)
+            return child;
+        if (trie.nodes[child].c > c)
+            break;
+    }
+    return 0;
+}
+
+static uint32_t trie_insert_child(const uint32_t node, const unsigned char c) {
+    uint32_t *link = &trie.nodes[node].child;
+    while (*link && trie.nodes[*link].c < c)
+        link = &trie.nodes[*link].sibling;
+    if (*link && trie.nodes[*link].c == c)
+        return *link;
+
+    const uint32_t child = trie_new_node(c);
+    if (!child)
+        return 0;
+
+    // trie_new_node() may have moved the array, so find the link again
+    link = &trie.nodes[node].child;
+    while (*link && trie.nodes[*link].c < c)
+        link = &trie.nodes[*link].sibling;
+    trie.nodes[child].sibling = *link;
+    *link = child;
+    return child;
+}
+
+/**
+ * Records whether PATH directory @dir holds an executable called @name, keeping the
+ * subtree counts in step when the name appears or disappears altogether.
+ */
+static void trie_set(const char *name, const size_t dir, const bool present) {
+    uint32_t path[NAME_MAX + 1];
+    size_t depth = 0;
+    uint32_t node = 0;
+
+    path[depth++] = 0;
+    for (const unsigned char *p = (const unsigned char *)name; *p && depth <= NAME_MAX; p++) {
+        node = present ? trie_insert_child(node, *p) : trie_find_child(node, *p);
+        if (!node)
+            return;
+        path[depth++] = node;
+    }
+
+    const uint64_t bit = UINT64_C(1) << dir;
+    const bool was = trie.nodes[node].dirs != 0;
+    if (present)
+        trie.nodes[node].dirs |= bit;
+    else
+        trie.nodes[node].dirs &= ~bit;
+
+    const bool is = trie.nodes[node].dirs != 0;
+    if (was == is)
+        return;
+    for (size_t i = 0; i < depth; i++)
+        trie.nodes[path[i]].count += is ? 1 : (uint32_t)-1;
+}
+
+static bool is_executable(const int dir_fd, const char *name, const unsigned char type) {
+    if (type == DT_DIR)
+        return false;
+
+    struct stat st;
+    if (type != DT_REG && (fstatat(dir_fd, name, &st, 0) != 0 || !S_ISREG(st.st_mode)))
+        return false;
+    return faccessat(dir_fd, name, X_OK, 0) == 0;
+}
+
+typedef struct {
+    int dir_fd;
+    size_t index;
+} DirScan;
+
+static void add_if_executable(const char *name, const unsigned char type, void *ctx) {
+    const DirScan *scan = ctx;
+    if (is_executable(scan->dir_fd, name, type))
+        trie_set(name, scan->index, true);
+}
+
+static void watch_and_scan(const char *dir, const size_t index, void *ctx) {
+    (void)ctx;
+    if (index >= COMPLETE_MAX_DIRS)
+        return;
+
+    trie.dirs[index] = strdup(dir);
+    trie.watches[index] = trie.notify_fd == -1
+                              ? -1
+                              : inotify_add_watch(trie.notify_fd, dir, WATCH_MASK | IN_ONLYDIR);
+    if (index >= trie.dir_count)
+        trie.dir_count = index + 1;
+
+    DirScan scan = {.dir_fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC), .index = index};
+    if (scan.dir_fd == -1)
+        return;
+    scan_dir(scan.dir_fd, add_if_executable, &scan);
+    close(scan.dir_fd);
+}
+
+static void trie_clear(void) {
+    if (trie.notify_fd != -1)
+        close(trie.notify_fd);
+    trie.notify_fd = -1;
+
+    for (size_t i = 0; i < trie.dir_count; i++) {
+        free(trie.dirs[i]);
+        trie.dirs[i] = NULL;
+    }
+    trie.dir_count = 0;
+
+    free(trie.path_value);
+    trie.path_value = NULL;
+    trie.node_count = 0;
+}
+
+/**
+ * Scans every PATH directory once and starts watching them. Only a different $PATH or a
+ * lost watch (a directory removed or renamed, or the event queue overflowing) brings this
+ * back; everything else arrives as single-name inotify events.
+ */
+static bool trie_build(const char *path) {
+    trie_clear();
+
+    trie.path_value = strdup(path);
+    if (!trie.path_value)
+        return false;
+
+    // The root
+    trie_new_node(0);
+    if (trie.node_count == 0)
+        return false;
+
+    trie.notify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    trie.stale = false;
+    for (size_t i = 0; i < COMPLETE_MAX_DIRS; i++)
+        trie.watches[i] = -1;
+
+    return util_path_foreach_dir(watch_and_scan, NULL);
+}
+
+static void apply_event(const struct inotify_event *event) {
+    if (event->mask & (IN_Q_OVERFLOW | IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) {
+        trie.stale = true;
+        return;
+    }
+
+    size_t dir = 0;
+    while (dir < trie.dir_count && trie.watches[dir] != event->wd)
+        dir++;
+    if (dir == trie.dir_count || event->len == 0)
+        return;
+
+    if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+        trie_set(event->name, dir, false);
+        return;
+    }
+
+    // Created, moved in or chmod'ed: ask the file system what it is now
+    const int dir_fd = open(trie.dirs[dir], O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir_fd == -1)
+        return;
+    trie_set(event->name, dir, is_executable(dir_fd, event->name, DT_UNKNOWN));
+    close(dir_fd);
+}
+
+static void drain_events(void) {
+    _Alignas(struct inotify_event) char buf[4096];
+
+    while (trie.notify_fd != -1) {
+        const ssize_t n = read(trie.notify_fd, buf, sizeof(buf));
+        if (n <= 0)
+            return;
+
+        for (ssize_t off = 0; off < n;) {
+            const struct inotify_event *event = (const struct inotify_event *)(buf + off);
+            apply_event(event);
+            off += sizeof(*event) + event->len;
+        }
+    }
+}
+
+static bool trie_refresh(void) {
+    const char *path = vars_get("PATH");
+    if (!path)
+        return false;
+
+    drain_events();
+    if (!trie.path_value || trie.stale || strcmp(trie.path_value, path) != 0)
+        return trie_build(path);
+    return true;
+}
+
+typedef struct {
+    Arena *arena;
+    Completions *out;
+    char name[NAME_MAX + 1];
+} TrieWalk;
+
+static void collect_names(TrieWalk *walk, const uint32_t node, const size_t depth) {
+    for (uint32_t child = trie.nodes[node].child; child; child = trie.nodes[child].sibling) {
+        if (walk->out->count == COMPLETION_LIST_LIMIT || depth >= NAME_MAX)
+            return;
+
+        const TrieNode *n = &trie.nodes[child];
+        if (n->count == 0)
+            continue;
+
+        walk->name[depth] = (char)n->c;
+        if (n->dirs) {
+            char *name = arena_strndup(walk->arena, walk->name, depth + 1);
+            if (name)
+                walk->out->items[walk->out->count++] = name;
+        }
+        collect_names(walk, child, depth + 1);
+    }
+}
+
+/**
+ * Completes @prefix against the executables on PATH. The answer comes from the trie alone:
+ * no directory is read unless PATH itself changed.
+ */
+bool complete_command(Arena *arena, const char *prefix, const size_t len, Completions *out) {
+    *out = (Completions){0};
+    if (len > NAME_MAX || !trie_refresh() || trie.node_count == 0)
+        return false;
+
+    uint32_t node = 0;
+    for (size_t i = 0; i < len; i++) {
+        node = trie_find_child(node, (unsigned char)prefix[i]);
+        if (!node)
+            return true;
+    }
+    if (trie.nodes[node].count == 0)
+        return true;
+
+    TrieWalk *walk = arena_alloc(arena, sizeof(*walk));
+    out->items = arena_alloc(arena, COMPLETION_LIST_LIMIT * sizeof(*out->items));
+    if (!walk || !out->items)
+        return false;
+
+    walk->arena = arena;
+    walk->out = out;
+    memcpy(walk->name, prefix, len);
+
+    // The shared prefix runs on while exactly one name continues it
+    size_t common = len;
+    uint32_t at = node;
+    while (!trie.nodes[at].dirs && common < NAME_MAX) {
+        uint32_t only = 0;
+        for (uint32_t child = trie.nodes[at].child; child; child = trie.nodes[child].sibling) {
+            if (trie.nodes[child].count == trie.nodes[at].count)
+                only = child;
+        }
+        if (!only)
+            break;
+        walk->name[common++] = (char)trie.nodes[only].c;
+        at = only;
+    }
+    out->common = arena_strndup(arena, walk->name, common);
+
+    out->total = trie.nodes[node].count;
+    if (trie.nodes[node].dirs && (out->items[out->count] = arena_strndup(arena, prefix, len)))
+        out->count++;
+    collect_names(walk, node, len);
+    return out->common != NULL;
+}
+
+typedef struct {
+    Arena *arena;
+    int dir_fd;
+    const char *dir;
+    size_t dir_len;
+    const char *base;
+    size_t base_len;
+    char **matches;
+    size_t count;
+    size_t cap;
+    bool failed;
+} FileScan;
+
+static void add_if_matching(const char *name, const unsigned char type, void *ctx) {
+    FileScan *scan = ctx;
+    if (strncmp(name, scan->base, scan->base_len) != 0)
+        return;
+    // Hidden files only when the word asks for them
+    if (name[0] == '.' && scan->base_len == 0)
+        return;
+
+    bool is_dir = type == DT_DIR;
+    struct stat st;
+    if ((type == DT_LNK || type == DT_UNKNOWN) && fstatat(scan->dir_fd, name, &st, 0) == 0)
+        is_dir = S_ISDIR(st.st_mode);
+
+    if (scan->count == scan->cap) {
+        const size_t cap = scan->cap ? scan->cap * 2 : 64;
+        char **grown = arena_grow(scan->arena, scan->matches, scan->cap * sizeof(*grown),
+                                  cap * sizeof(*grown));
+        if (!grown) {
+            scan->failed = true;
+            return;
+        }
+        scan->matches = grown;
+        scan->cap = cap;
+    }
+
+    const size_t name_len = strlen(name);
+    char *match = arena_alloc(scan->arena, scan->dir_len + name_len + 2);
+    if (!match) {
+        scan->failed = true;
+        return;
+    }
+    memcpy(match, scan->dir, scan->dir_len);
+    memcpy(match + scan->dir_len, name, name_len);
+    match[scan->dir_len + name_len] = is_dir ? '/' : '\0';
+    match[scan->dir_len + name_len + 1] = '\0';
+    scan->matches[scan->count++] = match;
+}
+
+static int compare_strings(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/**
+ * Completes @word as a path: the part up to its last '/' names the directory to list (the
+ * current one if there is none) and the rest is the prefix to match.
+ */
+bool complete_file(Arena *arena, const char *word, const size_t len, Completions *out) {
+    *out = (Completions){0};
+
+    const char *slash = memrchr(word, '/', len);
+    FileScan scan = {.arena = arena, .dir = word};
+    scan.dir_len = slash ? (size_t)(slash - word) + 1 : 0;
+    scan.base = word + scan.dir_len;
+    scan.base_len = len - scan.dir_len;
+
+    const char *dir = scan.dir_len ? arena_strndup(arena, word, scan.dir_len) : ".";
+    if (!dir)
+        return false;
+
+    scan.dir_fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (scan.dir_fd == -1)
+        return true;
+    scan_dir(scan.dir_fd, add_if_matching, &scan);
+    close(scan.dir_fd);
+    if (scan.failed)
+        return false;
+    if (scan.count == 0)
+        return true;
+
+    qsort(scan.matches, scan.count, sizeof(*scan.matches), compare_strings);
+
+    // Sorted, so the first and last match bound the common prefix of all of them
+    const char *first = scan.matches[0];
+    const char *last = scan.matches[scan.count - 1];
+    size_t common = 0;
+    while (first[common] && first[common] == last[common])
+        common++;
+
+    out->items = scan.matches;
+    out->count = scan.count < COMPLETION_LIST_LIMIT ? scan.count : COMPLETION_LIST_LIMIT;
+    out->total = scan.count;
+    out->common = arena_strndup(arena, first, common);
+    return out->common != NULL;
+}
+
+void complete_shutdown(void) {
+    trie_clear();
+    free(trie.nodes);
+    trie.nodes = NULL;
+    trie.node_cap = 0;
+}
@@ -0,0 +1,31 @@
+#ifndef COMPLETE_H
+#define COMPLETE_H
+#include "../arena.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// At most this many matches are collected for listing; the rest are only counted
+#define COMPLETION_LIST_LIMIT 256
+
+/**
+ * Matches for a word being completed.
+ *
+ * @items   Up to COMPLETION_LIST_LIMIT whole replacement words, sorted bytewise. Directory
+ *          matches end in '/'.
+ * @count   Entries in @items.
+ * @total   Matches in all, which can be more than @count.
+ * @common  Longest prefix shared by every match; the word can be replaced by it.
+ */
+typedef struct {
+    char **items;
+    size_t count;
+    size_t total;
+    char *common;
+} Completions;
+
+bool complete_command(Arena *arena, const char *prefix, size_t len, Completions *out);
+bool complete_file(Arena *arena, const char *word, size_t len, Completions *out);
+void complete_shutdown(void);
+
+#endif // COMPLETE_H
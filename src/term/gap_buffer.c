@@ -0,0 +1,183 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gap_buffer.h"
+
+#include "../memstats.h"
+
+static size_t gap_size(const GapBuffer *gb) { return gb->gap_end - gb->gap_start; }
+
+/**
+ * Makes room for @extra more bytes in the gap. The text after the gap moves to the end of
+ * the grown buffer.
+ */
+bool gap_buffer_reserve(GapBuffer *gb, const size_t extra) {
+    // One spare byte for the terminating NUL
+    if (gap_size(gb) > extra)
+        return true;
+
+    size_t capacity = gb->capacity ? gb->capacity * 2 : 256;
+    while (capacity <= gb->length + extra)
+        capacity *= 2;
+
+    unsigned char *grown = realloc(gb->buffer, capacity);
+    if (!grown)
+        return false;
+
+    const size_t tail = gb->capacity - gb->gap_end;
+    memmove(grown + capacity - tail, grown + gb->gap_end, tail);
+    gb->buffer = grown;
+    gb->capacity = capacity;
+    gb->gap_end = capacity - tail;
+    return true;
+}
+
+/**
+ * Moves the gap to text index @pos, copying only the bytes between the two.
+ */
+void gap_buffer_move_gap(GapBuffer *gb, const size_t pos) {
+    if (pos < gb->gap_start) {
+        const size_t n = gb->gap_start - pos;
+        memmove(gb->buffer + gb->gap_end - n, gb->buffer + pos, n);
+        gb->gap_start -= n;
+        gb->gap_end -= n;
+    } else if (pos > gb->gap_start) {
+        const size_t n = pos - gb->gap_start;
+        memmove(gb->buffer + gb->gap_start, gb->buffer + gb->gap_end, n);
+        gb->gap_start += n;
+        gb->gap_end += n;
+    }
+}
+
+unsigned char gap_buffer_at(const GapBuffer *gb, const size_t i) {
+    return gb->buffer[i < gb->gap_start ? i : i + gap_size(gb)];
+}
+
+/**
+ * Copies @n bytes of text starting at index @from to @dst, across the gap.
+ */
+void gap_buffer_copy(const GapBuffer *gb, size_t from, size_t n, unsigned char *dst) {
+    if (from < gb->gap_start) {
+        const size_t before = n < gb->gap_start - from ? n : gb->gap_start - from;
+        memcpy(dst, gb->buffer + from, before);
+        dst += before;
+        from += before;
+        n -= before;
+    }
+    memcpy(dst, gb->buffer + from + gap_size(gb), n);
+}
+
+/**
+ * @return  The whole text, contiguous and NUL-terminated. Closes the gap by moving it to the
+ *          end, so it is for whole-line uses (history, the finished line), not per key.
+ */
+const unsigned char *gap_buffer_text(GapBuffer *gb) {
+    if (!gb->buffer && !gap_buffer_reserve(gb, 0))
+        return (const unsigned char *)"";
+
+    gap_buffer_move_gap(gb, gb->length);
+    gb->buffer[gb->length] = '\0';
+    return gb->buffer;
+}
+
+void gap_buffer_set(GapBuffer *gb, const void *text, const size_t n) {
+    gb->length = 0;
+    gb->cursor_pos = 0;
+    gb->gap_start = 0;
+    gb->gap_end = gb->capacity;
+    gap_buffer_insert(gb, text, n);
+}
+
+void gap_buffer_insert(GapBuffer *gb, const unsigned char *text, const size_t n) {
+    if (n == 0 || !gap_buffer_reserve(gb, n))
+        return;
+
+    gap_buffer_move_gap(gb, gb->cursor_pos);
+    memcpy(gb->buffer + gb->gap_start, text, n);
+    gb->gap_start += n;
+    gb->length += n;
+    gb->cursor_pos += n;
+}
+
+// Deletes up to @n bytes before the cursor
+void gap_buffer_delete_before(GapBuffer *gb, size_t n) {
+    if (n > gb->cursor_pos)
+        n = gb->cursor_pos;
+
+    gap_buffer_move_gap(gb, gb->cursor_pos);
+    gb->gap_start -= n;
+    gb->length -= n;
+    gb->cursor_pos -= n;
+}
+
+// Deletes up to @n bytes after the cursor
+void gap_buffer_delete_after(GapBuffer *gb, size_t n) {
+    if (n > gb->length - gb->cursor_pos)
+        n = gb->length - gb->cursor_pos;
+
+    gap_buffer_move_gap(gb, gb->cursor_pos);
+    gb->gap_end += n;
+    gb->length -= n;
+}
+
+/**
+ * Cuts [@from, @to) from @gb, which has the cursor at one end of the range, into @killed.
+ *
+ * @param append  Add to what the previous key killed instead of replacing it. Killing
+ *                backwards puts the text in front of it, killing forwards after it.
+ */
+void gap_buffer_kill(GapBuffer *gb, const size_t from, const size_t to, GapBuffer *killed,
+                     const bool append) {
+    if (from == to)
+        return;
+
+    const size_t n = to - from;
+    const bool backward = from < gb->cursor_pos;
+    if (!append)
+        gap_buffer_set(killed, NULL, 0);
+
+    killed->cursor_pos = backward ? 0 : killed->length;
+    if (!gap_buffer_reserve(killed, n))
+        return;
+    gap_buffer_move_gap(killed, killed->cursor_pos);
+    gap_buffer_copy(gb, from, n, killed->buffer + killed->gap_start);
+    killed->gap_start += n;
+    killed->length += n;
+
+    if (backward)
+        gap_buffer_delete_before(gb, n);
+    else
+        gap_buffer_delete_after(gb, n);
+}
+
+static bool is_word_char(const unsigned char c) { return isalnum(c) || c == '_'; }
+
+// Start of the word before @pos, skipping what separates them (Alt-b)
+size_t gap_buffer_word_start(const GapBuffer *gb, size_t pos) {
+    while (pos > 0 && !is_word_char(gap_buffer_at(gb, pos - 1)))
+        pos--;
+    while (pos > 0 && is_word_char(gap_buffer_at(gb, pos - 1)))
+        pos--;
+    return pos;
+}
+
+// End of the word after @pos (Alt-f)
+size_t gap_buffer_word_end(const GapBuffer *gb, size_t pos) {
+    while (pos < gb->length && !is_word_char(gap_buffer_at(gb, pos)))
+        pos++;
+    while (pos < gb->length && is_word_char(gap_buffer_at(gb, pos)))
+        pos++;
+    return pos;
+}
+
+// Start of the blank-separated word before @pos (Ctrl-W)
+size_t gap_buffer_blank_word_start(const GapBuffer *gb, size_t pos) {
+    while (pos > 0 && isblank(gap_buffer_at(gb, pos - 1)))
+        pos--;
+    while (pos > 0 && !isblank(gap_buffer_at(gb, pos - 1)))
+        pos--;
+    return pos;
+}
@@ -0,0 +1,47 @@
+#ifndef GAP_BUFFER_H
+#define GAP_BUFFER_H
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * A line being edited, as a gap buffer: the text is buffer[0, gap_start) followed by
+ * buffer[gap_end, capacity), with the free space in between.
+ *
+ * Inserts and deletes happen at the gap, so a keystroke in the middle of a 100 KB line
+ * moves nothing. Motion keys only change @cursor_pos; the gap follows the cursor lazily, by
+ * the distance between them, at the next edit. A zeroed GapBuffer is empty; free() @buffer
+ * when done.
+ *
+ * @buffer      Text before and after the gap; grows as needed.
+ * @length      Bytes of text.
+ * @capacity    Bytes allocated for buffer.
+ * @cursor_pos  Insertion point, 0..length.
+ * @gap_start   Text index where the gap is.
+ * @gap_end     Buffer offset of the text after the gap.
+ */
+typedef struct {
+    unsigned char *buffer;
+    size_t length;
+    size_t capacity;
+    size_t cursor_pos;
+    size_t gap_start;
+    size_t gap_end;
+} GapBuffer;
+
+bool gap_buffer_reserve(GapBuffer *gb, size_t extra);
+void gap_buffer_move_gap(GapBuffer *gb, size_t pos);
+unsigned char gap_buffer_at(const GapBuffer *gb, size_t i);
+void gap_buffer_copy(const GapBuffer *gb, size_t from, size_t n, unsigned char *dst);
+const unsigned char *gap_buffer_text(GapBuffer *gb);
+
+void gap_buffer_set(GapBuffer *gb, const void *text, size_t n);
+void gap_buffer_insert(GapBuffer *gb, const unsigned char *text, size_t n);
+void gap_buffer_delete_before(GapBuffer *gb, size_t n);
+void gap_buffer_delete_after(GapBuffer *gb, size_t n);
+void gap_buffer_kill(GapBuffer *gb, size_t from, size_t to, GapBuffer *killed, bool append);
+
+size_t gap_buffer_word_start(const GapBuffer *gb, size_t pos);
+size_t gap_buffer_word_end(const GapBuffer *gb, size_t pos);
+size_t gap_buffer_blank_word_start(const GapBuffer *gb, size_t pos);
+
+#endif // GAP_BUFFER_H
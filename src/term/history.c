@@ -0,0 +1,368 @@
+// memmem() and memrchr()
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../outbuf.h"
+#include "history.h"
+
+#include "../memstats.h"
+
+// Entries per block of the search index; one bloom filter covers a block
+#define INDEX_BLOCK_ENTRIES 64
+#define BLOOM_BITS 4096
+#define BLOOM_WORDS (BLOOM_BITS / 64)
+
+typedef struct {
+    uint64_t words[BLOOM_WORDS];
+} Bloom;
+
+/**
+ * @fd             The log, opened O_APPEND so concurrent shells only ever add whole lines.
+ * @map            The log as it was when it was opened, up to its last complete line.
+ * @map_len        Bytes of @map that hold complete lines.
+ * @map_size       Bytes mapped, for munmap().
+ * @session        Entries added by this shell, newline-terminated like the log.
+ * @indexer        Thread building the search index; started by the first search.
+ * @indexer_joined @indexer has been waited for.
+ * @index_ready    Set (with release ordering) once @lines and @blooms are complete.
+ * @lines          Offset in @map of every entry, oldest first.
+ * @blooms         One trigram bloom filter per INDEX_BLOCK_ENTRIES entries of @lines.
+ */
+static struct {
+    int fd;
+    const char *map;
+    size_t map_len;
+    size_t map_size;
+    char *session;
+    size_t session_len;
+    size_t session_cap;
+    pthread_t indexer;
+    bool indexer_started;
+    bool indexer_joined;
+    atomic_bool index_ready;
+    size_t *lines;
+    size_t line_count;
+    Bloom *blooms;
+} history = {.fd = -1};
+
+static bool lock_log(const short type) {
+    struct flock lock = {.l_type = type, .l_whence = SEEK_SET};
+    while (fcntl(history.fd, F_SETLKW, &lock) == -1) {
+        if (errno != EINTR)
+            return false;
+    }
+    return true;
+}
+
+static void unlock_log(void) {
+    struct flock lock = {.l_type = F_UNLCK, .l_whence = SEEK_SET};
+    fcntl(history.fd, F_SETLK, &lock);
+}
+
+bool history_open(const char *path) {
+    history.fd = open(path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+    if (history.fd == -1)
+        return false;
+
+    // A read lock keeps another shell's append from landing between fstat() and mmap()
+    lock_log(F_RDLCK);
+
+    struct stat st;
+    if (fstat(history.fd, &st) == 0 && st.st_size > 0) {
+        void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, history.fd, 0);
+        if (map != MAP_FAILED) {
+            history.map = map;
+            history.map_size = st.st_size;
+
+            // A shell that died mid-write can leave a partial last line; it is not an entry
+            const char *last_newline = memrchr(history.map, '\n', history.map_size);
+            history.map_len = last_newline ? (size_t)(last_newline - history.map) + 1 : 0;
+        }
+    }
+
+    unlock_log();
+    return true;
+}
+
+void history_close(void) {
+    history_wait_for_index();
+
+    if (history.map)
+        munmap((void *)history.map, history.map_size);
+    if (history.fd != -1)
+        close(history.fd);
+
+    free(history.session);
+    free(history.lines);
+    free(history.blooms);
+
+    history.map = NULL;
+    history.map_len = history.map_size = 0;
+    history.fd = -1;
+    history.session = NULL;
+    history.lines = NULL;
+    history.line_count = 0;
+    history.blooms = NULL;
+    history.session_len = history.session_cap = 0;
+    history.indexer_started = false;
+    history.indexer_joined = false;
+    atomic_store(&history.index_ready, false);
+}
+
+/**
+ * Waits for the search index started by the first search, if there is one. Searches never
+ * need to: they scan until the index is ready.
+ */
+void history_wait_for_index(void) {
+    if (history.indexer_started && !history.indexer_joined) {
+        pthread_join(history.indexer, NULL);
+        history.indexer_joined = true;
+    }
+}
+
+size_t history_end(void) { return history.map_len + history.session_len; }
+
+/**
+ * Returns the entry that starts at @pos, which must be a position returned by one of the
+ * history_* functions, and stores its length (without the newline) in @len.
+ */
+const char *history_entry(const size_t pos, size_t *len) {
+    const char *start;
+    const char *end;
+    if (pos < history.map_len) {
+        start = history.map + pos;
+        end = history.map + history.map_len;
+    } else {
+        start = history.session + (pos - history.map_len);
+        end = history.session + history.session_len;
+    }
+
+    const char *newline = memchr(start, '\n', end - start);
+    *len = newline ? (size_t)(newline - start) : (size_t)(end - start);
+    return start;
+}
+
+bool history_prev(const size_t pos, size_t *prev) {
+    if (pos == 0)
+        return false;
+
+    // pos - 1 is the newline ending the previous entry; look for the one before it
+    const size_t last = pos - 1;
+    const char *base = last < history.map_len ? history.map : history.session;
+    const size_t base_pos = last < history.map_len ? 0 : history.map_len;
+
+    const char *newline = memrchr(base, '\n', last - base_pos);
+    *prev = newline ? base_pos + (size_t)(newline - base) + 1 : base_pos;
+    return true;
+}
+
+bool history_next(const size_t pos, size_t *next) {
+    if (pos >= history_end())
+        return false;
+
+    size_t len;
+    history_entry(pos, &len);
+    *next = pos + len + 1;
+    return true;
+}
+
+bool history_add(const char *line) {
+    const size_t len = strlen(line);
+    if (len == 0)
+        return true;
+
+    size_t newest;
+    if (history_prev(history_end(), &newest)) {
+        size_t newest_len;
+        const char *text = history_entry(newest, &newest_len);
+        if (newest_len == len && !memcmp(text, line, len))
+            return true;
+    }
+
+    if (history.session_len + len + 1 > history.session_cap) {
+        size_t cap = history.session_cap ? history.session_cap * 2 : 4096;
+        while (cap < history.session_len + len + 1)
+            cap *= 2;
+
+        char *grown = realloc(history.session, cap);
+        if (!grown)
+            return false;
+        history.session = grown;
+        history.session_cap = cap;
+    }
+
+    char *entry = history.session + history.session_len;
+    memcpy(entry, line, len);
+    entry[len] = '\n';
+    history.session_len += len + 1;
+
+    // Without a log the entry only lives for this session
+    if (history.fd == -1)
+        return true;
+    if (!lock_log(F_WRLCK))
+        return false;
+
+    // Start on a fresh line if a shell died mid-write, then add the entry in one write
+    struct stat st;
+    char tail = '\n';
+    if (fstat(history.fd, &st) == 0 && st.st_size > 0)
+        pread(history.fd, &tail, 1, st.st_size - 1);
+
+    bool ok = true;
+    if (tail != '\n')
+        ok = write_all(history.fd, "\n", 1);
+    if (ok)
+        ok = write_all(history.fd, entry, len + 1);
+
+    unlock_log();
+    return ok;
+}
+
+static unsigned trigram_bit(const unsigned char *s) {
+    const uint32_t key = (uint32_t)s[0] | (uint32_t)s[1] << 8 | (uint32_t)s[2] << 16;
+    // Multiplicative hash; the top 12 bits index the 4096-bit filter
+    return (key * 0x9E3779B1u) >> (32 - 12);
+}
+
+static void bloom_add_text(Bloom *bloom, const char *text, const size_t len) {
+    for (size_t i = 0; i + 3 <= len; i++) {
+        const unsigned bit = trigram_bit((const unsigned char *)text + i);
+        bloom->words[bit / 64] |= UINT64_C(1) << (bit % 64);
+    }
+}
+
+static bool bloom_contains(const Bloom *bloom, const Bloom *query) {
+    for (size_t i = 0; i < BLOOM_WORDS; i++) {
+        if ((bloom->words[i] & query->words[i]) != query->words[i])
+            return false;
+    }
+    return true;
+}
+
+/**
+ * Builds the search index over the mapped log: the offset of every entry, and for every
+ * block of INDEX_BLOCK_ENTRIES entries a bloom filter of their trigrams, so a search only
+ * looks inside blocks that can contain all of the query's trigrams.
+ */
+static void *build_index(void *unused) {
+    (void)unused;
+
+    size_t count = 0;
+    for (const char *p = history.map, *end = history.map + history.map_len; p < end; count++)
+        p = (const char *)memchr(p, '\n', end - p) + 1;
+
+    const size_t blocks = (count + INDEX_BLOCK_ENTRIES - 1) / INDEX_BLOCK_ENTRIES;
+    size_t *lines = malloc((count + 1) * sizeof(*lines));
+    Bloom *blooms = calloc(blocks ? blocks : 1, sizeof(*blooms));
+    if (!lines || !blooms) {
+        free(lines);
+        free(blooms);
+        return NULL;
+    }
+
+    size_t offset = 0;
+    for (size_t i = 0; i < count; i++) {
+        const char *start = history.map + offset;
+        const size_t len = (const char *)memchr(start, '\n', history.map_len - offset) - start;
+
+        lines[i] = offset;
+        bloom_add_text(&blooms[i / INDEX_BLOCK_ENTRIES], start, len);
+        offset += len + 1;
+    }
+    lines[count] = history.map_len;
+
+    history.lines = lines;
+    history.line_count = count;
+    history.blooms = blooms;
+    atomic_store_explicit(&history.index_ready, true, memory_order_release);
+    return NULL;
+}
+
+static bool entry_contains(const size_t pos, const char *query, const size_t query_len) {
+    size_t len;
+    const char *text = history_entry(pos, &len);
+    return memmem(text, len, query, query_len) != NULL;
+}
+
+static bool indexed_search(const char *query, const size_t query_len, const size_t before,
+                           size_t *found) {
+    Bloom wanted = {0};
+    bloom_add_text(&wanted, query, query_len);
+
+    // Entries [0, limit) start before @before
+    size_t low = 0;
+    size_t limit = history.line_count;
+    while (low < limit) {
+        const size_t mid = low + (limit - low) / 2;
+        if (history.lines[mid] < before)
+            low = mid + 1;
+        else
+            limit = mid;
+    }
+
+    for (size_t block = (limit + INDEX_BLOCK_ENTRIES - 1) / INDEX_BLOCK_ENTRIES; block-- > 0;) {
+        if (!bloom_contains(&history.blooms[block], &wanted))
+            continue;
+
+        const size_t first = block * INDEX_BLOCK_ENTRIES;
+        size_t i = first + INDEX_BLOCK_ENTRIES < limit ? first + INDEX_BLOCK_ENTRIES : limit;
+        while (i-- > first) {
+            const char *text = history.map + history.lines[i];
+            const size_t len = history.lines[i + 1] - history.lines[i] - 1;
+            if (memmem(text, len, query, query_len)) {
+                *found = history.lines[i];
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/**
+ * Finds the newest entry that starts before @before and contains @query.
+ *
+ * The first search starts indexing the mapped log in the background. Until the index is
+ * ready, searches scan the log entry by entry; entries from this session are always
+ * scanned, there are few of them.
+ */
+bool history_search(const char *query, const size_t query_len, const size_t before,
+                    size_t *found) {
+    if (query_len == 0)
+        return false;
+
+    if (!history.indexer_started && history.map_len > 0)
+        history.indexer_started = pthread_create(&history.indexer, NULL, build_index, NULL) == 0;
+
+    size_t pos = before < history_end() ? before : history_end();
+    size_t prev;
+    while (pos > history.map_len && history_prev(pos, &prev)) {
+        if (entry_contains(prev, query, query_len)) {
+            *found = prev;
+            return true;
+        }
+        pos = prev;
+    }
+
+    if (atomic_load_explicit(&history.index_ready, memory_order_acquire))
+        return indexed_search(query, query_len, pos, found);
+
+    while (history_prev(pos, &prev)) {
+        if (entry_contains(prev, query, query_len)) {
+            *found = prev;
+            return true;
+        }
+        pos = prev;
+    }
+    return false;
+}
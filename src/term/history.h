@@ -0,0 +1,26 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * Command history, shared by every shell through an append-only log of one entry per line.
+ *
+ * The log is memory-mapped when it is opened and never parsed up front. Entries from this
+ * session are kept after it in the same format, so the whole history reads as one text:
+ * a history position is the offset of an entry's first byte in that text, and
+ * history_end() is the position just past the newest entry (the line being edited).
+ */
+
+bool history_open(const char *path);
+void history_close(void);
+bool history_add(const char *line);
+
+size_t history_end(void);
+const char *history_entry(size_t pos, size_t *len);
+bool history_prev(size_t pos, size_t *prev);
+bool history_next(size_t pos, size_t *next);
+bool history_search(const char *query, size_t query_len, size_t before, size_t *found);
+void history_wait_for_index(void);
+
+#endif // HISTORY_H
@@ -1,29 +1,87 @@
 #define _POSIX_C_SOURCE 200809L
 
-#include <assert.h>
+#include <errno.h>
+#include <poll.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/ioctl.h>
 #include <termios.h>
 #include <unistd.h>
 
+#include "../outbuf.h"
+#include "complete.h"
+#include "gap_buffer.h"
+#include "history.h"
 #include "term.h"
 
-#define INPUT_CAPACITY 1024
+#include "../memstats.h"
+
 #define PROMPT "$ "
 #define PROMPT_LEN (sizeof(PROMPT) - 1)
+#define DEFAULT_TERM_WIDTH 80
+#define READ_BUFFER_SIZE 4096
+// How long to wait for the rest of an escape sequence before taking ESC as a key by itself
+#define ESCAPE_TIMEOUT_MS 50
+
+#define BRACKETED_PASTE_ON "\x1b[?2004h"
+#define BRACKETED_PASTE_OFF "\x1b[?2004l"
+#define PASTE_END "\x1b[201~"
 
 static bool term_raw_enabled = false;
 static struct termios orig_termios;
 
-enum { KEY_BACKSPACE_CTRL_H = 0x08, KEY_BACKSPACE_DEL = 0x7f };
+enum {
+    KEY_CTRL_A = 0x01,
+    KEY_CTRL_E = 0x05,
+    KEY_CTRL_G = 0x07,
+    KEY_BACKSPACE_CTRL_H = 0x08,
+    KEY_TAB = 0x09,
+    KEY_CTRL_K = 0x0b,
+    KEY_CTRL_R = 0x12,
+    KEY_CTRL_U = 0x15,
+    KEY_CTRL_W = 0x17,
+    KEY_CTRL_Y = 0x19,
+    KEY_BACKSPACE_DEL = 0x7f,
+};
+
+typedef enum {
+    KEY_NONE,
+    KEY_CHAR,
+    KEY_ENTER,
+    KEY_BACKSPACE,
+    KEY_ESCAPE,
+    KEY_LEFT,
+    KEY_RIGHT,
+    KEY_UP,
+    KEY_DOWN,
+    KEY_HOME,
+    KEY_END,
+    KEY_DELETE,
+    KEY_WORD_LEFT,       // Alt-b, Ctrl-Left
+    KEY_WORD_RIGHT,      // Alt-f, Ctrl-Right
+    KEY_KILL_WORD_LEFT,  // Alt-Backspace
+    KEY_KILL_WORD_RIGHT, // Alt-d
+    KEY_PASTE,
+    KEY_EOF,
+} KeyKind;
 
 typedef struct {
-    unsigned char buffer[INPUT_CAPACITY];
-    int length;
-    int cursor_pos;
-} InputState;
+    KeyKind kind;
+    unsigned char c;
+} Key;
+
+/**
+ * Raw bytes read from the terminal but not consumed yet. Every read() takes whatever is
+ * available, so a fast typist or a paste costs one syscall per batch instead of one per byte.
+ * It is kept across lines so typed-ahead input is not lost.
+ */
+static struct {
+    unsigned char data[READ_BUFFER_SIZE];
+    size_t start;
+    size_t end;
+} pending;
 
 static bool is_visible_ascii(const unsigned char c) { return c >= 32 && c <= 126; }
 static bool char_is_backspace(const unsigned char c) {
@@ -31,8 +89,11 @@ static bool char_is_backspace(const unsigned char c) {
 }
 
 void term_disable_raw_mode() {
-    assert(term_raw_enabled && "term_disable_raw_mode called before enable");
+    // Also registered with atexit(), so it can run after an explicit call
+    if (!term_raw_enabled)
+        return;
 
+    write_all(STDOUT_FILENO, BRACKETED_PASTE_OFF, sizeof(BRACKETED_PASTE_OFF) - 1);
     if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &orig_termios) == -1) {
         perror("tcsetattr");
         return;
@@ -64,88 +125,697 @@ void term_enable_raw_mode() {
 
     atexit(term_disable_raw_mode);
 
+    // Pastes arrive wrapped in \e[200~ ... \e[201~ and become a single edit
+    write_all(STDOUT_FILENO, BRACKETED_PASTE_ON, sizeof(BRACKETED_PASTE_ON) - 1);
+
     term_raw_enabled = true;
 }
 
-static void redraw_input_line(const InputState *input) {
-    // TODO: Wrap in write_all() helper to handle partial writes
-    write(STDOUT_FILENO, "\x1b[2K\r", 5);
-    write(STDOUT_FILENO, PROMPT, PROMPT_LEN);
+/**
+ * What the last frame put on the screen, so the next frame only sends the difference.
+ *
+ * The line scrolls horizontally: only a viewport of the input as wide as the terminal
+ * (minus the prompt and one spare column, so the terminal never wraps) is shown.
+ *
+ * @prompt      Text in front of the input; changing it redraws the whole line.
+ * @frame       Escape sequences and text of the frame being composed, written at once.
+ * @shown       The slice of the input that is on the screen.
+ * @view        Scratch copy of the slice being drawn; swapped with @shown afterwards.
+ * @cursor_col  Screen column of the cursor, 0-based.
+ * @scroll      Input index of the first byte in the viewport.
+ * @width       Terminal width in columns.
+ * @drawn       Something was drawn already; the first frame draws the whole line.
+ */
+typedef struct {
+    const char *prompt;
+    size_t prompt_len;
+    char *frame;
+    size_t frame_len;
+    size_t frame_cap;
+    char *shown;
+    size_t shown_len;
+    size_t shown_cap;
+    char *view;
+    size_t view_cap;
+    size_t cursor_col;
+    size_t scroll;
+    size_t width;
+    bool drawn;
+} Screen;
+
+static size_t terminal_width(void) {
+    struct winsize ws;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_col > 0)
+        return ws.ws_col;
+    return DEFAULT_TERM_WIDTH;
+}
+
+static bool grow_buffer(char **buf, size_t *cap, const size_t needed) {
+    if (needed <= *cap)
+        return true;
+
+    size_t new_cap = *cap ? *cap * 2 : 256;
+    while (new_cap < needed)
+        new_cap *= 2;
+
+    char *grown = realloc(*buf, new_cap);
+    if (!grown)
+        return false;
+
+    *buf = grown;
+    *cap = new_cap;
+    return true;
+}
+
+static void frame_append(Screen *screen, const char *data, const size_t n) {
+    if (!grow_buffer(&screen->frame, &screen->frame_cap, screen->frame_len + n))
+        return;
 
-    write(STDOUT_FILENO, input->buffer, input->length);
+    memcpy(screen->frame + screen->frame_len, data, n);
+    screen->frame_len += n;
+}
 
+static void frame_move_to(Screen *screen, const size_t col) {
     char seq[32];
-    snprintf(seq, sizeof(seq), "\x1b[%dG", PROMPT_LEN + 1 + input->cursor_pos);
+    const int n = snprintf(seq, sizeof(seq), "\x1b[%zuG", col + 1);
+    frame_append(screen, seq, n);
+}
+
+static void screen_init(Screen *screen) {
+    *screen = (Screen){.prompt = PROMPT, .prompt_len = PROMPT_LEN, .width = terminal_width()};
+}
+
+static void screen_set_prompt(Screen *screen, const char *prompt, const size_t len) {
+    screen->prompt = prompt;
+    screen->prompt_len = len;
+    screen->drawn = false;
+}
+
+static void screen_free(Screen *screen) {
+    free(screen->frame);
+    free(screen->shown);
+    free(screen->view);
+}
+
+/**
+ * Composes the frame that turns the screen from what was shown last into @input and
+ * emits it with one write. Typing at the end of the line sends just the new character,
+ * cursor motion sends just a cursor move, and an edit in the middle rewrites only the
+ * part of the line from the first changed column on.
+ */
+static void render(Screen *screen, const GapBuffer *input) {
+    const size_t length = input->length;
+    const size_t cursor = input->cursor_pos;
+    const size_t prompt_len = screen->prompt_len;
+    const size_t columns = screen->width > prompt_len + 1 ? screen->width - prompt_len - 1 : 1;
+
+    size_t scroll = screen->scroll;
+    if (cursor < scroll)
+        scroll = cursor;
+    else if (cursor > scroll + columns)
+        scroll = cursor - columns;
+
+    // Only the viewport is copied out of the gap buffer, so drawing costs the same on any line
+    const size_t visible_len = length - scroll < columns ? length - scroll : columns;
+    if (!grow_buffer(&screen->view, &screen->view_cap, visible_len + 1)) {
+        // Out of memory: forget the screen so the next frame redraws everything
+        screen->drawn = false;
+        return;
+    }
+    gap_buffer_copy(input, scroll, visible_len, (unsigned char *)screen->view);
+    const char *visible = screen->view;
+    const size_t target_col = prompt_len + cursor - scroll;
+
+    screen->frame_len = 0;
+    size_t col = screen->cursor_col;
+
+    if (!screen->drawn || scroll != screen->scroll) {
+        // Nothing to diff against: redraw the whole line
+        frame_append(screen, "\r", 1);
+        frame_append(screen, screen->prompt, prompt_len);
+        frame_append(screen, visible, visible_len);
+        frame_append(screen, "\x1b[K", 3);
+        col = prompt_len + visible_len;
+    } else {
+        const size_t common = visible_len < screen->shown_len ? visible_len : screen->shown_len;
+        size_t same = 0;
+        while (same < common && visible[same] == screen->shown[same])
+            same++;
+
+        if (same < visible_len || same < screen->shown_len) {
+            if (col != prompt_len + same)
+                frame_move_to(screen, prompt_len + same);
+            frame_append(screen, visible + same, visible_len - same);
+            if (visible_len < screen->shown_len)
+                frame_append(screen, "\x1b[K", 3);
+            col = prompt_len + visible_len;
+        }
+    }
+
+    if (col != target_col)
+        frame_move_to(screen, target_col);
+
+    if (screen->frame_len > 0)
+        write_all(STDOUT_FILENO, screen->frame, screen->frame_len);
+
+    // What was drawn is now what is shown; the old slice becomes the next scratch buffer
+    char *shown = screen->shown;
+    const size_t shown_cap = screen->shown_cap;
+    screen->shown = screen->view;
+    screen->shown_cap = screen->view_cap;
+    screen->view = shown;
+    screen->view_cap = shown_cap;
+    screen->shown_len = visible_len;
+    screen->cursor_col = target_col;
+    screen->scroll = scroll;
+    screen->drawn = true;
+}
+
+/**
+ * Next raw byte from the terminal.
+ *
+ * @param timeout_ms  How long to wait if nothing is buffered, -1 for no limit.
+ * @return            The byte, -1 on timeout, or -2 at end of input or on a read error.
+ */
+static int read_byte(const int timeout_ms) {
+    if (pending.start < pending.end)
+        return pending.data[pending.start++];
+
+    while (1) {
+        if (timeout_ms >= 0) {
+            struct pollfd pfd = {.fd = STDIN_FILENO, .events = POLLIN};
+            const int ready = poll(&pfd, 1, timeout_ms);
+            if (ready == 0)
+                return -1;
+            if (ready < 0 && errno != EINTR)
+                return -2;
+            if (ready < 0)
+                continue;
+        }
 
-    write(STDOUT_FILENO, seq, strlen(seq));
+        const ssize_t n = read(STDIN_FILENO, pending.data, sizeof(pending.data));
+        if (n > 0) {
+            pending.start = 1;
+            pending.end = (size_t)n;
+            return pending.data[0];
+        }
+        if (n == 0 || errno != EINTR)
+            return -2;
+    }
+}
+
+static bool input_pending(void) { return pending.start < pending.end; }
+
+/**
+ * Decodes an escape sequence after its ESC. A lone ESC (nothing follows within
+ * ESCAPE_TIMEOUT_MS) is reported as KEY_ESCAPE instead of blocking for the next key.
+ */
+static KeyKind read_escape_sequence(void) {
+    const int intro = read_byte(ESCAPE_TIMEOUT_MS);
+    if (intro == -1)
+        return KEY_ESCAPE;
+
+    // Alt-<key> arrives as ESC followed by the key
+    switch (intro) {
+    case 'b':
+        return KEY_WORD_LEFT;
+    case 'f':
+        return KEY_WORD_RIGHT;
+    case 'd':
+        return KEY_KILL_WORD_RIGHT;
+    case KEY_BACKSPACE_CTRL_H:
+    case KEY_BACKSPACE_DEL:
+        return KEY_KILL_WORD_LEFT;
+    default:
+        break;
+    }
+    if (intro != '[' && intro != 'O')
+        return KEY_NONE;
+
+    // CSI: numeric parameters, then a final byte in 0x40..0x7e
+    int param = 0;
+    int c;
+    while ((c = read_byte(ESCAPE_TIMEOUT_MS)) >= 0 && ((c >= '0' && c <= '9') || c == ';')) {
+        if (c == ';')
+            param = 0;
+        else
+            param = param * 10 + (c - '0');
+    }
+    if (c < 0)
+        return KEY_NONE;
+
+    // The last parameter of \e[1;5C is the modifier: 3 for Alt, 5 for Ctrl
+    const bool word = param == 3 || param == 5;
+    switch (c) {
+    case 'A':
+        return KEY_UP;
+    case 'B':
+        return KEY_DOWN;
+    case 'C':
+        return word ? KEY_WORD_RIGHT : KEY_RIGHT;
+    case 'D':
+        return word ? KEY_WORD_LEFT : KEY_LEFT;
+    case 'H':
+        return KEY_HOME;
+    case 'F':
+        return KEY_END;
+    case '~':
+        switch (param) {
+        case 1:
+        case 7:
+            return KEY_HOME;
+        case 4:
+        case 8:
+            return KEY_END;
+        case 3:
+            return KEY_DELETE;
+        case 200:
+            return KEY_PASTE;
+        default:
+            return KEY_NONE;
+        }
+    default:
+        return KEY_NONE;
+    }
+}
+
+static Key read_key(void) {
+    const int c = read_byte(-1);
+    if (c == -2)
+        return (Key){KEY_EOF, 0};
+    if (c == '\x1b')
+        return (Key){read_escape_sequence(), 0};
+    if (c == '\r' || c == '\n')
+        return (Key){KEY_ENTER, 0};
+    if (char_is_backspace(c))
+        return (Key){KEY_BACKSPACE, 0};
+    return (Key){KEY_CHAR, (unsigned char)c};
+}
+
+/**
+ * Reads a bracketed paste up to its closing \e[201~ and inserts it as one edit. Control
+ * characters (including the newlines of a multi-line paste) become spaces, so a paste can
+ * never run a command by itself.
+ */
+static void insert_paste(GapBuffer *input) {
+    const size_t end_len = sizeof(PASTE_END) - 1;
+    unsigned char *text = NULL;
+    size_t len = 0;
+    size_t cap = 0;
+
+    int c;
+    while ((c = read_byte(-1)) >= 0) {
+        if (len == cap) {
+            cap = cap ? cap * 2 : READ_BUFFER_SIZE;
+            unsigned char *grown = realloc(text, cap);
+            if (!grown)
+                break;
+            text = grown;
+        }
+        text[len++] = (unsigned char)c;
+
+        if (len >= end_len && !memcmp(text + len - end_len, PASTE_END, end_len)) {
+            len -= end_len;
+            break;
+        }
+    }
+
+    for (size_t i = 0; i < len; i++) {
+        if (!is_visible_ascii(text[i]))
+            text[i] = ' ';
+    }
+
+    gap_buffer_insert(input, text, len);
+    free(text);
+}
+
+/**
+ * Text removed by the kill keys (Ctrl-K, Ctrl-U, Ctrl-W, Alt-d, Alt-Backspace), put back by
+ * Ctrl-Y. Kept across lines. Kills by consecutive keys collect into one entry, as in other
+ * line editors.
+ */
+static GapBuffer kill_buffer;
+
+/**
+ * Where the line being edited stands in the history.
+ *
+ * @pos    History position of the entry shown, history_end() while editing a new line.
+ * @draft  The new line as it was when the first entry was recalled, restored by moving
+ *         past the newest entry or by cancelling a search.
+ */
+typedef struct {
+    size_t pos;
+    GapBuffer draft;
+} Recall;
+
+static void recall(Recall *recall, GapBuffer *input, const size_t pos) {
+    if (recall->pos == history_end())
+        gap_buffer_set(&recall->draft, gap_buffer_text(input), input->length);
+
+    recall->pos = pos;
+    if (pos == history_end()) {
+        gap_buffer_set(input, gap_buffer_text(&recall->draft), recall->draft.length);
+        return;
+    }
+
+    size_t len;
+    const char *entry = history_entry(pos, &len);
+    gap_buffer_set(input, entry, len);
+}
+
+/**
+ * Reverse incremental search (Ctrl-R).
+ *
+ * @active  The search prompt is shown and keys edit @query.
+ * @failed  Nothing older matches @query; the last match stays on the line.
+ * @query   What is being searched for.
+ * @prompt  Storage for the "(reverse-i-search)`query': " prompt.
+ */
+typedef struct {
+    bool active;
+    bool failed;
+    GapBuffer query;
+    char *prompt;
+    size_t prompt_cap;
+} Search;
+
+static void search_update_prompt(Search *search, Screen *screen) {
+    static const char failed[] = "(failed ";
+    static const char head[] = "reverse-i-search)`";
+    static const char tail[] = "': ";
+
+    const size_t failed_len = search->failed ? sizeof(failed) - 1 : 1;
+    const size_t len = failed_len + sizeof(head) - 1 + search->query.length + sizeof(tail) - 1;
+    if (!grow_buffer(&search->prompt, &search->prompt_cap, len))
+        return;
+
+    char *p = search->prompt;
+    memcpy(p, search->failed ? failed : "(", failed_len);
+    p += failed_len;
+    memcpy(p, head, sizeof(head) - 1);
+    p += sizeof(head) - 1;
+    memcpy(p, gap_buffer_text(&search->query), search->query.length);
+    p += search->query.length;
+    memcpy(p, tail, sizeof(tail) - 1);
+
+    screen_set_prompt(screen, search->prompt, len);
+}
+
+/**
+ * Looks for the query in entries starting before @before and shows the match with the
+ * cursor on it.
+ */
+static void search_run(Search *search, Recall *recall_state, GapBuffer *input,
+                       const size_t before) {
+    const char *query = (const char *)gap_buffer_text(&search->query);
+    const size_t query_len = search->query.length;
+
+    size_t found;
+    search->failed = query_len > 0 && !history_search(query, query_len, before, &found);
+    if (query_len == 0 || search->failed)
+        return;
+
+    recall(recall_state, input, found);
+    const unsigned char *text = gap_buffer_text(input);
+    for (size_t i = 0; i + query_len <= input->length; i++) {
+        if (!memcmp(text + i, query, query_len)) {
+            input->cursor_pos = i;
+            break;
+        }
+    }
+}
+
+/**
+ * Handles a key while searching. Returns false when the key ends the search and should
+ * also be handled as a normal editing key.
+ */
+static bool search_key(Search *search, Recall *recall_state, GapBuffer *input, Screen *screen,
+                       const Key key) {
+    const size_t match = recall_state->pos;
+
+    if (key.kind == KEY_CHAR && key.c == KEY_CTRL_R) {
+        search_run(search, recall_state, input, match);
+    } else if (key.kind == KEY_CHAR && is_visible_ascii(key.c)) {
+        // A longer query can still match the entry already shown
+        gap_buffer_insert(&search->query, &key.c, 1);
+        search_run(search, recall_state, input,
+                   match < history_end() ? match + 1 : history_end());
+    } else if (key.kind == KEY_BACKSPACE) {
+        gap_buffer_delete_before(&search->query, 1);
+        search_run(search, recall_state, input, history_end());
+    } else {
+        if (key.kind == KEY_CHAR && key.c == KEY_CTRL_G)
+            recall(recall_state, input, history_end());
+
+        search->active = false;
+        screen_set_prompt(screen, PROMPT, PROMPT_LEN);
+        return key.kind == KEY_ESCAPE || (key.kind == KEY_CHAR && key.c == KEY_CTRL_G);
+    }
+
+    search_update_prompt(search, screen);
+    return true;
+}
+
+static bool ends_completion_word(const unsigned char c) {
+    return c == ' ' || c == '\t' || c == '|' || c == '&' || c == ';' || c == '<' || c == '>';
+}
+
+static void list_completions(Screen *screen, const Completions *completions) {
+    size_t width = 0;
+    for (size_t i = 0; i < completions->count; i++) {
+        const size_t len = strlen(completions->items[i]);
+        if (len > width)
+            width = len;
+    }
+    width += 2;
+
+    const size_t columns = screen->width / width ? screen->width / width : 1;
+    const size_t rows = (completions->count + columns - 1) / columns;
+
+    screen->frame_len = 0;
+    frame_append(screen, "\n", 1);
+    for (size_t row = 0; row < rows; row++) {
+        for (size_t col = 0; col < columns; col++) {
+            const size_t i = col * rows + row;
+            if (i >= completions->count)
+                break;
+
+            const size_t len = strlen(completions->items[i]);
+            frame_append(screen, completions->items[i], len);
+            for (size_t pad = len; i + rows < completions->count && pad < width; pad++)
+                frame_append(screen, " ", 1);
+        }
+        frame_append(screen, "\n", 1);
+    }
+
+    if (completions->total > completions->count) {
+        char more[64];
+        const int n = snprintf(more, sizeof(more), "... and %zu more\n",
+                               completions->total - completions->count);
+        frame_append(screen, more, n);
+    }
+
+    write_all(STDOUT_FILENO, screen->frame, screen->frame_len);
+    // The prompt goes below the list
+    screen->drawn = false;
+}
+
+/**
+ * Tab: completes the word before the cursor as far as every match agrees. The first word
+ * of a command (with no '/') completes from the executables on PATH, anything else from
+ * the file system. A second Tab in a row lists the matches when they still disagree.
+ */
+static void complete_word(GapBuffer *input, Screen *screen, Arena *arena, const bool again) {
+    // Everything before the cursor is then contiguous at the start of the buffer
+    gap_buffer_move_gap(input, input->cursor_pos);
+
+    size_t start = input->cursor_pos;
+    while (start > 0 && !ends_completion_word(input->buffer[start - 1]))
+        start--;
+
+    const char *word = (const char *)input->buffer + start;
+    const size_t len = input->cursor_pos - start;
+
+    size_t before = start;
+    while (before > 0 && (input->buffer[before - 1] == ' ' || input->buffer[before - 1] == '\t'))
+        before--;
+    const unsigned char previous = before > 0 ? input->buffer[before - 1] : '|';
+    const bool command_position =
+        (previous == '|' || previous == '&' || previous == ';') && !memchr(word, '/', len);
+
+    arena_reset(arena);
+    Completions completions;
+    const bool ok = command_position ? complete_command(arena, word, len, &completions)
+                                     : complete_file(arena, word, len, &completions);
+    if (!ok || completions.total == 0) {
+        write_all(STDOUT_FILENO, "\a", 1);
+        return;
+    }
+
+    const size_t common_len = strlen(completions.common);
+    if (common_len > len) {
+        gap_buffer_insert(input, (const unsigned char *)completions.common + len, common_len - len);
+    } else if (completions.total > 1) {
+        if (again)
+            list_completions(screen, &completions);
+        else
+            write_all(STDOUT_FILENO, "\a", 1);
+    }
+
+    // A single match is finished: move on to the next word, unless it is a directory
+    if (completions.total == 1 && completions.common[common_len - 1] != '/')
+        gap_buffer_insert(input, (const unsigned char *)" ", 1);
 }
 
 char *term_read_input_raw() {
-    InputState input = {0};
+    GapBuffer input = {0};
+    if (!gap_buffer_reserve(&input, 0))
+        return NULL;
 
-    redraw_input_line(&input);
+    Screen screen;
+    screen_init(&screen);
+    Recall recall_state = {.pos = history_end()};
+    Search search = {0};
+    Arena completion_arena = {0};
+    bool after_tab = false;
+    bool after_kill = false;
+
+    render(&screen, &input);
 
     while (true) {
-        unsigned char c;
-        unsigned char seq[8] = {0};
+        const Key key = read_key();
 
-        if (read(STDIN_FILENO, &c, 1) != 1)
+        if (search.active && search_key(&search, &recall_state, &input, &screen, key)) {
+            if (!input_pending())
+                render(&screen, &input);
             continue;
+        }
+
+        // End of input on an empty line ends the session; a last unterminated line is still
+        // returned, and the next call sees the end at once
+        if (key.kind == KEY_EOF && input.length == 0) {
+            write_all(STDOUT_FILENO, "\n", 1);
+            free(input.buffer);
+            input.buffer = NULL;
+            break;
+        }
 
-        // TODO: Also accept '\n' as Enter
-        if (c == '\r') {
-            write(STDOUT_FILENO, "\n", 1);
+        if (key.kind == KEY_ENTER || key.kind == KEY_EOF) {
+            render(&screen, &input);
+            write_all(STDOUT_FILENO, "\n", 1);
             break;
         }
 
         // TODO: Remove this temporary quit key
-        if (c == 'q') {
+        if (key.kind == KEY_CHAR && key.c == 'q') {
+            screen_free(&screen);
+            free(input.buffer);
+            free(recall_state.draft.buffer);
+            free(search.query.buffer);
+            free(search.prompt);
+            arena_destroy(&completion_arena);
             return NULL;
         }
 
-        if (c == '\x1b') {
-            // TODO: Replace blocking reads with select() + timeout to handle bare ESC
-            // TODO: Parse more keys: Up/Down, Home, End, Delete
-            if (read(STDIN_FILENO, &seq[0], 1) != 1)
-                continue;
-            if (read(STDIN_FILENO, &seq[1], 1) != 1)
-                continue;
+        const bool tab_again = after_tab;
+        after_tab = key.kind == KEY_CHAR && key.c == KEY_TAB;
+        const bool kill_again = after_kill;
+        after_kill = false;
 
-            if (seq[0] == '[') {
-                if (seq[1] == 'D') {
-                    if (input.cursor_pos > 0) {
-                        input.cursor_pos--;
-                        redraw_input_line(&input);
-                        continue;
-                    }
-                } else if (seq[1] == 'C') {
-                    if (input.cursor_pos < input.length) {
-                        input.cursor_pos++;
-                        redraw_input_line(&input);
-                        continue;
-                    }
-                }
-            }
-        }
-
-        if (char_is_backspace(c) && input.length > 0) {
-            // TODO: Support mid-line backspace (shift text left instead of jumping to end)
-            input.length--;
+        size_t pos;
+        switch (key.kind) {
+        case KEY_HOME:
+            input.cursor_pos = 0;
+            break;
+        case KEY_END:
             input.cursor_pos = input.length;
-            input.buffer[input.length] = '\0';
-            redraw_input_line(&input);
+            break;
+        case KEY_WORD_LEFT:
+            input.cursor_pos = gap_buffer_word_start(&input, input.cursor_pos);
+            break;
+        case KEY_WORD_RIGHT:
+            input.cursor_pos = gap_buffer_word_end(&input, input.cursor_pos);
+            break;
+        case KEY_DELETE:
+            gap_buffer_delete_after(&input, 1);
+            break;
+        case KEY_KILL_WORD_LEFT:
+            pos = gap_buffer_word_start(&input, input.cursor_pos);
+            gap_buffer_kill(&input, pos, input.cursor_pos, &kill_buffer, kill_again);
+            after_kill = true;
+            break;
+        case KEY_KILL_WORD_RIGHT:
+            pos = gap_buffer_word_end(&input, input.cursor_pos);
+            gap_buffer_kill(&input, input.cursor_pos, pos, &kill_buffer, kill_again);
+            after_kill = true;
+            break;
+        case KEY_LEFT:
+            if (input.cursor_pos > 0)
+                input.cursor_pos--;
+            break;
+        case KEY_RIGHT:
+            if (input.cursor_pos < input.length)
+                input.cursor_pos++;
+            break;
+        case KEY_UP:
+            if (history_prev(recall_state.pos, &pos))
+                recall(&recall_state, &input, pos);
+            break;
+        case KEY_DOWN:
+            if (history_next(recall_state.pos, &pos))
+                recall(&recall_state, &input, pos);
+            break;
+        case KEY_BACKSPACE:
+            gap_buffer_delete_before(&input, 1);
+            break;
+        case KEY_PASTE:
+            insert_paste(&input);
+            break;
+        case KEY_CHAR:
+            if (key.c == KEY_TAB) {
+                complete_word(&input, &screen, &completion_arena, tab_again);
+            } else if (key.c == KEY_CTRL_R) {
+                search.active = true;
+                search.failed = false;
+                gap_buffer_set(&search.query, NULL, 0);
+                search_update_prompt(&search, &screen);
+            } else if (key.c == KEY_CTRL_A) {
+                input.cursor_pos = 0;
+            } else if (key.c == KEY_CTRL_E) {
+                input.cursor_pos = input.length;
+            } else if (key.c == KEY_CTRL_K) {
+                gap_buffer_kill(&input, input.cursor_pos, input.length, &kill_buffer, kill_again);
+                after_kill = true;
+            } else if (key.c == KEY_CTRL_U) {
+                gap_buffer_kill(&input, 0, input.cursor_pos, &kill_buffer, kill_again);
+                after_kill = true;
+            } else if (key.c == KEY_CTRL_W) {
+                pos = gap_buffer_blank_word_start(&input, input.cursor_pos);
+                gap_buffer_kill(&input, pos, input.cursor_pos, &kill_buffer, kill_again);
+                after_kill = true;
+            } else if (key.c == KEY_CTRL_Y) {
+                gap_buffer_insert(&input, gap_buffer_text(&kill_buffer), kill_buffer.length);
+            } else if (is_visible_ascii(key.c)) {
+                gap_buffer_insert(&input, &key.c, 1);
+            }
+            break;
+        default:
+            break;
         }
 
-        if (is_visible_ascii(c) && input.length < INPUT_CAPACITY - 1) {
-            // TODO: Support mid-line insert (shift text right instead of always appending)
-            input.buffer[input.length++] = c;
-            input.cursor_pos = input.length;
-
-            redraw_input_line(&input);
-        }
+        // Keys that arrived in one batch are applied together and drawn once
+        if (!input_pending())
+            render(&screen, &input);
     }
 
-    input.buffer[input.length] = '\0';
+    screen_free(&screen);
+    free(recall_state.draft.buffer);
+    free(search.query.buffer);
+    free(search.prompt);
+    arena_destroy(&completion_arena);
 
-    return strdup(input.buffer);
-}
\ No newline at end of file
+    if (!input.buffer)
+        return NULL;
+    gap_buffer_text(&input);
+    return (char *)input.buffer;
+}
@@ -1,140 +1,877 @@
 #define _POSIX_C_SOURCE 200809L
+#include "tokenizer.h"
+
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define TOKENIZER_HAVE_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+/**
+ * Delimiter scanning.
+ *
+ * The tokenizer only has decisions to make at whitespace, quotes, backslashes, '|', '&', '<',
+ * '>', '$' and '`'.
+ * Everything between them is a plain run that is copied to the token as is, so the main
+ * loop asks a scanner for the length of the next plain run and bulk-copies it. The scalar
+ * scanner is the reference; the SSE2 (16 bytes per step) and AVX2 (32 bytes per step)
+ * scanners must return exactly the same lengths and are checked against it in
+ * tokenizer_test.
+ */
+typedef size_t (*ScanFn)(const char *s, size_t len);
+
+static bool is_delimiter(const char c) {
+    return c == ' ' || c == '\t' || c == '\'' || c == '"' || c == '\\' || c == '|' || c == '&' ||
+           c == '<' || c == '>' || c == '$' || c == '`';
+}
+
+static size_t scan_scalar(const char *s, const size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        if (is_delimiter(s[i]))
+            return i;
+    }
+    return len;
+}
+
+#ifdef TOKENIZER_HAVE_X86_SIMD
+static size_t scan_sse2(const char *s, const size_t len) {
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i squote = _mm_set1_epi8('\'');
+    const __m128i dquote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i pipe = _mm_set1_epi8('|');
+    const __m128i amp = _mm_set1_epi8('&');
+    const __m128i less = _mm_set1_epi8('<');
+    const __m128i greater = _mm_set1_epi8('>');
+    const __m128i dollar = _mm_set1_epi8('$');
+    const __m128i backtick = _mm_set1_epi8('`');
+
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        const __m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+        __m128i hits = _mm_or_si128(_mm_cmpeq_epi8(v, space), _mm_cmpeq_epi8(v, tab));
+        hits = _mm_or_si128(hits, _mm_cmpeq_epi8(v, squote));
+        hits = _mm_or_si128(hits, _mm_cmpeq_epi8(v, dquote));
+        hits = _mm_or_si128(hits, _mm_cmpeq_epi8(v, backslash));
+        hits = _mm_or_si128(hits, _mm_cmpeq_epi8(v, pipe));
+        hits = _mm_or_si128(hits, _mm_cmpeq_epi8(v, amp));
+        hits = _mm_or_si128(hits, _mm_cmpeq_epi8(v, less));
+        hits = _mm_or_si128(hits, _mm_cmpeq_epi8(v, greater));
+        hits = _mm_or_si128(hits, _mm_cmpeq_epi8(v, dollar));
+        hits = _mm_or_si128(hits, _mm_cmpeq_epi8(v, backtick));
+
+        const unsigned mask = (unsigned)_mm_movemask_epi8(hits);
+        if (mask)
+            return i + __builtin_ctz(mask);
+    }
+
+    return i + scan_scalar(s + i, len - i);
+}
+
+__attribute__((target("avx2"))) static size_t scan_avx2(const char *s, const size_t len) {
+    const __m256i space = _mm256_set1_epi8(' ');
+    const __m256i tab = _mm256_set1_epi8('\t');
+    const __m256i squote = _mm256_set1_epi8('\'');
+    const __m256i dquote = _mm256_set1_epi8('"');
+    const __m256i backslash = _mm256_set1_epi8('\\');
+    const __m256i pipe = _mm256_set1_epi8('|');
+    const __m256i amp = _mm256_set1_epi8('&');
+    const __m256i less = _mm256_set1_epi8('<');
+    const __m256i greater = _mm256_set1_epi8('>');
+    const __m256i dollar = _mm256_set1_epi8('$');
+    const __m256i backtick = _mm256_set1_epi8('`');
+
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        const __m256i v = _mm256_loadu_si256((const __m256i *)(s + i));
+        __m256i hits = _mm256_or_si256(_mm256_cmpeq_epi8(v, space), _mm256_cmpeq_epi8(v, tab));
+        hits = _mm256_or_si256(hits, _mm256_cmpeq_epi8(v, squote));
+        hits = _mm256_or_si256(hits, _mm256_cmpeq_epi8(v, dquote));
+        hits = _mm256_or_si256(hits, _mm256_cmpeq_epi8(v, backslash));
+        hits = _mm256_or_si256(hits, _mm256_cmpeq_epi8(v, pipe));
+        hits = _mm256_or_si256(hits, _mm256_cmpeq_epi8(v, amp));
+        hits = _mm256_or_si256(hits, _mm256_cmpeq_epi8(v, less));
+        hits = _mm256_or_si256(hits, _mm256_cmpeq_epi8(v, greater));
+        hits = _mm256_or_si256(hits, _mm256_cmpeq_epi8(v, dollar));
+        hits = _mm256_or_si256(hits, _mm256_cmpeq_epi8(v, backtick));
+
+        const unsigned mask = (unsigned)_mm256_movemask_epi8(hits);
+        if (mask)
+            return i + __builtin_ctz(mask);
+    }
+
+    // Tail of fewer than 32 bytes
+    return i + scan_sse2(s + i, len - i);
+}
+#endif
+
+static ScanFn scan_next_delimiter = NULL;
+
+/**
+ * Picks the scanner used by tokenize_input_n().
+ *
+ * @return  false (and leaves the current choice alone) if this CPU or build cannot run @impl.
+ */
+bool tokenizer_set_scan_impl(const TokenizerScanImpl impl) {
+    switch (impl) {
+    case TOKENIZER_SCAN_SCALAR:
+        scan_next_delimiter = scan_scalar;
+        return true;
+#ifdef TOKENIZER_HAVE_X86_SIMD
+    case TOKENIZER_SCAN_SSE2:
+        scan_next_delimiter = scan_sse2;
+        return true;
+    case TOKENIZER_SCAN_AVX2:
+        __builtin_cpu_init();
+        if (!__builtin_cpu_supports("avx2"))
+            return false;
+        scan_next_delimiter = scan_avx2;
+        return true;
+    case TOKENIZER_SCAN_AUTO:
+        __builtin_cpu_init();
+        scan_next_delimiter = __builtin_cpu_supports("avx2") ? scan_avx2 : scan_sse2;
+        return true;
+#else
+    case TOKENIZER_SCAN_AUTO:
+        scan_next_delimiter = scan_scalar;
+        return true;
+    default:
+        return false;
+#endif
+    }
+
+    return false;
+}
+
+typedef enum { HERE_DOC_NONE, HERE_DOC_PLAIN, HERE_DOC_STRIP_TABS } HereDocMode;
+
+// Bits of the flag byte that follows each finished token's NUL
+enum { TOKEN_PATTERN = 1, TOKEN_OPERATOR = 2 };
+
+/**
+ * Token text is written back to back, each token NUL-terminated, into one growable arena
+ * buffer. While it is the newest arena allocation it grows in place. Command substitutions,
+ * here-documents and parameter lookups may allocate from the same arena mid-scan, and the
+ * next growth after that copies the buffer instead.
+ *
+ * @text         Start of the token text.
+ * @len          Bytes written so far, including the NULs of finished tokens.
+ * @cap          Bytes available in text.
+ * @token_start  Offset of the token being built.
+ * @token_count  Number of finished tokens.
+ * @quoted       The token being built contains quoted or escaped characters.
+ * @glob_mode    Words may be patterns: a pattern token keeps its literal metacharacters
+ *               backslash-escaped.
+ * @pattern      The token being built has an unquoted `*`, `?` or `[`.
+ * @operator     The token being built is an unquoted `|`, `&` or redirection operator.
+ * @escaped      The token being built holds escape backslashes.
+ * @here_document  The token being built is the delimiter of a `<<` (or `<<-`) here-document.
+ * @hooks        Expansion hooks, for reading here-documents.
+ */
+typedef struct {
+    Arena *arena;
+    char *text;
+    size_t len;
+    size_t cap;
+    size_t token_start;
+    int token_count;
+    bool quoted;
+    bool glob_mode;
+    bool pattern;
+    bool operator;
+    bool escaped;
+    HereDocMode here_document;
+    const TokenizerHooks *hooks;
+} TokenWriter;
+
+static bool writer_reserve(TokenWriter *w, const size_t extra) {
+    if (w->len + extra <= w->cap)
+        return true;
+
+    size_t new_cap = w->cap ? w->cap * 2 : 64;
+    while (new_cap < w->len + extra)
+        new_cap *= 2;
+
+    char *text = arena_grow(w->arena, w->text, w->len, new_cap);
+    if (!text) {
+        perror("arena_grow");
+        return false;
+    }
+
+    w->text = text;
+    w->cap = new_cap;
+    return true;
+}
+
+static bool writer_put(TokenWriter *w, const char c) {
+    if (!writer_reserve(w, 1))
+        return false;
+
+    w->text[w->len++] = c;
+    return true;
+}
+
+static bool writer_append(TokenWriter *w, const char *s, const size_t n) {
+    if (!writer_reserve(w, n))
+        return false;
+
+    memcpy(w->text + w->len, s, n);
+    w->len += n;
+    return true;
+}
+
+static bool is_glob_char(const char c) { return c == '*' || c == '?' || c == '['; }
+
+// Characters a pattern gives a meaning to, escaped when they stand for themselves
+static bool is_glob_special(const char c) { return is_glob_char(c) || c == ']' || c == '\\'; }
+
+/**
+ * Writes characters that stand for themselves: quoted, escaped or from a quoted expansion.
+ * When words may be patterns, the ones a pattern would interpret get a backslash in front.
+ */
+static bool writer_append_literal(TokenWriter *w, const char *s, const size_t n) {
+    size_t start = 0;
+    for (size_t i = 0; w->glob_mode && i < n; i++) {
+        if (!is_glob_special(s[i]))
+            continue;
+        if (!writer_append(w, s + start, i - start) || !writer_put(w, '\\'))
+            return false;
+        w->escaped = true;
+        start = i;
+    }
+    return writer_append(w, s + start, n - start);
+}
+
+static bool writer_put_literal(TokenWriter *w, const char c) {
+    return writer_append_literal(w, &c, 1);
+}
+
+/**
+ * Writes unquoted characters, noting whether they make the word a pattern.
+ */
+static bool writer_append_word(TokenWriter *w, const char *s, const size_t n) {
+    for (size_t i = 0; w->glob_mode && !w->pattern && i < n; i++)
+        w->pattern = is_glob_char(s[i]);
+    return writer_append(w, s, n);
+}
+
+/**
+ * Drops the escape backslashes from the @len bytes at @s. Every literal backslash was
+ * escaped too, so each backslash escapes exactly the byte after it.
+ *
+ * @return  The new length.
+ */
+static size_t unescape(char *s, const size_t len) {
+    size_t out = 0;
+    for (size_t in = 0; in < len; in++) {
+        if (s[in] == '\\' && in + 1 < len)
+            in++;
+        s[out++] = s[in];
+    }
+    return out;
+}
+
+static bool writer_has_token(const TokenWriter *w) { return w->len > w->token_start; }
+
+/**
+ * Replaces the delimiter word just written with the number of the descriptor holding the
+ * here-document it ends, as read by the here_document hook.
+ */
+static bool writer_read_here_document(TokenWriter *w) {
+    const bool strip_tabs = w->here_document == HERE_DOC_STRIP_TABS;
+    w->here_document = HERE_DOC_NONE;
+    if (!writer_put(w, '\0'))
+        return false;
+
+    const char *delimiter = w->text + w->token_start;
+    const int fd = w->hooks->here_document(w->hooks->ctx, w->arena, delimiter, strip_tabs,
+                                           !w->quoted);
+    if (fd < 0)
+        return false;
+
+    char number[16];
+    const int n = snprintf(number, sizeof(number), "%d", fd);
+    w->len = w->token_start;
+    return writer_append(w, number, n);
+}
+
+static bool writer_end_token(TokenWriter *w) {
+    // A delimiter is compared as written, never matched as a pattern
+    if (w->here_document)
+        w->pattern = false;
+
+    // A word that is no pattern needs none of its escapes
+    if (w->escaped && !w->pattern)
+        w->len = w->token_start + unescape(w->text + w->token_start, w->len - w->token_start);
+
+    if (w->here_document && !writer_read_here_document(w))
+        return false;
+
+    // Each token is followed by its NUL and a byte of TOKEN_* flags
+    const char flags = (w->pattern ? TOKEN_PATTERN : 0) | (w->operator ? TOKEN_OPERATOR : 0);
+    if (!writer_put(w, '\0') || !writer_put(w, flags))
+        return false;
+
+    w->token_start = w->len;
+    w->token_count++;
+    w->quoted = false;
+    w->pattern = false;
+    w->operator = false;
+    w->escaped = false;
+    return true;
+}
+
+/**
+ * @return  true if the token built so far is the fd part of a redirection operator at
+ *          @op: a single unquoted digit (`2>`), or '&' in front of '>' (`&>`).
+ */
+static bool writer_is_operator_prefix(const TokenWriter *w, const char op) {
+    if (w->quoted || w->len - w->token_start != 1)
+        return false;
+
+    const char c = w->text[w->token_start];
+    return (c >= '0' && c <= '9') || (c == '&' && op == '>');
+}
+
+static bool ends_word(const char c) {
+    return c == ' ' || c == '\t' || c == '|' || c == '&' || c == '<' || c == '>';
+}
+
+/**
+ * Length of the redirection operator starting at s[0], which is '<' or '>': one of
+ * <, <>, <&, <<, <<-, <<<, >, >>, >&, and after a '&' the fd number or '-' it is glued to
+ * (2>&1, >&-).
+ */
+static size_t operator_length(const char *s, const size_t len) {
+    if (s[0] == '<' && len > 1 && s[1] == '<')
+        return len > 2 && (s[2] == '<' || s[2] == '-') ? 3 : 2;
+
+    size_t n = 1;
+    if (n < len && (s[n] == '>' || s[n] == '&'))
+        n++;
+    if (s[n - 1] != '&' || n == len)
+        return n;
+
+    if (s[n] == '-')
+        return n + 1;
+
+    // `>&1` takes the fd along, `>&1.log` is a file name (the old spelling of `&>1.log`)
+    size_t digits = n;
+    while (digits < len && s[digits] >= '0' && s[digits] <= '9')
+        digits++;
+    return digits == len || ends_word(s[digits]) ? digits : n;
+}
+
+/**
+ * Points an argv-style array at the finished tokens, replacing each pattern with the paths
+ * it matches.
+ *
+ * @param operators_out  Out, when not NULL: for each entry, whether it is an operator.
+ * @param count_out      Out: number of entries in the array.
+ */
+static char **writer_finish(TokenWriter *w, const TokenizerHooks *hooks, bool **operators_out,
+                            int *count_out) {
+    char **words = arena_alloc(w->arena, (w->token_count + 1) * sizeof *words);
+    bool *operators = arena_alloc(w->arena, (w->token_count + 1) * sizeof *operators);
+    if (!words || !operators) {
+        perror("arena_alloc");
+        return NULL;
+    }
+
+    char *p = w->text;
+    int total = w->token_count;
+    char ***matches = NULL;
+    int *match_counts = NULL;
+    for (int i = 0; i < w->token_count; i++) {
+        words[i] = p;
+        const size_t len = strlen(p);
+        p += len + 1;
+        const char flags = *p++;
+        operators[i] = flags & TOKEN_OPERATOR;
+        if (!w->glob_mode || !(flags & TOKEN_PATTERN))
+            continue;
+
+        if (!matches) {
+            matches = arena_alloc(w->arena, w->token_count * sizeof *matches);
+            match_counts = arena_alloc(w->arena, w->token_count * sizeof *match_counts);
+            if (!matches || !match_counts) {
+                perror("arena_alloc");
+                return NULL;
+            }
+            memset(match_counts, 0, w->token_count * sizeof *match_counts);
+        }
+
+        const int n = hooks->glob(hooks->ctx, w->arena, words[i], &matches[i]);
+        if (n < 0)
+            return NULL;
+        if (n == 0) {
+            // No match: the word stays, as written
+            words[i][unescape(words[i], len)] = '\0';
+            continue;
+        }
+        match_counts[i] = n;
+        total += n - 1;
+    }
+
+    if (!matches) {
+        words[w->token_count] = NULL;
+        operators[w->token_count] = false;
+        if (operators_out)
+            *operators_out = operators;
+        *count_out = w->token_count;
+        return words;
+    }
+
+    char **tokens = arena_alloc(w->arena, (total + 1) * sizeof *tokens);
+    bool *token_operators = arena_alloc(w->arena, (total + 1) * sizeof *token_operators);
+    if (!tokens || !token_operators) {
+        perror("arena_alloc");
+        return NULL;
+    }
+    int n = 0;
+    for (int i = 0; i < w->token_count; i++) {
+        if (match_counts[i] == 0) {
+            token_operators[n] = operators[i];
+            tokens[n++] = words[i];
+            continue;
+        }
+        memcpy(tokens + n, matches[i], match_counts[i] * sizeof *tokens);
+        memset(token_operators + n, 0, match_counts[i] * sizeof *token_operators);
+        n += match_counts[i];
+    }
+    tokens[n] = NULL;
+    token_operators[n] = false;
+    if (operators_out)
+        *operators_out = token_operators;
+    *count_out = n;
+    return tokens;
+}
+
+static bool is_name_start(const char c) {
+    return c == '_' || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+static bool is_name_char(const char c) { return is_name_start(c) || (c >= '0' && c <= '9'); }
+
+/**
+ * Finds the parameter named by the `$` at s[0]: `$NAME`, `${NAME}`, `$?` or `$$`.
+ *
+ * @param name      Out: the name.
+ * @param name_len  Out: its length.
+ * @return          Bytes the reference takes up in the input, 0 if the '$' is a plain
+ *                  character, or -1 for a malformed `${...}`.
+ */
+static long parameter_reference(const char *s, const size_t len, const char **name,
+                                size_t *name_len) {
+    if (len < 2)
+        return 0;
+
+    if (s[1] == '?' || s[1] == '$') {
+        *name = s + 1;
+        *name_len = 1;
+        return 2;
+    }
+
+    if (s[1] == '{') {
+        const char *close = memchr(s + 2, '}', len - 2);
+        if (!close)
+            return -1;
+
+        *name = s + 2;
+        *name_len = close - *name;
+        const bool special = *name_len == 1 && (**name == '?' || **name == '$');
+        if (!special && (*name_len == 0 || !is_name_start(**name)))
+            return -1;
+        for (size_t k = 1; !special && k < *name_len; k++) {
+            if (!is_name_char((*name)[k]))
+                return -1;
+        }
+        return close - s + 1;
+    }
+
+    if (!is_name_start(s[1]))
+        return 0;
+
+    size_t n = 2;
+    while (n < len && is_name_char(s[n]))
+        n++;
+    *name = s + 1;
+    *name_len = n - 1;
+    return (long)n;
+}
+
+/**
+ * Finds the ')' that closes a `$(`, skipping quoted text, escapes and nested parentheses.
+ *
+ * @param s  The command, just past the `$(`.
+ * @return   Length of the command, or -1 if the `$(` is never closed.
+ */
+static long substitution_length(const char *s, const size_t len) {
+    int depth = 1;
+    char quote = 0;
+    for (size_t k = 0; k < len; k++) {
+        const char c = s[k];
+        if (c == '\\' && quote != '\'') {
+            k++;
+        } else if (quote) {
+            quote = c == quote ? 0 : quote;
+        } else if (c == '\'' || c == '"') {
+            quote = c;
+        } else if (c == '(') {
+            depth++;
+        } else if (c == ')' && --depth == 0) {
+            return (long)k;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Copies the command of the backquoted substitution at @s (just past the opening '`') into
+ * @arena, undoing the backslash escapes of '`', '\\' and '$' inside it.
+ *
+ * @param consumed  Out: bytes taken from @s, the closing '`' included.
+ * @return          The command, or NULL if there is no closing '`' (or no memory).
+ */
+static char *backquoted_command(Arena *arena, const char *s, const size_t len, size_t *cmd_len,
+                                size_t *consumed) {
+    char *command = arena_alloc(arena, len + 1);
+    if (!command)
+        return NULL;
+
+    size_t n = 0;
+    for (size_t k = 0; k < len; k++) {
+        if (s[k] == '`') {
+            command[n] = '\0';
+            *cmd_len = n;
+            *consumed = k + 1;
+            return command;
+        }
+        const char next = k + 1 < len ? s[k + 1] : '\0';
+        if (s[k] == '\\' && (next == '`' || next == '\\' || next == '$'))
+            k++;
+        command[n++] = s[k];
+    }
+    return NULL;
+}
+
+/**
+ * Writes the value of a parameter. Inside double quotes it stays part of the current word;
+ * unquoted, blanks in it split words (field splitting), so `$ARGS` can stand for several
+ * arguments and an empty unquoted expansion adds none.
+ */
+static bool writer_expand(TokenWriter *w, const char *value, const bool quoted) {
+    if (quoted)
+        return writer_append_literal(w, value, strlen(value));
+
+    for (const char *p = value; *p; p++) {
+        if (*p == ' ' || *p == '\t' || *p == '\n') {
+            if (writer_has_token(w) && !writer_end_token(w))
+                return false;
+        } else if (!(*p == '\\' ? writer_put_literal(w, *p) : writer_append_word(w, p, 1))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Expands the command substitution or parameter reference at s[0], a '$' or '`'.
+ *
+ * @param quoted  The reference is inside double quotes (or a here-document): no splitting.
+ * @return        Bytes it takes up in the input, 0 if s[0] is a plain character here, or -1
+ *                on error.
+ */
+static long writer_expand_reference(TokenWriter *w, const char *s, const size_t len,
+                                    const TokenizerHooks *hooks, const bool quoted) {
+    if (!hooks)
+        return 0;
+
+    if (s[0] == '$' && len > 1 && s[1] == '(' && hooks->substitute) {
+        const long n = substitution_length(s + 2, len - 2);
+        if (n < 0) {
+            fprintf(stderr, "%.*s: unterminated command substitution\n", (int)len, s);
+            return -1;
+        }
+        const char *output = hooks->substitute(hooks->ctx, w->arena, s + 2, n);
+        if (!output || !writer_expand(w, output, quoted))
+            return -1;
+        return n + 3;
+    }
+
+    if (s[0] == '`' && hooks->substitute) {
+        size_t cmd_len, consumed;
+        const char *command = backquoted_command(w->arena, s + 1, len - 1, &cmd_len, &consumed);
+        if (!command) {
+            fprintf(stderr, "%.*s: unterminated command substitution\n", (int)len, s);
+            return -1;
+        }
+        const char *output = hooks->substitute(hooks->ctx, w->arena, command, cmd_len);
+        if (!output || !writer_expand(w, output, quoted))
+            return -1;
+        return (long)consumed + 1;
+    }
+
+    if (s[0] == '$' && hooks->lookup) {
+        const char *name;
+        size_t name_len;
+        const long n = parameter_reference(s, len, &name, &name_len);
+        if (n < 0) {
+            fprintf(stderr, "%.*s: bad substitution\n", (int)len, s);
+            return -1;
+        }
+        if (n > 0) {
+            const char *value = hooks->lookup(hooks->ctx, name, name_len);
+            if (value && !writer_expand(w, value, quoted))
+                return -1;
+        }
+        return n;
+    }
+
+    return 0;
+}
+
 /**
- * Splits input into at most capacity-1 tokens, always NULL‑terminating tokens[].
+ * Splits input into tokens allocated from @arena, expanding parameters, command substitutions
+ * and patterns through @hooks.
  *
- * @param input     The line to tokenize.
- * @param tokens    Output array of tokens.
- * @param capacity  Total size of tokens[] (must be ≥2).
- * @return          Number of real tokens (0..capacity-1), or -1 on error.
+ * A quoted `">"` and a bare `>` come out as the same string, so which tokens are operators
+ * (`|`, `&` and redirections, as written unquoted) is reported separately.
+ *
+ * @param arena          Allocator for the token text and the tokens[] array.
+ * @param input          The line to tokenize, need not be NUL-terminated.
+ * @param len            Number of bytes in input.
+ * @param hooks          Parameter, command and pathname expansion; NULL leaves every '$',
+ *                       '`' and pattern as it is.
+ * @param tokens_out     Out: NULL-terminated array of tokens, valid until the arena is reset.
+ * @param operators_out  Out, when not NULL: parallel to tokens_out, true for operator tokens.
+ * @return               Number of tokens, or -1 on error.
  */
-int tokenize_input(const char *input, char *tokens[], int capacity) {
+int tokenize_input_expand(Arena *arena, const char *input, const size_t len,
+                          const TokenizerHooks *hooks, char ***tokens_out, bool **operators_out) {
     // TODO: Better error handling, perhaps return an enum with tokenizer_errors instead
-    if (capacity < 2)
+    TokenWriter w = {.arena = arena, .glob_mode = hooks && hooks->glob, .hooks = hooks};
+
+    // Unquoting only ever shrinks a token and each token adds two bytes (NUL and flags), so
+    // this is the only allocation unless operators are glued to words or expansions grow
+    if (!writer_reserve(&w, 2 * len + 2))
         return -1;
 
-    int max_tokens = capacity - 1;
-    char token_buffer[128]; // TODO: Should probably look over buffer sizing
-    int token_len = 0;
-    int token_count = 0;
+    if (!scan_next_delimiter)
+        tokenizer_set_scan_impl(TOKENIZER_SCAN_AUTO);
 
-    int i = 0;
+    size_t i = 0;
     char quote = 0;
-    while (input[i] != '\0') {
+    while (i < len) {
+        // Plain bytes mean the same thing in every quoting state: copy the whole run
+        const size_t run = scan_next_delimiter(input + i, len - i);
+        if (run > 0) {
+            const bool ok = quote ? writer_append_literal(&w, input + i, run)
+                                  : writer_append_word(&w, input + i, run);
+            if (!ok)
+                return -1;
+            i += run;
+            if (i == len)
+                break;
+        }
+
         const char c = input[i];
         if (c == '\'' || c == '"') {
             if (quote == 0) {
                 quote = c;
+                w.quoted = true;
             } else if (quote == c) {
                 quote = 0;
-            } else {
-                token_buffer[token_len++] = c;
+            } else if (!writer_put(&w, c)) {
+                return -1;
             }
             i++;
             continue;
         }
 
         if (quote == '"' && c == '\\') {
-            const char next = input[i + 1];
+            const char next = i + 1 < len ? input[i + 1] : '\0';
             if (next == '\0') {
                 // No character to escape: end token and drop trailing backslash
                 break;
             }
 
-            if (next == '"' || next == '\\' || next == '$' || next == '\n') {
-                token_buffer[token_len++] = next;
+            if (next == '"' || next == '\\' || next == '$' || next == '`' || next == '\n') {
+                if (!writer_put_literal(&w, next))
+                    return -1;
                 i += 2;
                 continue;
             }
         }
 
         if (quote == 0 && c == '\\') {
-            const char next = input[i + 1];
+            const char next = i + 1 < len ? input[i + 1] : '\0';
             if (next == '\0') {
                 // We don’t support line‐continuation here—drop trailing '\' and finish token
                 break;
             }
 
-            if (token_len >= sizeof(token_buffer) - 1)
-                goto error;
-
-            token_buffer[token_len++] = next;
+            w.quoted = true;
+            if (!writer_put_literal(&w, next))
+                return -1;
             i += 2;
             continue;
         }
 
-        if (quote == 0 && (c == ' ' || c == '\t')) {
-            // Check for multiple spaces and skip
-            if (token_len == 0) {
-                i++;
+        // A here-document's delimiter is taken as written
+        if ((c == '$' || c == '`') && quote != '\'' && !w.here_document) {
+            const long n = writer_expand_reference(&w, input + i, len - i, hooks, quote == '"');
+            if (n < 0)
+                return -1;
+            if (n > 0) {
+                i += n;
                 continue;
             }
+        }
 
-            token_buffer[token_len] = '\0';
+        if (quote == 0 && c == '|') {
+            // A pipe is always a token of its own, even when written as "a|b"
+            if (writer_has_token(&w) && !writer_end_token(&w))
+                return -1;
 
-            if (token_count >= max_tokens)
-                goto error;
+            w.here_document = HERE_DOC_NONE;
+            w.operator = true;
+            if (!writer_put(&w, '|') || !writer_end_token(&w))
+                return -1;
+            i++;
+            continue;
+        }
 
-            char *token = strdup(token_buffer);
-            if (!token) {
-                perror("strdup");
-                goto error;
-            }
+        if (quote == 0 && c == '&') {
+            // '&' runs a command in the background and is a token of its own, like '|'.
+            // In front of '>' it starts the `&>` operator instead.
+            if (writer_has_token(&w) && !writer_end_token(&w))
+                return -1;
 
-            tokens[token_count++] = token;
-            token_len = 0;
+            w.here_document = HERE_DOC_NONE;
+            w.operator = true;
+            if (!writer_put(&w, '&'))
+                return -1;
             i++;
+            if ((i == len || input[i] != '>') && !writer_end_token(&w))
+                return -1;
             continue;
         }
 
-        if (token_len >= sizeof(token_buffer) - 1)
-            goto error;
+        if (quote == 0 && (c == '<' || c == '>')) {
+            // Redirection operators are tokens of their own too, together with their fd:
+            // "a>b" is `a > b`, "2>&1" stays whole and '>' stays a word
+            if (!writer_is_operator_prefix(&w, c) && writer_has_token(&w) &&
+                !writer_end_token(&w))
+                return -1;
+
+            w.here_document = HERE_DOC_NONE;
+            w.operator = true;
+            const size_t n = operator_length(input + i, len - i);
+            if (!writer_append(&w, input + i, n) || !writer_end_token(&w))
+                return -1;
 
-        token_buffer[token_len++] = c;
+            // The next word is a here-document delimiter; the body is read when it ends
+            const bool here = n >= 2 && input[i + 1] == '<' && (n == 2 || input[i + 2] == '-');
+            if (here && hooks && hooks->here_document)
+                w.here_document = n == 3 ? HERE_DOC_STRIP_TABS : HERE_DOC_PLAIN;
+            i += n;
+            continue;
+        }
+
+        if (quote == 0 && (c == ' ' || c == '\t')) {
+            // Check for multiple spaces and skip
+            if (writer_has_token(&w) && !writer_end_token(&w))
+                return -1;
+            i++;
+            continue;
+        }
+
+        // A backslash inside double quotes that escapes nothing, a lone '$' or a literal '`'
+        if (!writer_put_literal(&w, c))
+            return -1;
         i++;
     }
 
     if (quote != 0)
-        goto error;
+        return -1;
+
+    if (writer_has_token(&w) && !writer_end_token(&w))
+        return -1;
 
-    if (token_len > 0) {
-        if (token_count >= max_tokens)
-            goto error;
+    int token_count;
+    char **tokens = writer_finish(&w, hooks, operators_out, &token_count);
+    if (!tokens)
+        return -1;
+
+    *tokens_out = tokens;
+    return token_count;
+}
 
-        token_buffer[token_len] = '\0';
-        char *token = strdup(token_buffer);
-        if (!token) {
-            perror("strdup");
-            goto error;
+/**
+ * Expands one line of a here-document whose delimiter was not quoted. Parameters and command
+ * substitutions are replaced as inside double quotes, quotes are ordinary characters, and a
+ * backslash only escapes '$', '`' and '\\'. Nothing is split or globbed.
+ *
+ * @param len_out  Out: length of the result.
+ * @return         The expanded line, NUL-terminated, allocated from @arena; NULL on error.
+ */
+char *tokenize_here_document(Arena *arena, const char *line, const size_t len,
+                             const TokenizerHooks *hooks, size_t *len_out) {
+    TokenWriter w = {.arena = arena};
+    if (!writer_reserve(&w, len + 1))
+        return NULL;
+
+    size_t i = 0;
+    while (i < len) {
+        size_t run = 0;
+        while (i + run < len && line[i + run] != '$' && line[i + run] != '`' &&
+               line[i + run] != '\\')
+            run++;
+        if (!writer_append(&w, line + i, run))
+            return NULL;
+        i += run;
+        if (i == len)
+            break;
+
+        const char c = line[i];
+        const char next = i + 1 < len ? line[i + 1] : '\0';
+        if (c == '\\' && (next == '$' || next == '`' || next == '\\')) {
+            if (!writer_put(&w, next))
+                return NULL;
+            i += 2;
+            continue;
         }
 
-        tokens[token_count++] = token;
+        const long n = c == '\\' ? 0 : writer_expand_reference(&w, line + i, len - i, hooks, true);
+        if (n < 0)
+            return NULL;
+        if (n == 0 && !writer_put(&w, c))
+            return NULL;
+        i += n > 0 ? (size_t)n : 1;
     }
 
-    tokens[token_count] = NULL;
-    return token_count;
+    if (!writer_put(&w, '\0'))
+        return NULL;
+    *len_out = w.len - 1;
+    return w.text;
+}
 
-error:
-    for (int j = 0; j < token_count; j++) {
-        free(tokens[j]);
-    }
-    return -1;
+/**
+ * Splits input into tokens without expanding anything; '$' is an ordinary character.
+ */
+int tokenize_input_n(Arena *arena, const char *input, const size_t len, char ***tokens_out) {
+    return tokenize_input_expand(arena, input, len, NULL, tokens_out, NULL);
 }
 
 /**
- * @brief Frees shell command tokens.
- *
- * Frees each dynamically allocated token string used by the shell.
- *
- * @param tokens Array of command tokens.
- * @param count  Number of tokens.
+ * tokenize_input_n() for a NUL-terminated line.
  */
-void free_tokens(char *tokens[], const int count) {
-    for (int i = 0; i < count; i++) {
-        free(tokens[i]);
-        tokens[i] = NULL;
-    }
+int tokenize_input(Arena *arena, const char *input, char ***tokens_out) {
+    return tokenize_input_n(arena, input, strlen(input), tokens_out);
 }
@@ -1,7 +1,56 @@
 #ifndef TOKENIZER_H
 #define TOKENIZER_H
+#include "arena.h"
 
-int tokenize_input(const char *input, char *tokens[], int capacity);
-void free_tokens(char *tokens[], int count);
+#include <stdbool.h>
+#include <stddef.h>
 
-#endif
\ No newline at end of file
+/**
+ * Delimiter scanner used by the tokenizer. AUTO picks AVX2 when the CPU has it, SSE2 on
+ * other x86 CPUs and the scalar reference everywhere else.
+ */
+typedef enum {
+    TOKENIZER_SCAN_AUTO,
+    TOKENIZER_SCAN_SCALAR,
+    TOKENIZER_SCAN_SSE2,
+    TOKENIZER_SCAN_AVX2,
+} TokenizerScanImpl;
+
+/**
+ * How the tokenizer expands `$NAME`, `${NAME}`, `$?` and `$$`, `$(command)` and
+ * `` `command` ``, and words with unquoted `*`, `?` or `[`, and where the bodies of
+ * here-documents come from.
+ *
+ * @lookup         Returns the value of the parameter @name (@len bytes, not NUL-terminated),
+ *                 or NULL if it is unset. The value must stay valid until tokenizing is done.
+ * @substitute     Runs @command (@len bytes, not NUL-terminated) and returns its output
+ *                 without trailing newlines, allocated from @arena; NULL on a fatal error.
+ *                 NULL leaves `$(` and '`' as they are.
+ * @glob           Expands @pattern, in which a backslash makes the next character literal
+ *                 (quoted metacharacters arrive escaped), into @matches_out allocated from
+ *                 @arena. Returns the number of matches, 0 to keep the word as written, -1 on
+ *                 error. NULL turns pathname expansion off.
+ * @here_document  Reads the body of a `<<delimiter` (`<<-` sets @strip_tabs) into a file
+ *                 and returns its descriptor, which replaces the delimiter word; -1 on error.
+ *                 @expand is false when the delimiter was quoted. NULL leaves the delimiter
+ *                 word as it is.
+ * @ctx            Passed to every hook.
+ */
+typedef struct {
+    const char *(*lookup)(void *ctx, const char *name, size_t len);
+    const char *(*substitute)(void *ctx, Arena *arena, const char *command, size_t len);
+    int (*glob)(void *ctx, Arena *arena, const char *pattern, char ***matches_out);
+    int (*here_document)(void *ctx, Arena *arena, const char *delimiter, bool strip_tabs,
+                         bool expand);
+    void *ctx;
+} TokenizerHooks;
+
+bool tokenizer_set_scan_impl(TokenizerScanImpl impl);
+int tokenize_input(Arena *arena, const char *input, char ***tokens_out);
+int tokenize_input_n(Arena *arena, const char *input, size_t len, char ***tokens_out);
+int tokenize_input_expand(Arena *arena, const char *input, size_t len,
+                          const TokenizerHooks *hooks, char ***tokens_out, bool **operators_out);
+char *tokenize_here_document(Arena *arena, const char *line, size_t len,
+                             const TokenizerHooks *hooks, size_t *len_out);
+
+#endif
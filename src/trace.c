@@ -0,0 +1,110 @@
+#define _POSIX_C_SOURCE 200809L
+#include "trace.h"
+#include "outbuf.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * Phase timings of the main loop, written as Chrome trace events (chrome://tracing,
+ * Perfetto) to the file named by SLEEPYSHELL_TRACE.
+ *
+ * Events are complete ("X") events with microsecond timestamps from CLOCK_MONOTONIC. They
+ * collect in an OutBuf, so tracing costs a clock read and a formatted copy per phase and
+ * a write only when the buffer fills. The file is valid JSON once trace_close() has run;
+ * the viewers also accept a trace cut short by a crash.
+ */
+
+bool trace_active = false;
+
+static const char *const phase_names[] = {
+    [TRACE_READ] = "read",
+    [TRACE_TOKENIZE] = "tokenize",
+    [TRACE_PARSE] = "parse",
+    [TRACE_REDIRECT] = "redirect",
+    [TRACE_RESOLVE] = "resolve",
+    [TRACE_SPAWN] = "spawn",
+    [TRACE_FORK] = "fork",
+    [TRACE_BUILTIN] = "builtin",
+    [TRACE_WAIT] = "wait",
+};
+
+static OutBuf trace_out;
+static int trace_pid;
+static bool first_event = true;
+
+uint64_t trace_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+bool trace_open(const char *path) {
+    const int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd == -1)
+        return false;
+
+    outbuf_init(&trace_out, fd);
+    outbuf_puts_ref(&trace_out, "{\"traceEvents\":[");
+    trace_pid = getpid();
+    trace_active = true;
+    atexit(trace_close);
+    return true;
+}
+
+void trace_close(void) {
+    // Forked children inherit the buffer but must leave the file to the shell
+    if (!trace_active || getpid() != trace_pid)
+        return;
+
+    outbuf_puts_ref(&trace_out, "\n]}\n");
+    outbuf_flush(&trace_out);
+    close(trace_out.fd);
+    trace_active = false;
+}
+
+/**
+ * Appends @detail as the contents of a JSON string. Commands are rarely more than a few
+ * words, so only a bounded prefix is kept.
+ */
+static void write_json_string(const char *detail) {
+    char escaped[256];
+    size_t len = 0;
+    for (const unsigned char *p = (const unsigned char *)detail;
+         *p && len < sizeof(escaped) - 6; p++) {
+        if (*p == '"' || *p == '\\') {
+            escaped[len++] = '\\';
+            escaped[len++] = (char)*p;
+        } else if (*p < 0x20) {
+            len += snprintf(escaped + len, 7, "\\u%04x", *p);
+        } else {
+            escaped[len++] = (char)*p;
+        }
+    }
+    outbuf_write(&trace_out, escaped, len);
+}
+
+/**
+ * Records that @phase ran from @start (a trace_now() value) until now.
+ *
+ * @detail  Shown with the event, e.g. the program being resolved; NULL for none.
+ */
+void trace_record(const TracePhase phase, const uint64_t start, const char *detail) {
+    const uint64_t end = trace_now();
+
+    outbuf_printf(&trace_out,
+                  "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,"
+                  "\"tid\":%d",
+                  first_event ? "" : ",", phase_names[phase], start / 1e3, (end - start) / 1e3,
+                  trace_pid, trace_pid);
+    if (detail) {
+        outbuf_puts_ref(&trace_out, ",\"args\":{\"detail\":\"");
+        write_json_string(detail);
+        outbuf_puts_ref(&trace_out, "\"}");
+    }
+    outbuf_puts_ref(&trace_out, "}");
+    first_event = false;
+}
@@ -0,0 +1,39 @@
+#ifndef TRACE_H
+#define TRACE_H
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Phases of running a command line, as they appear in a trace.
+ *
+ * TRACE_SPAWN covers posix_spawn(), which returns only once the child has exec'ed, so it is
+ * fork and exec together. TRACE_FORK is the plain fork() of a builtin pipeline stage.
+ */
+typedef enum {
+    TRACE_READ,
+    TRACE_TOKENIZE,
+    TRACE_PARSE,
+    TRACE_REDIRECT,
+    TRACE_RESOLVE,
+    TRACE_SPAWN,
+    TRACE_FORK,
+    TRACE_BUILTIN,
+    TRACE_WAIT,
+} TracePhase;
+
+// Set by trace_open(); everything else is a no-op while it is false
+extern bool trace_active;
+
+bool trace_open(const char *path);
+void trace_close(void);
+uint64_t trace_now(void);
+void trace_record(TracePhase phase, uint64_t start, const char *detail);
+
+static inline uint64_t trace_begin(void) { return trace_active ? trace_now() : 0; }
+
+static inline void trace_end(const TracePhase phase, const uint64_t start, const char *detail) {
+    if (trace_active)
+        trace_record(phase, start, detail);
+}
+
+#endif // TRACE_H
@@ -0,0 +1,268 @@
+#define _POSIX_C_SOURCE 200809L
+#include "vars.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "memstats.h"
+
+#define VARS_INITIAL_BUCKETS 64
+
+/**
+ * @name      Variable name, NUL-terminated.
+ * @value     Current value, NUL-terminated.
+ * @exported  Passed to commands the shell starts.
+ */
+typedef struct Var {
+    char *name;
+    char *value;
+    uint32_t hash;
+    bool exported;
+    struct Var *next;
+} Var;
+
+/**
+ * The shell's variables.
+ *
+ * @buckets      Chained hash table keyed by name.
+ * @envp         The exported variables as NAME=value strings, handed to every command.
+ * @envp_stale   An exported variable changed since @envp was built. Only exporting,
+ *               unexporting or changing an exported variable sets it, so running commands
+ *               reuses the same array.
+ */
+static struct {
+    Var **buckets;
+    size_t bucket_count;
+    size_t count;
+    size_t exported_count;
+    char **envp;
+    bool envp_stale;
+} vars = {.envp_stale = true};
+
+static uint32_t hash_name(const char *name, const size_t len) {
+    // FNV-1a
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)name[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static Var *find_var(const char *name, const size_t len, const uint32_t hash) {
+    if (vars.bucket_count == 0)
+        return NULL;
+
+    for (Var *var = vars.buckets[hash & (vars.bucket_count - 1)]; var; var = var->next) {
+        if (var->hash == hash && !strncmp(var->name, name, len) && var->name[len] == '\0')
+            return var;
+    }
+    return NULL;
+}
+
+static bool grow_buckets(void) {
+    const size_t new_count = vars.bucket_count ? vars.bucket_count * 2 : VARS_INITIAL_BUCKETS;
+    Var **new_buckets = calloc(new_count, sizeof *new_buckets);
+    if (!new_buckets)
+        return false;
+
+    for (size_t i = 0; i < vars.bucket_count; i++) {
+        Var *var = vars.buckets[i];
+        while (var) {
+            Var *next = var->next;
+            Var **slot = &new_buckets[var->hash & (new_count - 1)];
+            var->next = *slot;
+            *slot = var;
+            var = next;
+        }
+    }
+
+    free(vars.buckets);
+    vars.buckets = new_buckets;
+    vars.bucket_count = new_count;
+    return true;
+}
+
+/**
+ * @return  true if @name (@len bytes) can be a variable name: a letter or '_', then
+ *          letters, digits and '_'.
+ */
+bool vars_valid_name(const char *name, const size_t len) {
+    if (len == 0 || (name[0] >= '0' && name[0] <= '9'))
+        return false;
+
+    for (size_t i = 0; i < len; i++) {
+        const char c = name[i];
+        if (!(c == '_' || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+              (c >= '0' && c <= '9')))
+            return false;
+    }
+    return true;
+}
+
+const char *vars_get_n(const char *name, const size_t len) {
+    const Var *var = find_var(name, len, hash_name(name, len));
+    return var ? var->value : NULL;
+}
+
+const char *vars_get(const char *name) { return vars_get_n(name, strlen(name)); }
+
+/**
+ * Sets @name (@name_len bytes) to @value. @export marks the variable exported; otherwise
+ * it keeps whatever export state it had, as plain `NAME=value` does in other shells.
+ */
+bool vars_set_n(const char *name, const size_t name_len, const char *value, const bool export) {
+    const uint32_t hash = hash_name(name, name_len);
+    Var *var = find_var(name, name_len, hash);
+    if (var) {
+        // Re-assigning the same value changes nothing a command could see
+        if (!strcmp(var->value, value)) {
+            if (export && !var->exported) {
+                var->exported = true;
+                vars.exported_count++;
+                vars.envp_stale = true;
+            }
+            return true;
+        }
+
+        char *copy = strdup(value);
+        if (!copy)
+            return false;
+        free(var->value);
+        var->value = copy;
+    } else {
+        // Keep the load factor at or below 1
+        if (vars.count >= vars.bucket_count && !grow_buckets())
+            return false;
+
+        var = calloc(1, sizeof *var);
+        if (!var)
+            return false;
+        var->name = strndup(name, name_len);
+        var->value = strdup(value);
+        if (!var->name || !var->value) {
+            free(var->name);
+            free(var->value);
+            free(var);
+            return false;
+        }
+        var->hash = hash;
+
+        Var **slot = &vars.buckets[hash & (vars.bucket_count - 1)];
+        var->next = *slot;
+        *slot = var;
+        vars.count++;
+    }
+
+    if (export && !var->exported) {
+        var->exported = true;
+        vars.exported_count++;
+    }
+    if (var->exported)
+        vars.envp_stale = true;
+    return true;
+}
+
+bool vars_set(const char *name, const char *value, const bool export) {
+    return vars_set_n(name, strlen(name), value, export);
+}
+
+/**
+ * Marks @name exported, creating it with an empty value if it does not exist yet.
+ */
+bool vars_export(const char *name) {
+    const char *value = vars_get(name);
+    return vars_set(name, value ? value : "", true);
+}
+
+bool vars_unset(const char *name) {
+    const size_t len = strlen(name);
+    const uint32_t hash = hash_name(name, len);
+    if (vars.bucket_count == 0)
+        return false;
+
+    Var **link = &vars.buckets[hash & (vars.bucket_count - 1)];
+    while (*link) {
+        Var *var = *link;
+        if (var->hash == hash && !strcmp(var->name, name)) {
+            *link = var->next;
+            if (var->exported) {
+                vars.exported_count--;
+                vars.envp_stale = true;
+            }
+            free(var->name);
+            free(var->value);
+            free(var);
+            vars.count--;
+            return true;
+        }
+        link = &var->next;
+    }
+    return false;
+}
+
+/**
+ * Imports the process environment; every variable in it starts out exported.
+ */
+bool vars_init(char *const envp[]) {
+    bool ok = true;
+    for (size_t i = 0; envp && envp[i]; i++) {
+        const char *eq = strchr(envp[i], '=');
+        if (eq && vars_valid_name(envp[i], eq - envp[i]))
+            ok = vars_set_n(envp[i], eq - envp[i], eq + 1, true) && ok;
+    }
+    return ok;
+}
+
+static void free_envp(char **envp) {
+    for (size_t i = 0; envp && envp[i]; i++)
+        free(envp[i]);
+    free(envp);
+}
+
+/**
+ * The environment for commands the shell starts: NULL-terminated NAME=value strings of the
+ * exported variables. It is only rebuilt after an exported variable changed, so the
+ * pointer stays valid (and cheap to get) until then.
+ */
+char **vars_envp(void) {
+    if (!vars.envp_stale && vars.envp)
+        return vars.envp;
+
+    char **envp = calloc(vars.exported_count + 1, sizeof *envp);
+    if (!envp)
+        return vars.envp;
+
+    size_t n = 0;
+    for (size_t i = 0; i < vars.bucket_count; i++) {
+        for (const Var *var = vars.buckets[i]; var; var = var->next) {
+            if (!var->exported)
+                continue;
+
+            const size_t name_len = strlen(var->name);
+            const size_t value_len = strlen(var->value);
+            char *entry = malloc(name_len + 1 + value_len + 1);
+            if (!entry) {
+                free_envp(envp);
+                return vars.envp;
+            }
+            memcpy(entry, var->name, name_len);
+            entry[name_len] = '=';
+            memcpy(entry + name_len + 1, var->value, value_len + 1);
+            envp[n++] = entry;
+        }
+    }
+
+    free_envp(vars.envp);
+    vars.envp = envp;
+    vars.envp_stale = false;
+    return envp;
+}
+
+void vars_foreach(VarsVisitor visit, void *ctx) {
+    for (size_t i = 0; i < vars.bucket_count; i++) {
+        for (const Var *var = vars.buckets[i]; var; var = var->next)
+            visit(var->name, var->value, var->exported, ctx);
+    }
+}
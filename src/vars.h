@@ -0,0 +1,19 @@
+#ifndef VARS_H
+#define VARS_H
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef void (*VarsVisitor)(const char *name, const char *value, bool exported, void *ctx);
+
+bool vars_init(char *const envp[]);
+const char *vars_get(const char *name);
+const char *vars_get_n(const char *name, size_t len);
+bool vars_set(const char *name, const char *value, bool export);
+bool vars_set_n(const char *name, size_t name_len, const char *value, bool export);
+bool vars_export(const char *name);
+bool vars_unset(const char *name);
+bool vars_valid_name(const char *name, size_t len);
+char **vars_envp(void);
+void vars_foreach(VarsVisitor visit, void *ctx);
+
+#endif // VARS_H
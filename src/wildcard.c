@@ -0,0 +1,589 @@
+// getdents64 through syscall()
+#define _GNU_SOURCE
+#include "wildcard.h"
+
+#include <ctype.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "memstats.h"
+
+/**
+ * Pathname expansion: `*`, `?` and `[...]` (with `!`/`^` negation, ranges and `[:class:]`).
+ *
+ * A pattern is split at '/' into segments, and each segment is compiled once into a short
+ * op list. Only segments with metacharacters read a directory; literal segments are joined
+ * onto the path as they are, so `build/` followed by `*.tar` reads only `build`.
+ * Directories are listed with getdents64() in large batches straight into a reusable
+ * buffer, and every name is matched against the compiled ops without copying it. Matches
+ * are sorted bytewise, which is also what the C locale does.
+ *
+ * A backslash in the pattern makes the next character literal; the tokenizer uses this to
+ * keep quoted metacharacters from matching.
+ */
+
+// Large enough that directories with hundreds of thousands of entries take few syscalls
+#define DENTS_BUFFER_SIZE (1 << 20)
+
+struct linux_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+typedef enum {
+    OP_LITERAL,
+    OP_ANY,
+    OP_STAR,
+    OP_CLASS,
+} OpKind;
+
+/**
+ * @text  OP_LITERAL: the unescaped bytes to match, @len of them.
+ * @set   OP_CLASS: bit c set if byte c matches.
+ */
+typedef struct {
+    OpKind kind;
+    uint32_t len;
+    const char *text;
+    uint64_t set[4];
+} Op;
+
+/**
+ * One '/'-separated piece of a pattern.
+ *
+ * @literal      The unescaped segment, used as is when it has no metacharacters.
+ * @min_len      Bytes a name needs at least to match.
+ * @leading_dot  The segment starts with a literal '.', so it may match hidden names.
+ */
+typedef struct {
+    Op *ops;
+    size_t op_count;
+    char *literal;
+    size_t literal_len;
+    size_t min_len;
+    bool has_meta;
+    bool leading_dot;
+} Segment;
+
+/**
+ * State of one expansion.
+ *
+ * @path       The directory being walked, NUL-terminated at the current length.
+ * @dirs_only  The pattern ended in '/': only directories match, and keep the slash.
+ */
+typedef struct {
+    Arena *arena;
+    Segment *segments;
+    size_t segment_count;
+    bool dirs_only;
+    char **matches;
+    size_t count;
+    size_t cap;
+    bool failed;
+    char path[PATH_MAX];
+} Walk;
+
+static char *dents_buffer;
+
+static void set_bit(uint64_t set[4], const unsigned char c) { set[c >> 6] |= 1ull << (c & 63); }
+
+static bool has_bit(const uint64_t set[4], const unsigned char c) {
+    return set[c >> 6] >> (c & 63) & 1;
+}
+
+static int (*const class_tests[])(int) = {isalnum, isalpha, isblank, iscntrl, isdigit, isgraph,
+                                           islower, isprint, ispunct, isspace, isupper,
+                                           isxdigit};
+static const char *const class_names[] = {"alnum", "alpha", "blank", "cntrl", "digit", "graph",
+                                          "lower", "print", "punct", "space", "upper",
+                                          "xdigit"};
+
+/**
+ * Adds the `[:name:]` at @p (ending before @end) to @set.
+ *
+ * @return  Bytes it takes up, 0 if @p does not start a known class.
+ */
+static size_t parse_named_class(const char *p, const char *end, uint64_t set[4]) {
+    if (end - p < 4 || p[0] != '[' || p[1] != ':')
+        return 0;
+
+    const char *close = p + 2;
+    while (close + 1 < end && !(close[0] == ':' && close[1] == ']'))
+        close++;
+    if (close + 1 >= end)
+        return 0;
+
+    const size_t name_len = close - (p + 2);
+    for (size_t k = 0; k < sizeof(class_names) / sizeof(class_names[0]); k++) {
+        if (strlen(class_names[k]) != name_len || strncmp(p + 2, class_names[k], name_len))
+            continue;
+        for (int c = 0; c < 256; c++) {
+            if (class_tests[k](c))
+                set_bit(set, (unsigned char)c);
+        }
+        return close + 2 - p;
+    }
+    return 0;
+}
+
+/**
+ * Compiles the bracket expression at @p ('[') into @op.
+ *
+ * @return  Pointer past the closing ']', or NULL if there is none and '[' is a literal.
+ */
+static const char *parse_class(const char *p, const char *end, Op *op) {
+    memset(op, 0, sizeof *op);
+    op->kind = OP_CLASS;
+
+    p++;
+    const bool negate = p < end && (*p == '!' || *p == '^');
+    if (negate)
+        p++;
+
+    bool first = true;
+    while (p < end && (*p != ']' || first)) {
+        first = false;
+
+        const size_t named = parse_named_class(p, end, op->set);
+        if (named) {
+            p += named;
+            continue;
+        }
+
+        unsigned char lo = (unsigned char)*p++;
+        if (lo == '\\' && p < end)
+            lo = (unsigned char)*p++;
+
+        unsigned char hi = lo;
+        if (p + 1 < end && p[0] == '-' && p[1] != ']') {
+            p++;
+            hi = (unsigned char)*p++;
+            if (hi == '\\' && p < end)
+                hi = (unsigned char)*p++;
+        }
+        for (unsigned c = lo; c <= hi; c++)
+            set_bit(op->set, (unsigned char)c);
+    }
+    if (p == end)
+        return NULL;
+
+    if (negate) {
+        for (int k = 0; k < 4; k++)
+            op->set[k] = ~op->set[k];
+    }
+    // '/' never matches inside a segment
+    op->set['/' >> 6] &= ~(1ull << ('/' & 63));
+    return p + 1;
+}
+
+/**
+ * Compiles the @len bytes at @text into @seg.
+ */
+static bool compile_segment(Arena *arena, const char *text, const size_t len, Segment *seg) {
+    memset(seg, 0, sizeof *seg);
+    // Every byte yields at most one op, and unescaping only shrinks the text
+    seg->ops = arena_alloc(arena, (len + 1) * sizeof *seg->ops);
+    seg->literal = arena_alloc(arena, len + 1);
+    if (!seg->ops || !seg->literal)
+        return false;
+
+    const char *end = text + len;
+    const char *p = text;
+    Op *literal_op = NULL;
+    while (p < end) {
+        Op *op = &seg->ops[seg->op_count];
+        if (*p == '*') {
+            while (p < end && *p == '*')
+                p++;
+            *op = (Op){.kind = OP_STAR};
+            seg->op_count++;
+            seg->has_meta = true;
+            literal_op = NULL;
+            continue;
+        }
+        if (*p == '?') {
+            p++;
+            *op = (Op){.kind = OP_ANY};
+            seg->op_count++;
+            seg->min_len++;
+            seg->has_meta = true;
+            literal_op = NULL;
+            continue;
+        }
+        if (*p == '[') {
+            const char *after = parse_class(p, end, op);
+            if (after) {
+                p = after;
+                seg->op_count++;
+                seg->min_len++;
+                seg->has_meta = true;
+                literal_op = NULL;
+                continue;
+            }
+        }
+
+        if (*p == '\\' && p + 1 < end)
+            p++;
+        if (seg->literal_len == 0)
+            seg->leading_dot = *p == '.' && seg->op_count == 0;
+        if (!literal_op) {
+            literal_op = op;
+            *op = (Op){.kind = OP_LITERAL, .text = seg->literal + seg->literal_len};
+            seg->op_count++;
+        }
+        seg->literal[seg->literal_len++] = *p++;
+        literal_op->len++;
+        seg->min_len++;
+    }
+    seg->literal[seg->literal_len] = '\0';
+    return true;
+}
+
+static bool match_op(const Op *op, const char *name, const size_t len, const size_t i) {
+    switch (op->kind) {
+    case OP_LITERAL:
+        return i + op->len <= len && !memcmp(name + i, op->text, op->len);
+    case OP_ANY:
+        return i < len;
+    case OP_CLASS:
+        return i < len && has_bit(op->set, (unsigned char)name[i]);
+    default:
+        return false;
+    }
+}
+
+static size_t op_width(const Op *op) { return op->kind == OP_LITERAL ? op->len : 1; }
+
+/**
+ * Matches @name against the compiled segment. A mismatch after a '*' retries with the star
+ * taking one more byte; only the last star needs retrying, so this is linear for the usual
+ * one- or two-star pattern.
+ */
+static bool match_segment(const Segment *seg, const char *name, const size_t len) {
+    if (len < seg->min_len)
+        return false;
+
+    // `*.tar`: reject on the suffix before anything else
+    const Op *last = &seg->ops[seg->op_count - 1];
+    if (last->kind == OP_LITERAL &&
+        (len < last->len || memcmp(name + len - last->len, last->text, last->len)))
+        return false;
+
+    size_t p = 0;
+    size_t i = 0;
+    size_t star_p = SIZE_MAX;
+    size_t star_i = 0;
+    while (true) {
+        if (p < seg->op_count) {
+            const Op *op = &seg->ops[p];
+            if (op->kind == OP_STAR) {
+                star_p = ++p;
+                star_i = i;
+                continue;
+            }
+            if (match_op(op, name, len, i)) {
+                i += op_width(op);
+                p++;
+                continue;
+            }
+        } else if (i == len) {
+            return true;
+        }
+
+        if (star_p == SIZE_MAX || star_i >= len)
+            return false;
+        p = star_p;
+        i = ++star_i;
+    }
+}
+
+/**
+ * Appends @name to the walk's path.
+ *
+ * @return  New path length, or 0 if it would not fit.
+ */
+static size_t join(Walk *w, const size_t path_len, const char *name, const size_t name_len) {
+    const size_t sep = path_len > 0 && w->path[path_len - 1] != '/';
+    if (path_len + sep + name_len + 2 > sizeof(w->path))
+        return 0;
+
+    if (sep)
+        w->path[path_len] = '/';
+    memcpy(w->path + path_len + sep, name, name_len);
+    w->path[path_len + sep + name_len] = '\0';
+    return path_len + sep + name_len;
+}
+
+static void add_match(Walk *w, size_t path_len) {
+    if (w->count == w->cap) {
+        const size_t cap = w->cap ? w->cap * 2 : 16;
+        char **matches = arena_grow(w->arena, w->matches, w->cap * sizeof *matches,
+                                    (cap + 1) * sizeof *matches);
+        if (!matches) {
+            w->failed = true;
+            return;
+        }
+        w->matches = matches;
+        w->cap = cap;
+    }
+
+    char *match = arena_alloc(w->arena, path_len + w->dirs_only + 1);
+    if (!match) {
+        w->failed = true;
+        return;
+    }
+    memcpy(match, w->path, path_len);
+    if (w->dirs_only)
+        match[path_len++] = '/';
+    match[path_len] = '\0';
+    w->matches[w->count++] = match;
+}
+
+static bool is_directory(const char *path) {
+    struct stat st;
+    return stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+static void walk(Walk *w, size_t path_len, size_t index);
+
+/**
+ * Lists the walk's current directory and matches every name against segment @index.
+ * Names that complete the pattern are added right away; names that lead to further
+ * segments are collected and descended into once the listing is done, so the one dents
+ * buffer is never needed by two directories at a time.
+ */
+static void walk_directory(Walk *w, const size_t path_len, const size_t index) {
+    const Segment *seg = &w->segments[index];
+    const bool last = index + 1 == w->segment_count;
+
+    const int fd = open(path_len ? w->path : ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1)
+        return;
+
+    char **subdirs = NULL;
+    size_t subdir_count = 0;
+    size_t subdir_cap = 0;
+
+    long n;
+    while ((n = syscall(SYS_getdents64, fd, dents_buffer, DENTS_BUFFER_SIZE)) > 0) {
+        for (long off = 0; off < n;) {
+            const struct linux_dirent64 *d = (const struct linux_dirent64 *)(dents_buffer + off);
+            off += d->d_reclen;
+
+            const char *name = d->d_name;
+            if (name[0] == '.' && (!seg->leading_dot || name[1] == '\0' ||
+                                   (name[1] == '.' && name[2] == '\0')))
+                continue;
+
+            const size_t name_len = strlen(name);
+            if (!match_segment(seg, name, name_len))
+                continue;
+
+            const bool maybe_dir =
+                d->d_type == DT_DIR || d->d_type == DT_LNK || d->d_type == DT_UNKNOWN;
+            if (last && !w->dirs_only) {
+                const size_t len = join(w, path_len, name, name_len);
+                if (len)
+                    add_match(w, len);
+                continue;
+            }
+            if (!maybe_dir)
+                continue;
+
+            if (subdir_count == subdir_cap) {
+                const size_t cap = subdir_cap ? subdir_cap * 2 : 16;
+                char **grown = arena_grow(w->arena, subdirs, subdir_cap * sizeof *subdirs,
+                                          cap * sizeof *subdirs);
+                if (!grown) {
+                    w->failed = true;
+                    break;
+                }
+                subdirs = grown;
+                subdir_cap = cap;
+            }
+            subdirs[subdir_count] = arena_strndup(w->arena, name, name_len);
+            if (!subdirs[subdir_count]) {
+                w->failed = true;
+                break;
+            }
+            subdir_count++;
+        }
+        if (w->failed)
+            break;
+    }
+    close(fd);
+
+    for (size_t i = 0; i < subdir_count && !w->failed; i++) {
+        const size_t len = join(w, path_len, subdirs[i], strlen(subdirs[i]));
+        if (!len)
+            continue;
+        if (last) {
+            if (is_directory(w->path))
+                add_match(w, len);
+        } else {
+            walk(w, len, index + 1);
+        }
+    }
+}
+
+/**
+ * Expands segment @index onward below the directory in w->path[0..@path_len).
+ */
+static void walk(Walk *w, size_t path_len, size_t index) {
+    // Literal segments need no listing: join them and let the last one be checked
+    while (index < w->segment_count && !w->segments[index].has_meta) {
+        const Segment *seg = &w->segments[index];
+        path_len = join(w, path_len, seg->literal, seg->literal_len);
+        if (!path_len)
+            return;
+        index++;
+    }
+
+    if (index < w->segment_count) {
+        walk_directory(w, path_len, index);
+        return;
+    }
+
+    struct stat st;
+    if (w->dirs_only ? is_directory(w->path) : lstat(w->path, &st) == 0)
+        add_match(w, path_len);
+}
+
+/**
+ * Sort key: the first eight bytes, big-endian, so most comparisons are one integer compare.
+ */
+typedef struct {
+    uint64_t prefix;
+    char *s;
+} SortKey;
+
+static int compare_keys(const void *a, const void *b) {
+    const SortKey *x = a;
+    const SortKey *y = b;
+    if (x->prefix != y->prefix)
+        return x->prefix < y->prefix ? -1 : 1;
+    // Equal prefixes that end in a NUL are equal strings; otherwise both go on
+    if ((x->prefix & 0xff) == 0)
+        return 0;
+    return strcmp(x->s + 8, y->s + 8);
+}
+
+static bool sort_matches(Arena *arena, char **matches, const size_t count) {
+    SortKey *keys = arena_alloc(arena, count * sizeof *keys);
+    if (!keys)
+        return false;
+
+    for (size_t i = 0; i < count; i++) {
+        uint64_t prefix = 0;
+        const unsigned char *s = (const unsigned char *)matches[i];
+        size_t k = 0;
+        for (; k < 8 && s[k]; k++)
+            prefix = prefix << 8 | s[k];
+        prefix <<= 8 * (8 - k);
+        keys[i] = (SortKey){prefix, matches[i]};
+    }
+
+    qsort(keys, count, sizeof *keys, compare_keys);
+    for (size_t i = 0; i < count; i++)
+        matches[i] = keys[i].s;
+    return true;
+}
+
+/**
+ * Splits @pattern at unescaped '/' and compiles every segment.
+ */
+static bool compile_pattern(Walk *w, const char *pattern) {
+    size_t max_segments = 1;
+    for (const char *p = pattern; *p; p++)
+        max_segments += *p == '/';
+
+    w->segments = arena_alloc(w->arena, max_segments * sizeof *w->segments);
+    if (!w->segments)
+        return false;
+
+    const char *start = pattern;
+    const char *p = pattern;
+    while (true) {
+        if (*p == '\\' && p[1]) {
+            p += 2;
+            continue;
+        }
+        if (*p && *p != '/') {
+            p++;
+            continue;
+        }
+
+        if (p > start) {
+            if (!compile_segment(w->arena, start, p - start, &w->segments[w->segment_count]))
+                return false;
+            w->segment_count++;
+        }
+        if (!*p)
+            break;
+        start = ++p;
+    }
+
+    const size_t len = p - pattern;
+    w->dirs_only = len > 0 && pattern[len - 1] == '/';
+    return true;
+}
+
+/**
+ * Expands @pattern into the sorted list of existing paths it matches.
+ *
+ * @param arena        Allocator for the list and the paths.
+ * @param pattern      The pattern; a backslash makes the next character literal.
+ * @param matches_out  Out: NULL-terminated array of matches.
+ * @return             Number of matches (0 if nothing matched), or -1 on error.
+ */
+int wildcard_expand(Arena *arena, const char *pattern, char ***matches_out) {
+    if (!dents_buffer) {
+        dents_buffer = malloc(DENTS_BUFFER_SIZE);
+        if (!dents_buffer)
+            return -1;
+    }
+
+    Walk *w = arena_alloc(arena, sizeof *w);
+    if (!w)
+        return -1;
+    memset(w, 0, sizeof *w);
+    w->arena = arena;
+    if (!compile_pattern(w, pattern))
+        return -1;
+
+    size_t path_len = 0;
+    if (pattern[0] == '/') {
+        w->path[0] = '/';
+        path_len = 1;
+    }
+    w->path[path_len] = '\0';
+
+    if (w->segment_count == 0) {
+        *matches_out = NULL;
+        return 0;
+    }
+    walk(w, path_len, 0);
+    if (w->failed)
+        return -1;
+    if (w->count == 0) {
+        *matches_out = NULL;
+        return 0;
+    }
+
+    if (w->count > 1 && !sort_matches(arena, w->matches, w->count))
+        return -1;
+    w->matches[w->count] = NULL;
+    *matches_out = w->matches;
+    return (int)w->count;
+}
@@ -0,0 +1,7 @@
+#ifndef WILDCARD_H
+#define WILDCARD_H
+#include "arena.h"
+
+int wildcard_expand(Arena *arena, const char *pattern, char ***matches_out);
+
+#endif // WILDCARD_H
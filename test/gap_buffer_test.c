@@ -0,0 +1,195 @@
+#include "../src/term/gap_buffer.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void assert_text(GapBuffer *gb, const char *expected) {
+    const size_t len = strlen(expected);
+    assert(gb->length == len);
+
+    // Read across the gap first, then closed up
+    unsigned char copy[256];
+    gap_buffer_copy(gb, 0, gb->length, copy);
+    assert(!memcmp(copy, expected, len));
+    for (size_t i = 0; i < len; i++)
+        assert(gap_buffer_at(gb, i) == (unsigned char)expected[i]);
+    assert(!strcmp((const char *)gap_buffer_text(gb), expected));
+}
+
+static void insert(GapBuffer *gb, const char *text) {
+    gap_buffer_insert(gb, (const unsigned char *)text, strlen(text));
+}
+
+static void test_edits_on_both_sides_of_the_gap(void) {
+    // Arrange
+    GapBuffer gb = {0};
+    insert(&gb, "echo world");
+
+    // Act
+    gb.cursor_pos = 5;
+    insert(&gb, "hello ");
+    gb.cursor_pos = 0;
+    gap_buffer_delete_after(&gb, 5);
+    gb.cursor_pos = gb.length;
+    gap_buffer_delete_before(&gb, 2);
+    gb.cursor_pos = 6;
+    gap_buffer_delete_before(&gb, 100);
+
+    // Assert
+    assert(gb.cursor_pos == 0);
+    assert_text(&gb, "wor");
+
+    // Cleanup
+    free(gb.buffer);
+}
+
+static void test_growing_keeps_the_text_after_the_gap(void) {
+    // Arrange
+    GapBuffer gb = {0};
+    insert(&gb, "head tail");
+    gb.cursor_pos = 5;
+    insert(&gb, "x");
+    const size_t capacity = gb.capacity;
+
+    // Act: the buffer is reallocated while the gap sits mid-line
+    char middle[999];
+    memset(middle, 'x', sizeof(middle));
+    gap_buffer_insert(&gb, (const unsigned char *)middle, sizeof(middle));
+
+    // Assert
+    assert(gb.capacity > capacity);
+    assert(gb.gap_start == 1005 && gb.capacity - gb.gap_end == 4);
+    assert(gap_buffer_at(&gb, 4) == ' ' && gap_buffer_at(&gb, 5) == 'x');
+    assert(gap_buffer_at(&gb, 1004) == 'x' && gap_buffer_at(&gb, 1005) == 't');
+
+    // Act: then moves back to the start of the line
+    gb.cursor_pos = 2;
+    insert(&gb, "--");
+
+    // Assert
+    const char *text = (const char *)gap_buffer_text(&gb);
+    assert(gb.length == 1011 && !strncmp(text, "he--ad xx", 9));
+    assert(!strcmp(text + 1007, "tail"));
+
+    // Cleanup
+    free(gb.buffer);
+}
+
+static void test_set_replaces_the_text(void) {
+    // Arrange
+    GapBuffer gb = {0};
+    insert(&gb, "old text");
+    gb.cursor_pos = 3;
+    gap_buffer_delete_after(&gb, 1);
+
+    // Act
+    gap_buffer_set(&gb, "new", 3);
+
+    // Assert
+    assert(gb.cursor_pos == 3);
+    assert_text(&gb, "new");
+    gap_buffer_set(&gb, NULL, 0);
+    assert_text(&gb, "");
+
+    // Cleanup
+    free(gb.buffer);
+}
+
+static void test_word_motions(void) {
+    // Arrange
+    GapBuffer gb = {0};
+    insert(&gb, "ls  -la my_dir/sub");
+    gb.cursor_pos = 9;
+    insert(&gb, "y");
+    gap_buffer_delete_before(&gb, 1);
+
+    // Act & Assert
+    assert(gap_buffer_word_start(&gb, gb.length) == 15);
+    assert(gap_buffer_word_start(&gb, 15) == 8);
+    assert(gap_buffer_word_start(&gb, 6) == 5);
+    assert(gap_buffer_word_start(&gb, 2) == 0);
+    assert(gap_buffer_word_end(&gb, 2) == 7);
+    assert(gap_buffer_word_end(&gb, 7) == 14);
+    assert(gap_buffer_word_end(&gb, 14) == gb.length);
+    assert(gap_buffer_blank_word_start(&gb, gb.length) == 8);
+    assert(gap_buffer_blank_word_start(&gb, 8) == 4);
+    assert(gap_buffer_blank_word_start(&gb, 4) == 0);
+
+    // Cleanup
+    free(gb.buffer);
+}
+
+static void test_consecutive_kills_collect(void) {
+    // Arrange
+    GapBuffer gb = {0};
+    GapBuffer killed = {0};
+    insert(&gb, "one two three four");
+    gb.cursor_pos = 13;
+
+    // Act: two backward kills, then a forward one, as by consecutive keys
+    gap_buffer_kill(&gb, gap_buffer_blank_word_start(&gb, 13), 13, &killed, false);
+    gap_buffer_kill(&gb, gap_buffer_blank_word_start(&gb, gb.cursor_pos), gb.cursor_pos,
+                    &killed, true);
+    gap_buffer_kill(&gb, gb.cursor_pos, gb.length, &killed, true);
+
+    // Assert
+    assert_text(&gb, "one ");
+    assert_text(&killed, "two three four");
+
+    // Act: a kill after another key starts over
+    gap_buffer_kill(&gb, 0, gb.cursor_pos, &killed, false);
+
+    // Assert
+    assert_text(&gb, "");
+    assert_text(&killed, "one ");
+
+    // Act: yank it back twice
+    gap_buffer_insert(&gb, gap_buffer_text(&killed), killed.length);
+    gb.cursor_pos = 0;
+    gap_buffer_insert(&gb, gap_buffer_text(&killed), killed.length);
+
+    // Assert
+    assert_text(&gb, "one one ");
+
+    // Cleanup
+    free(gb.buffer);
+    free(killed.buffer);
+}
+
+static void test_edits_far_from_the_end_of_a_long_line(void) {
+    // Arrange
+    GapBuffer gb = {0};
+    const size_t len = 100 * 1024;
+    char *line = malloc(len);
+    assert(line);
+    memset(line, 'a', len);
+    gap_buffer_insert(&gb, (const unsigned char *)line, len);
+    gb.cursor_pos = len / 2;
+
+    // Act: once the gap is at the cursor, typing only writes into it
+    for (int i = 0; i < 100000; i++) {
+        insert(&gb, "b");
+        gap_buffer_delete_before(&gb, 1);
+    }
+    insert(&gb, "b");
+
+    // Assert
+    assert(gb.gap_start == len / 2 + 1);
+    assert(gap_buffer_at(&gb, len / 2) == 'b');
+    const unsigned char *text = gap_buffer_text(&gb);
+    assert(strlen((const char *)text) == len + 1 && text[len / 2] == 'b');
+
+    // Cleanup
+    free(line);
+    free(gb.buffer);
+}
+
+int main(void) {
+    test_edits_on_both_sides_of_the_gap();
+    test_growing_keeps_the_text_after_the_gap();
+    test_set_replaces_the_text();
+    test_word_motions();
+    test_consecutive_kills_collect();
+    test_edits_far_from_the_end_of_a_long_line();
+    return 0;
+}
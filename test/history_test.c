@@ -0,0 +1,168 @@
+#define _POSIX_C_SOURCE 200809L
+#include "../src/term/history.h"
+#include <assert.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static char scratch_dir[] = "/tmp/history_test.XXXXXX";
+static char log_path[sizeof(scratch_dir) + 8];
+
+static void write_log(const char *text, const size_t len) {
+    const int fd = open(log_path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    assert(fd != -1);
+    const ssize_t written = write(fd, text, len);
+    assert(written == (ssize_t)len);
+    close(fd);
+}
+
+static void assert_entry(const size_t pos, const char *expected) {
+    size_t len;
+    const char *text = history_entry(pos, &len);
+    assert(len == strlen(expected) && !memcmp(text, expected, len));
+}
+
+static void test_partial_last_line_is_not_an_entry(void) {
+    // Arrange
+    write_log("one\ntwo\nthr", 11);
+
+    // Act
+    const bool opened = history_open(log_path);
+
+    // Assert
+    assert(opened);
+    size_t pos;
+    assert(history_end() == 8);
+    assert(history_prev(8, &pos) && pos == 4);
+    assert_entry(4, "two");
+    assert(history_prev(4, &pos) && pos == 0);
+    assert_entry(0, "one");
+    assert(!history_prev(0, &pos));
+    assert(history_next(4, &pos) && pos == 8);
+    assert(!history_next(8, &pos));
+
+    // Act: a new entry starts on a line of its own in the log
+    const bool added = history_add("four");
+
+    // Assert
+    assert(added);
+    assert(history_end() == 13);
+    assert_entry(8, "four");
+    char log[32];
+    const int fd = open(log_path, O_RDONLY);
+    const ssize_t n = read(fd, log, sizeof(log));
+    close(fd);
+    assert(n == 17 && !memcmp(log, "one\ntwo\nthr\nfour\n", 17));
+
+    // Cleanup
+    history_close();
+}
+
+static void test_prev_and_next_cross_into_the_session(void) {
+    // Arrange
+    write_log("a\nbb\n", 5);
+    const bool opened = history_open(log_path);
+    assert(opened);
+
+    // Act
+    const bool added = history_add("ccc") && history_add("dd") && history_add("dd");
+
+    // Assert
+    assert(added);
+    const size_t expected_pos[] = {0, 2, 5, 9};
+    const char *expected[] = {"a", "bb", "ccc", "dd"};
+    assert(history_end() == 12);
+
+    size_t pos = history_end();
+    for (int i = 3; i >= 0; i--) {
+        assert(history_prev(pos, &pos) && pos == expected_pos[i]);
+        assert_entry(pos, expected[i]);
+    }
+    assert(!history_prev(pos, &pos));
+
+    for (int i = 1; i < 4; i++)
+        assert(history_next(expected_pos[i - 1], &pos) && pos == expected_pos[i]);
+    assert(history_next(9, &pos) && pos == history_end());
+    assert(!history_next(pos, &pos));
+
+    // Cleanup
+    history_close();
+}
+
+static void test_empty_log_has_only_the_session(void) {
+    // Arrange
+    write_log("", 0);
+    const bool opened = history_open(log_path);
+    assert(opened);
+
+    // Act
+    const bool added = history_add("only");
+
+    // Assert
+    assert(added);
+    size_t pos;
+    assert(history_prev(history_end(), &pos) && pos == 0);
+    assert_entry(0, "only");
+    assert(history_search("nl", 2, history_end(), &pos) && pos == 0);
+
+    // Cleanup
+    history_close();
+}
+
+/**
+ * Runs the same searches once while the index may still be building and once after it is
+ * ready, over a log of several index blocks with matches in some of them.
+ */
+static void test_search_before_and_after_the_index_is_ready(void) {
+    // Arrange
+    enum { ENTRIES = 300 };
+    static char log[ENTRIES * 16];
+    size_t starts[ENTRIES];
+    size_t len = 0;
+    for (int i = 0; i < ENTRIES; i++) {
+        starts[i] = len;
+        const bool match = i == 10 || i == 100 || i == 250;
+        len += sprintf(log + len, "%s %d\n", match ? "needle" : "cmd", i);
+    }
+    write_log(log, len);
+    const bool opened = history_open(log_path) && history_add("needle session");
+    assert(opened);
+    const size_t session_start = len;
+
+    for (int round = 0; round < 2; round++) {
+        // Act & Assert: newest first, each search continuing before the last match
+        size_t pos;
+        assert(history_search("needle", 6, history_end(), &pos) && pos == session_start);
+        assert(history_search("needle", 6, pos, &pos) && pos == starts[250]);
+        assert(history_search("needle", 6, pos, &pos) && pos == starts[100]);
+        assert(history_search("needle", 6, pos, &pos) && pos == starts[10]);
+        assert(!history_search("needle", 6, pos, &pos));
+
+        // One trigram, and a query too short for any, which every block may contain
+        assert(history_search("d 1", 3, starts[200], &pos) && pos == starts[199]);
+        assert(history_search("9", 1, starts[11], &pos) && pos == starts[9]);
+        assert(!history_search("missing", 7, history_end(), &pos));
+
+        history_wait_for_index();
+    }
+
+    // Cleanup
+    history_close();
+}
+
+int main(void) {
+    const char *dir = mkdtemp(scratch_dir);
+    assert(dir);
+    snprintf(log_path, sizeof(log_path), "%s/log", scratch_dir);
+
+    test_partial_last_line_is_not_an_entry();
+    test_prev_and_next_cross_into_the_session();
+    test_empty_log_has_only_the_session();
+    test_search_before_and_after_the_index_is_ready();
+
+    unlink(log_path);
+    rmdir(scratch_dir);
+    return 0;
+}
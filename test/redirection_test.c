@@ -0,0 +1,52 @@
+#define _POSIX_C_SOURCE 200809L
+#include "../src/redirection.h"
+#include <assert.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/**
+ * `cat 5>/dev/null <<EOF` where 5 is the lowest free descriptor, which is where a memfd
+ * would land: the redirection must not replace the here-document before stdin reads it.
+ */
+static void test_here_document_survives_a_redirection_on_the_next_free_fd(void) {
+    // Arrange
+    const int next_free = dup(STDIN_FILENO);
+    assert(next_free != -1 && next_free < REDIR_FD_LIMIT);
+    close(next_free);
+
+    // Act
+    const int fd = here_document_create();
+    const bool ok = fd != -1 && here_document_write(fd, "body\n", 5) && here_document_seal(fd);
+
+    // Assert
+    assert(ok);
+    assert(fd >= REDIR_FD_LIMIT);
+
+    const RedirSpec specs[] = {
+        {.kind = REDIR_OPEN, .target_fd = next_free, .filename = "/dev/null",
+         .open_flags = O_WRONLY},
+        {.kind = REDIR_HERE, .target_fd = STDIN_FILENO, .source_fd = fd},
+    };
+    const pid_t pid = fork();
+    assert(pid != -1);
+    if (pid == 0) {
+        char body[16];
+        const bool applied = apply_all_redirection(specs, 2);
+        const ssize_t n = applied ? read(STDIN_FILENO, body, sizeof(body)) : -1;
+        _exit(n == 5 && !memcmp(body, "body\n", 5) ? 0 : 1);
+    }
+
+    int status;
+    const pid_t waited = waitpid(pid, &status, 0);
+    assert(waited == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    // Cleanup
+    release_here_documents();
+}
+
+int main(void) {
+    test_here_document_survives_a_redirection_on_the_next_free_fd();
+    return 0;
+}
@@ -1,24 +1,419 @@
+#include "../src/redirection.h"
 #include "../src/tokenizer.h"
 #include <assert.h>
+#include <stdbool.h>
+#include <stdio.h>
 #include <string.h>
 
 // TODO: Add more tests, especially for edge cases
 
-int main(void) {
+static void test_splits_on_whitespace(void) {
     // Arrange
-    char *buffer[10];
+    Arena arena = {0};
+    char **buffer;
     const char *input = "echo hello world";
 
     // Act
-    const int result = tokenize_input(input, buffer, 4);
+    const int result = tokenize_input(&arena, input, &buffer);
 
     // Assert
     assert(result == 3);
     assert(!strcmp(buffer[0], "echo"));
     assert(!strcmp(buffer[1], "hello"));
     assert(!strcmp(buffer[2], "world"));
+    assert(buffer[3] == NULL);
+
+    // Cleanup
+    arena_destroy(&arena);
+}
+
+static void test_pipe_is_its_own_token(void) {
+    // Arrange
+    Arena arena = {0};
+    char **buffer;
+    const char *input = "cat log|grep 'a|b'";
+
+    // Act
+    const int result = tokenize_input(&arena, input, &buffer);
+
+    // Assert
+    assert(result == 5);
+    assert(!strcmp(buffer[0], "cat"));
+    assert(!strcmp(buffer[1], "log"));
+    assert(!strcmp(buffer[2], "|"));
+    assert(!strcmp(buffer[3], "grep"));
+    assert(!strcmp(buffer[4], "a|b"));
+
+    // Cleanup
+    arena_destroy(&arena);
+}
+
+static void test_redirection_operators_are_tokens(void) {
+    // Arrange
+    Arena arena = {0};
+    char **buffer;
+    const char *input = "cmd a>out 2>&1 &>>all <in 3<>rw >&- x'>'y \"2\">f";
+    const char *expected[] = {"cmd", "a",  ">",   "out", "2>&1", "&>>", "all", "<",   "in",
+                              "3<>", "rw", ">&-", "x>y", "2",    ">",   "f",   NULL};
+
+    // Act
+    const int result = tokenize_input(&arena, input, &buffer);
+
+    // Assert
+    assert(result == 16);
+    for (int i = 0; expected[i]; i++)
+        assert(!strcmp(buffer[i], expected[i]));
+
+    // Cleanup
+    arena_destroy(&arena);
+}
+
+static void test_quoted_operators_are_words(void) {
+    const char *inputs[] = {"echo \">\"", "echo a \">\" b", "echo '|' \\& \"2>&1\""};
+    const char *expected[][6] = {{"echo", ">", NULL},
+                                 {"echo", "a", ">", "b", NULL},
+                                 {"echo", "|", "&", "2>&1", NULL}};
+
+    for (size_t k = 0; k < sizeof(inputs) / sizeof(inputs[0]); k++) {
+        // Arrange
+        Arena arena = {0};
+        char **tokens;
+        bool *operators;
+
+        // Act
+        const int count =
+            tokenize_input_expand(&arena, inputs[k], strlen(inputs[k]), NULL, &tokens, &operators);
+        int argc;
+        int redir_count;
+        const RedirSpec *specs =
+            extract_redirection(&arena, tokens, operators, count, &argc, &redir_count);
+
+        // Assert
+        assert(specs && redir_count == 0 && argc == count);
+        for (int i = 0; i < count; i++) {
+            assert(!operators[i]);
+            assert(!strcmp(tokens[i], expected[k][i]));
+        }
+        assert(expected[k][count] == NULL);
+
+        // Cleanup
+        arena_destroy(&arena);
+    }
+}
+
+static void test_unquoted_operators_are_marked(void) {
+    // Arrange
+    Arena arena = {0};
+    char **tokens;
+    bool *operators;
+    const char *input = "echo a > b | cat 2>&1 &";
+    const bool expected[] = {false, false, true, false, true, false, true, true};
+
+    // Act
+    const int count =
+        tokenize_input_expand(&arena, input, strlen(input), NULL, &tokens, &operators);
+
+    // Assert
+    assert(count == 8);
+    for (int i = 0; i < count; i++)
+        assert(operators[i] == expected[i]);
+
+    // Cleanup
+    arena_destroy(&arena);
+}
+
+static void test_ampersand_is_its_own_token(void) {
+    // Arrange
+    Arena arena = {0};
+    char **buffer;
+    const char *input = "sleep 1&>log 2>&1& echo 'a&b'&";
+    const char *expected[] = {"sleep", "1", "&>", "log", "2>&1", "&", "echo", "a&b", "&", NULL};
+
+    // Act
+    const int result = tokenize_input(&arena, input, &buffer);
+
+    // Assert
+    assert(result == 9);
+    for (int i = 0; expected[i]; i++)
+        assert(!strcmp(buffer[i], expected[i]));
+
+    // Cleanup
+    arena_destroy(&arena);
+}
+
+static void test_long_lines_have_no_token_or_argument_cap(void) {
+    // Arrange
+    Arena arena = {0};
+    char **buffer;
+    char input[4096];
+    memset(input, 'x', 1000);
+    int len = 1000;
+    for (int i = 0; i < 100; i++)
+        len += sprintf(input + len, " a%d", i);
+
+    // Act
+    const int result = tokenize_input(&arena, input, &buffer);
+
+    // Assert
+    assert(result == 101);
+    assert(strlen(buffer[0]) == 1000);
+    assert(!strcmp(buffer[100], "a99"));
+
+    // Cleanup
+    arena_destroy(&arena);
+}
+
+static const char *lookup_test_parameter(void *ctx, const char *name, const size_t len) {
+    (void)ctx;
+    if (len == 3 && !strncmp(name, "ONE", len))
+        return "1";
+    if (len == 4 && !strncmp(name, "ARGS", len))
+        return "a  b";
+    if (len == 1 && name[0] == '?')
+        return "0";
+    return NULL;
+}
+
+static void test_expands_parameters(void) {
+    // Arrange
+    Arena arena = {0};
+    char **buffer;
+    const TokenizerHooks hooks = {.lookup = lookup_test_parameter};
+    const char *input = "echo $ONE${ONE}x $ARGS \"$ARGS\" '$ONE' $UNSET $? $ 5$";
+    const char *expected[] = {"echo", "11x", "a", "b", "a  b", "$ONE", "0", "$", "5$", NULL};
+
+    // Act
+    const int result =
+        tokenize_input_expand(&arena, input, strlen(input), &hooks, &buffer, NULL);
+
+    // Assert
+    assert(result == 9);
+    for (int i = 0; expected[i]; i++)
+        assert(!strcmp(buffer[i], expected[i]));
+    assert(tokenize_input_expand(&arena, "echo ${ONE", 10, &hooks, &buffer, NULL) == -1);
+
+    // Cleanup
+    arena_destroy(&arena);
+}
+
+static int record_test_pattern(void *ctx, Arena *arena, const char *pattern,
+                               char ***matches_out) {
+    (void)ctx;
+    if (strcmp(pattern, "*.c"))
+        return 0;
+
+    char **matches = arena_alloc(arena, 3 * sizeof *matches);
+    matches[0] = "a.c";
+    matches[1] = "b.c";
+    matches[2] = NULL;
+    *matches_out = matches;
+    return 2;
+}
+
+static void test_quoted_metacharacters_do_not_glob(void) {
+    // Arrange
+    Arena arena = {0};
+    char **buffer;
+    const TokenizerHooks hooks = {.glob = record_test_pattern};
+    const char *input = "ls *.c '*.c' \\*.c \"*\".c x*.h a\\\\b";
+    const char *expected[] = {"ls", "a.c", "b.c", "*.c", "*.c", "*.c", "x*.h", "a\\b", NULL};
+
+    // Act
+    const int result =
+        tokenize_input_expand(&arena, input, strlen(input), &hooks, &buffer, NULL);
+
+    // Assert
+    assert(result == 8);
+    for (int i = 0; expected[i]; i++)
+        assert(!strcmp(buffer[i], expected[i]));
+    assert(buffer[8] == NULL);
+
+    // Cleanup
+    arena_destroy(&arena);
+}
+
+static const char *echo_test_command(void *ctx, Arena *arena, const char *command,
+                                     const size_t len) {
+    (void)ctx;
+    // Stands in for running the command: "echo WORDS" outputs WORDS
+    if (len < 5 || strncmp(command, "echo ", 5))
+        return "";
+    return arena_strndup(arena, command + 5, len - 5);
+}
+
+static void test_substitutes_commands(void) {
+    // Arrange
+    Arena arena = {0};
+    char **buffer;
+    const TokenizerHooks hooks = {.substitute = echo_test_command};
+    const char *input = "x$(echo a  b)y \"$(echo (c)  d)\" `echo \\`e\\`` '$(echo f)' $(true)";
+    const char *expected[] = {"xa", "by", "(c)  d", "`e`", "$(echo f)", NULL};
+
+    // Act
+    const int result =
+        tokenize_input_expand(&arena, input, strlen(input), &hooks, &buffer, NULL);
+
+    // Assert
+    assert(result == 5);
+    for (int i = 0; expected[i]; i++)
+        assert(!strcmp(buffer[i], expected[i]));
+    assert(tokenize_input_expand(&arena, "echo $(echo", 11, &hooks, &buffer, NULL) == -1);
 
     // Cleanup
-    free_tokens(buffer, result);
+    arena_destroy(&arena);
+}
+
+static void test_escaped_backquote_in_double_quotes_is_literal(void) {
+    // Arrange
+    Arena arena = {0};
+    char **buffer;
+    const TokenizerHooks hooks = {.substitute = echo_test_command};
+    const char *input = "echo \"a \\` b\" \"\\`echo c\\`\" \"`echo \\`d\\``\"";
+    const char *expected[] = {"echo", "a ` b", "`echo c`", "`d`", NULL};
+
+    // Act
+    const int result =
+        tokenize_input_expand(&arena, input, strlen(input), &hooks, &buffer, NULL);
+
+    // Assert
+    assert(result == 4);
+    for (int i = 0; expected[i]; i++)
+        assert(!strcmp(buffer[i], expected[i]));
+
+    // Cleanup
+    arena_destroy(&arena);
+}
+
+static const char *lookup_x(void *ctx, const char *name, const size_t len) {
+    (void)ctx;
+    return len == 1 && name[0] == 'X' ? "v" : NULL;
+}
+
+// Records the delimiters it is asked for and hands out fds 7, 8, ...
+static char here_calls[4][16];
+static int here_call_count;
+
+static int record_here_document(void *ctx, Arena *arena, const char *delimiter,
+                                const bool strip_tabs, const bool expand) {
+    (void)ctx;
+    (void)arena;
+    snprintf(here_calls[here_call_count], sizeof(here_calls[0]), "%s %d%d", delimiter,
+             strip_tabs, expand);
+    return 7 + here_call_count++;
+}
+
+static void test_here_document_delimiters(void) {
+    // Arrange
+    Arena arena = {0};
+    char **buffer;
+    const TokenizerHooks hooks = {.lookup = lookup_x, .here_document = record_here_document};
+    const char *input = "cat <<EOF 3<<-'E$X' <<<$X x<<E\\\\";
+    const char *expected[] = {"cat", "<<", "7", "3<<-", "8", "<<<", "v", "x", "<<", "9", NULL};
+
+    // Act
+    const int result =
+        tokenize_input_expand(&arena, input, strlen(input), &hooks, &buffer, NULL);
+
+    // Assert
+    assert(result == 10);
+    for (int i = 0; expected[i]; i++)
+        assert(!strcmp(buffer[i], expected[i]));
+    assert(here_call_count == 3);
+    assert(!strcmp(here_calls[0], "EOF 01"));
+    assert(!strcmp(here_calls[1], "E$X 10"));
+    assert(!strcmp(here_calls[2], "E\\ 00"));
+
+    // Cleanup
+    arena_destroy(&arena);
+}
+
+static void test_expands_here_document_lines(void) {
+    // Arrange
+    Arena arena = {0};
+    const TokenizerHooks hooks = {.lookup = lookup_x, .substitute = echo_test_command};
+    const char *line = "a $X \\$X \"$X\" '$(echo  b)' \\y `echo c`";
+    size_t len;
+
+    // Act
+    const char *result = tokenize_here_document(&arena, line, strlen(line), &hooks, &len);
+
+    // Assert
+    assert(result && !strcmp(result, "a v $X \"v\" ' b' \\y c"));
+    assert(len == strlen(result));
+
+    // Cleanup
+    arena_destroy(&arena);
+}
+
+static unsigned next_random(unsigned *state) {
+    *state = *state * 1103515245u + 12345u;
+    return (*state >> 16) & 0x7fff;
+}
+
+static int tokenize_with(const TokenizerScanImpl impl, Arena *arena, const char *input,
+                         char ***tokens) {
+    const bool supported = tokenizer_set_scan_impl(impl);
+    assert(supported);
+    return tokenize_input(arena, input, tokens);
+}
+
+static void test_simd_scanners_match_scalar_reference(void) {
+    // Delimiters are mixed with plain bytes so runs straddle 16 and 32 byte boundaries
+    static const char alphabet[] = "abcdefghij \t'\"\\|<>&$`xyz0123456789-_./";
+    const TokenizerScanImpl impls[] = {TOKENIZER_SCAN_SSE2, TOKENIZER_SCAN_AVX2};
+    unsigned seed = 42;
+
+    for (int round = 0; round < 2000; round++) {
+        // Arrange
+        Arena arena = {0};
+        char input[256];
+        const int len = (int)(next_random(&seed) % (sizeof(input) - 1));
+        const bool sparse = round % 2 == 0;
+        for (int i = 0; i < len; i++) {
+            const unsigned r = next_random(&seed);
+            input[i] = sparse && r % 8 != 0 ? (char)('a' + r % 26)
+                                            : alphabet[r % (sizeof(alphabet) - 1)];
+        }
+        input[len] = '\0';
+
+        char **expected;
+        const int expected_count = tokenize_with(TOKENIZER_SCAN_SCALAR, &arena, input, &expected);
+
+        for (size_t k = 0; k < sizeof(impls) / sizeof(impls[0]); k++) {
+            if (!tokenizer_set_scan_impl(impls[k]))
+                continue; // Not available on this CPU/build
+
+            // Act
+            char **actual;
+            const int actual_count = tokenize_input(&arena, input, &actual);
+
+            // Assert
+            assert(actual_count == expected_count);
+            for (int i = 0; i < actual_count; i++)
+                assert(!strcmp(actual[i], expected[i]));
+        }
+
+        // Cleanup
+        arena_destroy(&arena);
+    }
+
+    tokenizer_set_scan_impl(TOKENIZER_SCAN_AUTO);
+}
+
+int main(void) {
+    test_splits_on_whitespace();
+    test_pipe_is_its_own_token();
+    test_redirection_operators_are_tokens();
+    test_quoted_operators_are_words();
+    test_unquoted_operators_are_marked();
+    test_ampersand_is_its_own_token();
+    test_long_lines_have_no_token_or_argument_cap();
+    test_expands_parameters();
+    test_quoted_metacharacters_do_not_glob();
+    test_substitutes_commands();
+    test_escaped_backquote_in_double_quotes_is_literal();
+    test_here_document_delimiters();
+    test_expands_here_document_lines();
+    test_simd_scanners_match_scalar_reference();
     return 0;
 }
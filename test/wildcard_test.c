@@ -0,0 +1,112 @@
+#define _POSIX_C_SOURCE 200809L
+#include "../src/wildcard.h"
+#include <assert.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static char scratch_dir[] = "/tmp/wildcard_test.XXXXXX";
+static const char *const files[] = {"b.tar", "a.tar", "B.tar",  "c.txt",  ".hidden.tar",
+                                    "x*y",   "d1/f.c", "d2/g.c", "d2/h.h", NULL};
+
+static void touch(const char *path) {
+    const int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    assert(fd != -1);
+    close(fd);
+}
+
+static void make_tree(void) {
+    const char *dir = mkdtemp(scratch_dir);
+    assert(dir);
+    const int entered = chdir(scratch_dir);
+    assert(entered == 0);
+
+    const int made = mkdir("d1", 0755) | mkdir("d2", 0755);
+    assert(made == 0);
+    for (int i = 0; files[i]; i++)
+        touch(files[i]);
+}
+
+static void assert_matches(const char *pattern, const char *expected[]) {
+    // Arrange
+    Arena arena = {0};
+    char **matches;
+
+    // Act
+    const int count = wildcard_expand(&arena, pattern, &matches);
+
+    // Assert
+    int expected_count = 0;
+    while (expected[expected_count])
+        expected_count++;
+    assert(count == expected_count);
+    for (int i = 0; i < count; i++)
+        assert(!strcmp(matches[i], expected[i]));
+    assert(count == 0 || matches[count] == NULL);
+
+    // Cleanup
+    arena_destroy(&arena);
+}
+
+static void test_star_matches_sorted_bytewise(void) {
+    assert_matches("*.tar", (const char *[]){"B.tar", "a.tar", "b.tar", NULL});
+}
+
+static void test_hidden_names_need_a_literal_dot(void) {
+    assert_matches("*hidden*", (const char *[]){NULL});
+    assert_matches(".h*", (const char *[]){".hidden.tar", NULL});
+}
+
+static void test_question_mark_and_classes(void) {
+    assert_matches("?.t?t", (const char *[]){"c.txt", NULL});
+    assert_matches("[ab].tar", (const char *[]){"a.tar", "b.tar", NULL});
+    assert_matches("[!ab].*", (const char *[]){"B.tar", "c.txt", NULL});
+    assert_matches("[[:upper:]]*", (const char *[]){"B.tar", NULL});
+    assert_matches("[a-b].tar", (const char *[]){"a.tar", "b.tar", NULL});
+}
+
+static void test_escaped_metacharacters_are_literal(void) {
+    assert_matches("x\\*y", (const char *[]){"x*y", NULL});
+    assert_matches("\\*", (const char *[]){NULL});
+}
+
+static void test_only_pattern_segments_are_walked(void) {
+    assert_matches("d*/*.c", (const char *[]){"d1/f.c", "d2/g.c", NULL});
+    assert_matches("d2/*", (const char *[]){"d2/g.c", "d2/h.h", NULL});
+    assert_matches("d*/g.c", (const char *[]){"d2/g.c", NULL});
+    assert_matches("*/", (const char *[]){"d1/", "d2/", NULL});
+}
+
+static void test_absolute_patterns_keep_their_directory(void) {
+    char pattern[256];
+    snprintf(pattern, sizeof(pattern), "%s/d?", scratch_dir);
+    char first[256], second[256];
+    snprintf(first, sizeof(first), "%s/d1", scratch_dir);
+    snprintf(second, sizeof(second), "%s/d2", scratch_dir);
+    assert_matches(pattern, (const char *[]){first, second, NULL});
+}
+
+static void remove_tree(void) {
+    for (int i = 0; files[i]; i++)
+        unlink(files[i]);
+    rmdir("d1");
+    rmdir("d2");
+    const int left = chdir("/");
+    assert(left == 0);
+    rmdir(scratch_dir);
+}
+
+int main(void) {
+    make_tree();
+    test_star_matches_sorted_bytewise();
+    test_hidden_names_need_a_literal_dot();
+    test_question_mark_and_classes();
+    test_escaped_metacharacters_are_literal();
+    test_only_pattern_segments_are_walked();
+    test_absolute_patterns_keep_their_directory();
+    remove_tree();
+    return 0;
+}
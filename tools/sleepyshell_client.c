@@ -0,0 +1,102 @@
+#define _POSIX_C_SOURCE 200809L
+#include "../src/serve.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Runs a script on a sleepyshell --serve server, with this process's stdin, stdout and stderr.
+// Usage: sleepyshell_client SOCKET [COMMAND...]
+// The arguments are joined with spaces, as by `sh -c "$*"`; without any, the script is read
+// from stdin and the commands get /dev/null as their stdin.
+
+static char *join_arguments(char *argv[], const int argc, size_t *len_out) {
+    size_t len = 0;
+    for (int i = 0; i < argc; i++)
+        len += strlen(argv[i]) + 1;
+
+    char *script = malloc(len + 1);
+    if (!script)
+        return NULL;
+
+    char *p = script;
+    for (int i = 0; i < argc; i++) {
+        const size_t n = strlen(argv[i]);
+        memcpy(p, argv[i], n);
+        p += n;
+        *p++ = i + 1 < argc ? ' ' : '\n';
+    }
+    *p = '\0';
+    *len_out = len;
+    return script;
+}
+
+static char *read_stdin(size_t *len_out) {
+    size_t len = 0, capacity = 4096;
+    char *script = malloc(capacity);
+    while (script) {
+        if (len == capacity) {
+            char *grown = realloc(script, capacity *= 2);
+            if (!grown) {
+                free(script);
+                return NULL;
+            }
+            script = grown;
+        }
+        const ssize_t n = read(STDIN_FILENO, script + len, capacity - len);
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n == -1) {
+            free(script);
+            return NULL;
+        }
+        if (n == 0)
+            break;
+        len += n;
+    }
+    *len_out = len;
+    return script;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s SOCKET [COMMAND...]\n", argv[0]);
+        return 2;
+    }
+
+    size_t len;
+    char *script = argc > 2 ? join_arguments(argv + 2, argc - 2, &len) : read_stdin(&len);
+    if (!script) {
+        perror("sleepyshell_client");
+        return 2;
+    }
+
+    int fds[3] = {STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO};
+    if (argc == 2 && (fds[0] = open("/dev/null", O_RDONLY)) == -1) {
+        perror("/dev/null");
+        return 2;
+    }
+
+    const int sock = serve_connect(argv[1]);
+    if (sock == -1) {
+        fprintf(stderr, "sleepyshell_client: %s: %s\n", argv[1], strerror(errno));
+        return 2;
+    }
+
+    int status;
+    if (!serve_send_request(sock, script, len, fds)) {
+        perror("sleepyshell_client: send");
+        return 2;
+    }
+    if (!serve_read_status(sock, &status)) {
+        fprintf(stderr, "sleepyshell_client: connection closed before the script finished\n");
+        return 2;
+    }
+
+    free(script);
+    close(sock);
+    return status;
+}